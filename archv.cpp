@@ -0,0 +1,2289 @@
+/* ============================================================================================
+  archv.cpp                        Version 1           Last Update: 10/19/2026
+
+  Implementation of libarchv: the procedures that used to be copied in each of the Arch-V
+  programs (parameter file, keypoint filter, ratio / symmetry / RANSAC tests), the feature
+  extractor, the corpus of feature files and the query of a corpus with a seed image.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include "archv.hpp"
+#include "featurestore.hpp"
+#include "hammingindex.hpp"
+
+#include "opencv2/calib3d/calib3d.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+#include "opencv2/highgui/highgui.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <cstdlib>
+#include <cctype>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <cfloat>
+#include <cmath>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <errno.h>
+
+using namespace cv;
+using namespace std;
+
+namespace archv
+{
+
+/* ===============================================================================================
+   Default SURF parameters
+   =============================================================================================== */
+SurfParams::SurfParams ()
+  : minHessian (2000), octaves (8), octaveLayers (8), sizeMin (50), responseMin (100),
+    descriptor (DESCRIPTOR_SURF), maxFeatures (1000), threshold (30)
+{
+}
+
+SurfParams::SurfParams (int minh, int oct, int layers, int sizemin, double responsemin)
+  : minHessian (minh), octaves (oct), octaveLayers (layers), sizeMin (sizemin), responseMin (responsemin),
+    descriptor (DESCRIPTOR_SURF), maxFeatures (1000), threshold (30)
+{
+}
+
+/* ===============================================================================================
+   Procedure to read parameters for SURF from the parameter file
+   =============================================================================================== */
+void read_surfparams (string param, int *minHessian, int *octaves, int *octaveLayers, int *SizeMin, double *RespMin)
+{
+  ifstream inFile;
+  inFile.open(param.c_str());
+	string record;
+	stringstream ss;
+
+	while ( !inFile.eof () ) {    
+		getline(inFile,record);
+		if (record.find("minHessian") != std::string::npos) {
+			ss<<record.substr(record.find_last_of(":") + 1);
+			ss>> *minHessian;
+			ss.str("");
+			ss.clear();
+		}
+		if (record.find("octaves") != std::string::npos) {
+			ss<<record.substr(record.find_last_of(":") + 1);
+			ss>> *octaves;
+			ss.str("");
+			ss.clear();
+		}
+		if (record.find("octaveLayers") != std::string::npos) {
+			ss<<record.substr(record.find_last_of(":") + 1);
+			ss>> *octaveLayers;
+			ss.str("");
+			ss.clear();
+		}
+		if (record.find("min Size") != std::string::npos) {
+			ss<<record.substr(record.find_last_of(":") + 1);
+			ss>> *SizeMin;
+			ss.str("");
+			ss.clear();
+		}
+		if (record.find("min Resp") != std::string::npos) {
+			ss<<record.substr(record.find_last_of(":") + 1);
+			ss>> *RespMin;
+			ss.str("");
+			ss.clear();
+		}
+	}
+}
+
+void read_surfparams (string param, SurfParams &params)
+{
+  read_surfparams (param, &params.minHessian, &params.octaves, &params.octaveLayers, &params.sizeMin, &params.responseMin);
+  read_descriptorparams (param, params);
+}
+
+/* ===============================================================================================
+   Keys of the binary descriptors in the parameter file: "descriptor: surf|orb|brisk",
+   "max Features: N" (ORB) and "threshold: N" (BRISK)
+   =============================================================================================== */
+void read_descriptorparams (string param, SurfParams &params)
+{
+  ifstream inFile (param.c_str());
+  string record;
+  while (getline (inFile, record))
+  {
+    if (record.find (":") == string::npos)
+      continue;
+    stringstream ss (record.substr (record.find_last_of (":") + 1));
+    if (record.find ("descriptor") != string::npos)
+    {
+      string name;
+      ss >> name;
+      int descriptor = descriptor_type (name);
+      if (descriptor >= 0)
+        params.descriptor = descriptor;
+      else
+        cerr << "unknown descriptor in " << param << ": " << name << " (SURF is used)" << endl;
+    }
+    if (record.find ("max Features") != string::npos)
+      ss >> params.maxFeatures;
+    if (record.find ("threshold") != string::npos)
+      ss >> params.threshold;
+  }
+}
+
+/* ===============================================================================================
+   Descriptor names, as written in the parameter file (case does not matter); -1 if unknown
+   =============================================================================================== */
+static const char *DESCRIPTOR_NAMES[] = { "surf", "orb", "brisk" };
+
+int descriptor_type (string name)
+{
+  for (int c = 0; c < name.size(); c++)
+    name[c] = tolower (name[c]);
+  for (int d = 0; d < 3; d++)
+    if (name == DESCRIPTOR_NAMES[d])
+      return d;
+  return -1;
+}
+
+string descriptor_name (int descriptor)
+{
+  return descriptor >= 0 && descriptor < 3 ? DESCRIPTOR_NAMES[descriptor] : "unknown";
+}
+
+/* ===============================================================================================
+   Detector / descriptor of the parameters. SURF is created with extended = false: the 64-float
+   descriptors the default SurfDescriptorExtractor computed. ORB uses "octaves" pyramid levels
+   of scale factor 1.2, BRISK "octaves" octaves.
+   =============================================================================================== */
+Ptr<Feature2D> create_feature2d (const SurfParams &params)
+{
+  switch (params.descriptor)
+  {
+    case DESCRIPTOR_ORB:
+      return new ORB (params.maxFeatures, 1.2f, params.octaves);
+    case DESCRIPTOR_BRISK:
+      return new BRISK (params.threshold, params.octaves);
+    default:
+      return new SURF (params.minHessian, params.octaves, params.octaveLayers, false, false);
+  }
+}
+
+/* ===============================================================================================
+   Procedure to extract list of files from a directory; returns errno if the directory
+   cannot be read
+   =============================================================================================== */
+int get_filelist (string directory, vector<string> &files) 
+{
+  DIR *dp;
+  struct dirent *dirp;
+  if((dp  = opendir(directory.c_str())) == NULL) {
+    return errno;
+  }
+
+  while ((dirp = readdir(dp)) != NULL) {
+    files.push_back(string(dirp->d_name));
+  }
+  closedir(dp);
+  return 0;
+}
+
+/* ===============================================================================================
+   Procedure to extract the list of image files (.jpg extension) from a directory
+   =============================================================================================== */
+int get_imagelist (string directory, vector<string> &images)
+{
+  vector<string> allfiles;
+
+  int ierr = get_filelist (directory, allfiles);
+  if (ierr != 0)
+    return ierr;
+
+  string filename;
+  for (int i = 0; i < allfiles.size(); i++)
+  {
+    filename = allfiles[i];
+    if (filename.substr (filename.find_last_of(".") + 1) == "jpg")
+      images.push_back (filename);
+  }
+  return 0;
+}
+
+/* ===============================================================================================
+   Number of worker threads to use by default: one per core
+   =============================================================================================== */
+int default_threads ()
+{
+  int n = thread::hardware_concurrency();
+  return n > 0 ? n : 1;
+}
+
+/* ===============================================================================================
+   Run a loop body over a range with a pool of threads; each thread repeatedly takes the next
+   chunk of indices until the range is exhausted
+   =============================================================================================== */
+static void run_chunks (const Range &range, const ParallelLoopBody &body, int chunk, atomic<int> *next)
+{
+  int start;
+  while ((start = next->fetch_add (chunk)) < range.end)
+    body (Range (start, min (start + chunk, range.end)));
+}
+
+void run_parallel (const Range &range, const ParallelLoopBody &body, int nthreads, int chunk)
+{
+  if (nthreads <= 0)
+    nthreads = default_threads();
+  if (chunk < 1)
+    chunk = 1;
+
+  atomic<int> next (range.start);
+
+  if (nthreads == 1)
+  {
+    run_chunks (range, body, chunk, &next);
+    return;
+  }
+
+  vector<thread> workers;
+  for (int i = 0; i < nthreads; i++)
+    workers.push_back (thread (run_chunks, cref(range), cref(body), chunk, &next));
+  for (int i = 0; i < nthreads; i++)
+    workers[i].join();
+}
+
+/* ===============================================================================================
+   Procedures to read / write the keypoints and descriptors of an image in YAML format;
+   descriptors are only present when there is at least one keypoint. Binary feature files
+   (.akf, see featurestore.hpp) are read into the buffers of "features", which are reused,
+   and only their sections holding the requested "fields" are read. A YAML file has to be
+   parsed entirely; the fields that were not requested are dropped afterwards.
+   =============================================================================================== */
+int read_features (string filename, Features &features, int fields)
+{
+  if (is_binary_featurefile (filename))
+    return read_binary_features (filename, features, NULL, fields);
+
+  features.keypoints.clear();
+  features.descriptors.release();
+  features.points.release();
+  features.shape.release();
+
+  FileStorage fs (filename, FileStorage::READ);
+  if (!fs.isOpened())
+    return -1;
+
+  read (fs["keypoints"], features.keypoints);
+  if (features.keypoints.size() > 0)
+    fs["descriptors"] >> features.descriptors;
+
+  fs.release();
+  select_fields (features, fields);
+  return 0;
+}
+
+/* ===============================================================================================
+   Keep only some fields of features read in full: unless all the keypoint fields are kept,
+   the keypoints are replaced by their point (and shape) columns
+   =============================================================================================== */
+void select_fields (Features &features, int fields)
+{
+  if (!(fields & FIELD_DESCRIPTORS))
+    features.descriptors.release();
+  if ((fields & FIELDS_KEYPOINTS) == FIELDS_KEYPOINTS || features.keypoints.size() == 0)
+    return;
+
+  int npoints = features.keypoints.size();
+  if (fields & FIELD_POINTS)
+  {
+    features.points.create (npoints, 1, CV_32FC2);
+    for (int i = 0; i < npoints; i++)
+      features.points.at<Point2f>(i) = features.keypoints[i].pt;
+  }
+  if (fields & FIELD_SHAPE)
+  {
+    features.shape.create (npoints, 1, CV_32FC2);
+    for (int i = 0; i < npoints; i++)
+      features.shape.at<Point2f>(i) = Point2f (features.keypoints[i].size, features.keypoints[i].angle);
+  }
+  features.keypoints.clear();
+}
+
+int write_features (string filename, const Features &features)
+{
+  FileStorage fs (filename, FileStorage::WRITE);
+  if (!fs.isOpened())
+    return -1;
+
+  fs << "keypoints" << features.keypoints;
+  if (features.keypoints.size() > 0)
+    fs << "descriptors" << features.descriptors;
+
+  fs.release();
+  return 0;
+}
+
+/* ===============================================================================================
+   Detection mask for a region of a seed image: rectangle "x,y,w,h" and/or polygon file
+   =============================================================================================== */
+int seed_mask (Size size, string roi, string polygonfile, Mat &mask)
+{
+  mask.release();
+  if (roi == "" && polygonfile == "")
+    return 0;
+
+  // separators (commas, spaces) are all read as spaces
+  Mat region (size, CV_8U, Scalar (255));
+  if (roi != "")
+  {
+    replace (roi.begin(), roi.end(), ',', ' ');
+    stringstream ss (roi);
+    int x, y, w, h;
+    if (!(ss >> x >> y >> w >> h) || w <= 0 || h <= 0)
+      return -1;
+    Mat inside (size, CV_8U, Scalar (0));
+    rectangle (inside, Rect (x, y, w, h), Scalar (255), CV_FILLED);
+    bitwise_and (region, inside, region);
+  }
+
+  if (polygonfile != "")
+  {
+    ifstream in (polygonfile.c_str());
+    if (!in.is_open())
+      return -1;
+    vector<Point> polygon;
+    string line;
+    while (getline (in, line))
+    {
+      replace (line.begin(), line.end(), ',', ' ');
+      stringstream ss (line);
+      int x, y;
+      if (ss >> x >> y)
+        polygon.push_back (Point (x, y));
+    }
+    if (polygon.size() < 3)
+      return -1;
+    Mat inside (size, CV_8U, Scalar (0));
+    const Point *vertices = &polygon[0];
+    int nvertices = polygon.size();
+    fillPoly (inside, &vertices, &nvertices, 1, Scalar (255));
+    bitwise_and (region, inside, region);
+  }
+
+  mask = region;
+  return 0;
+}
+
+/* ===============================================================================================
+   Bounding box of the keypoints of an image that take part in a list of matches (train side)
+   =============================================================================================== */
+Rect match_region (const Features &features, const vector<DMatch> &matches)
+{
+  if (matches.size() == 0)
+    return Rect();
+
+  float xmin = FLT_MAX, ymin = FLT_MAX, xmax = -FLT_MAX, ymax = -FLT_MAX;
+  for (int m = 0; m < matches.size(); m++)
+  {
+    Point2f p = features.point (matches[m].trainIdx);
+    xmin = min (xmin, p.x);
+    ymin = min (ymin, p.y);
+    xmax = max (xmax, p.x);
+    ymax = max (ymax, p.y);
+  }
+
+  int x = floor (xmin), y = floor (ymin);
+  return Rect (x, y, (int) ceil (xmax) - x + 1, (int) ceil (ymax) - y + 1);
+}
+
+/* ===============================================================================================
+   Combine images into a contact sheet. The rows are as high as their highest scaled image;
+   the titles go in the spacer above each image.
+   =============================================================================================== */
+Mat combine_images (const vector<Mat> &images, const vector<string> &titles, int columns, int cellwidth)
+{
+  int spacer_x = 20;
+  int spacer_y = 20;
+  int nimage = images.size();
+  if (columns < 1)
+    columns = 1;
+
+  if (cellwidth <= 0)
+    for (int i = 0; i < nimage; i++)
+      cellwidth = max (cellwidth, images[i].cols);
+  if (nimage == 0 || cellwidth <= 0)
+    return Mat();
+
+  // scaled height of every image, and height of every row
+  int nrows = (nimage + columns - 1)/columns;
+  vector<int> heights (nimage, 0);
+  vector<int> rowheight (nrows, 0);
+  for (int i = 0; i < nimage; i++)
+  {
+    if (!images[i].empty())
+      heights[i] = cvRound (images[i].rows * ((double) cellwidth/images[i].cols));
+    rowheight[i/columns] = max (rowheight[i/columns], heights[i]);
+  }
+
+  int size_x = spacer_x*(columns + 1) + cellwidth*columns;
+  int size_y = spacer_y*(nrows + 1);
+  for (int r = 0; r < nrows; r++)
+    size_y += rowheight[r];
+
+  Mat sheet (Size (size_x, size_y), CV_8UC3, Scalar (255, 255, 255));
+
+  Mat scaled;
+  int offset_y = spacer_y;
+  for (int i = 0; i < nimage; i++)
+  {
+    int column = i % columns;
+    int offset_x = spacer_x + column*(cellwidth + spacer_x);
+
+    if (!images[i].empty())
+    {
+      resize (images[i], scaled, Size (cellwidth, heights[i]), 0, 0, INTER_AREA);
+      if (scaled.channels() == 1)
+        cvtColor (scaled, scaled, CV_GRAY2BGR);
+      Mat target = sheet (Rect (offset_x, offset_y, cellwidth, heights[i]));
+      scaled.copyTo (target);
+    }
+    if (i < titles.size())
+      putText (sheet, titles[i], Point (offset_x + spacer_x, offset_y - spacer_y/2), CV_FONT_HERSHEY_PLAIN, 0.7, Scalar (0, 0, 0));
+
+    if (column == columns - 1)
+      offset_y += rowheight[i/columns] + spacer_y;
+  }
+
+  return sheet;
+}
+
+/* ===============================================================================================
+   Thumbnail of an image: <thumbdir>/<image name>_t<factor>.jpg
+   =============================================================================================== */
+string thumbnail_file (string thumbdir, string imagefile, int factor)
+{
+  if (thumbdir != "" && *thumbdir.rbegin() != '/')
+    thumbdir.append ("/");
+  string base = imagefile.substr (imagefile.find_last_of ("/") + 1);
+  base = base.substr (0, base.find_last_of ("."));
+
+  ostringstream name;
+  name << thumbdir << base << "_t" << factor << ".jpg";
+  return name.str();
+}
+
+/* ===============================================================================================
+   Write the thumbnails of a decoded image. Each level is reduced from the previous one rather
+   than from the original, which keeps the cost well below that of a second decode.
+   =============================================================================================== */
+int write_thumbnails (const Mat &image, string thumbdir, string imagefile)
+{
+  if (image.empty())
+    return -1;
+
+  Mat previous = image;
+  int previousfactor = 1;
+  Mat thumbnail;
+  for (int t = 0; t < NTHUMBNAILS; t++)
+  {
+    int factor = THUMBNAIL_FACTORS[t];
+    double scale = (double) previousfactor/factor;
+    Size size (max (1, cvRound (previous.cols*scale)), max (1, cvRound (previous.rows*scale)));
+    resize (previous, thumbnail, size, 0, 0, INTER_AREA);
+    if (!imwrite (thumbnail_file (thumbdir, imagefile, factor), thumbnail))
+      return -1;
+    thumbnail.copyTo (previous);
+    previousfactor = factor;
+  }
+  return 0;
+}
+
+/* ===============================================================================================
+   Read an image, from its smallest thumbnail that is at least "minwidth" pixels wide when
+   there is one. Returns the reduction factor of what was read (1 for the original).
+   =============================================================================================== */
+int load_image (string imagefile, string thumbdir, int minwidth, Mat &image)
+{
+  if (thumbdir != "")
+    for (int t = NTHUMBNAILS - 1; t >= 0; t--)
+    {
+      image = imread (thumbnail_file (thumbdir, imagefile, THUMBNAIL_FACTORS[t]));
+      if (!image.empty() && image.cols >= minwidth)
+        return THUMBNAIL_FACTORS[t];
+    }
+
+  image = imread (imagefile);
+  return 1;
+}
+
+/* ===============================================================================================
+   Scale keypoint positions and sizes, e.g. by 1/factor to draw them on a thumbnail
+   =============================================================================================== */
+void scale_keypoints (vector<KeyPoint> &keypoints, double scale)
+{
+  for (int i = 0; i < keypoints.size(); i++)
+  {
+    keypoints[i].pt.x *= scale;
+    keypoints[i].pt.y *= scale;
+    keypoints[i].size *= scale;
+  }
+}
+
+/* ===============================================================================================
+   Procedure to filter the keypoints from the keypoint vector by minimum size and response
+   =============================================================================================== */
+void filter_keypoints (vector <KeyPoint> &keypoints, int sizemin, double responsemin)
+{
+  vector <KeyPoint> temp;
+  int npoints = keypoints.size();
+  int size;
+  double response;
+
+  //filter based on size and response size
+  for (int i = 0; i < npoints; i++)
+  {
+    size = keypoints[i].size;
+    response = keypoints[i].response;
+    if (size > sizemin && response > responsemin)
+      temp.push_back(keypoints[i]);
+  }
+
+  keypoints.clear();
+  keypoints = temp;
+
+  return;
+}
+
+/* ===============================================================================================
+   Feature extractor: one detector / descriptor object built from the parameters (see
+   create_feature2d) does detection and description
+   =============================================================================================== */
+FeatureExtractor::FeatureExtractor (const SurfParams &params)
+  : surfparams (params),
+    mode (EXTRACT_AUTO),
+    engine (create_feature2d (params))
+{
+}
+
+/* ===============================================================================================
+   Grey level version of an image, in a per-thread buffer kept from one image to the next:
+   the buffer only grows, so images of similar sizes reuse the same memory
+   =============================================================================================== */
+struct GreyScratch
+{
+  Mat buffer;
+  Mat grey;
+};
+
+static const Mat &grey_image (const Mat &image, GreyScratch &scratch)
+{
+  if (image.channels() == 1)
+    return image;
+
+  size_t needed = image.total();
+  if (scratch.buffer.total() < needed)
+    scratch.buffer.create (1, needed + needed/4, CV_8U);
+  scratch.grey = Mat (image.rows, image.cols, CV_8U, scratch.buffer.data);
+  cvtColor (image, scratch.grey, image.channels() == 4 ? CV_BGRA2GRAY : CV_BGR2GRAY);
+  return scratch.grey;
+}
+
+static thread_local GreyScratch greyScratch;
+
+/* ===============================================================================================
+   The fused pass is used when asked for, or by default when the filter cannot reject any
+   keypoint (all detected keypoints have a response above minHessian and a positive size)
+   and for the binary descriptors
+   =============================================================================================== */
+bool FeatureExtractor::fused () const
+{
+  if (mode != EXTRACT_AUTO)
+    return mode == EXTRACT_FUSED;
+  if (surfparams.descriptor != DESCRIPTOR_SURF)
+    return true;
+  return surfparams.sizeMin <= 0 && surfparams.responseMin < surfparams.minHessian;
+}
+
+/* ===============================================================================================
+   Detect keypoints and filter them; returns the number of keypoints before filtering
+   =============================================================================================== */
+int FeatureExtractor::detect (const Mat &image, vector<KeyPoint> &keypoints, const Mat &mask) const
+{
+  keypoints.clear();
+  engine->detect (grey_image (image, greyScratch), keypoints, mask);
+  int ndetected = keypoints.size();
+  filter_keypoints (keypoints, surfparams.sizeMin, surfparams.responseMin);
+  return ndetected;
+}
+
+/* ===============================================================================================
+   Compute the descriptors of a set of keypoints
+   =============================================================================================== */
+void FeatureExtractor::describe (const Mat &image, vector<KeyPoint> &keypoints, Mat &descriptors) const
+{
+  descriptors.release();
+  if (keypoints.size() > 0)
+    engine->compute (grey_image (image, greyScratch), keypoints, descriptors);
+}
+
+/* ===============================================================================================
+   Detect, filter and describe; returns the number of keypoints before filtering. The image is
+   converted to grey levels once for both passes (split) or for the single pass (fused); in the
+   fused pass the descriptor rows of the kept keypoints are compacted in place. In the split
+   pass, the seconds spent detecting (with the grey conversion and the filter) and describing
+   are added to "detectSeconds" and "describeSeconds" when given.
+   =============================================================================================== */
+int FeatureExtractor::extract (const Mat &image, Features &features, const Mat &mask, double *detectSeconds, double *describeSeconds) const
+{
+  int64 t0 = getTickCount();
+  const Mat &grey = grey_image (image, greyScratch);
+  vector<KeyPoint> &keypoints = features.keypoints;
+  keypoints.clear();
+  features.points.release();
+  features.shape.release();
+
+  // unreadable image: no keypoints, as the separate detect / compute calls give (the fused
+  // call asserts on an empty image)
+  if (image.empty())
+  {
+    features.descriptors.release();
+    return 0;
+  }
+
+  if (!fused())
+  {
+    engine->detect (grey, keypoints, mask);
+    int ndetected = keypoints.size();
+    filter_keypoints (keypoints, surfparams.sizeMin, surfparams.responseMin);
+    int64 t1 = getTickCount();
+    features.descriptors.release();
+    if (keypoints.size() > 0)
+      engine->compute (grey, keypoints, features.descriptors);
+    if (detectSeconds != NULL)
+      *detectSeconds += (t1 - t0)/getTickFrequency();
+    if (describeSeconds != NULL)
+      *describeSeconds += (getTickCount() - t1)/getTickFrequency();
+    return ndetected;
+  }
+
+  (*engine) (grey, mask, keypoints, features.descriptors, false);
+  int ndetected = keypoints.size();
+
+  int kept = 0;
+  for (int i = 0; i < ndetected; i++)
+  {
+    const KeyPoint &p = keypoints[i];
+    if ((int) p.size > surfparams.sizeMin && p.response > surfparams.responseMin)
+    {
+      if (kept != i)
+      {
+        keypoints[kept] = p;
+        Mat target = features.descriptors.row(kept);
+        features.descriptors.row(i).copyTo (target);
+      }
+      kept++;
+    }
+  }
+  keypoints.resize (kept);
+  features.descriptors = kept > 0 ? features.descriptors.rowRange (0, kept) : Mat();
+  return ndetected;
+}
+
+/* ===============================================================================================
+   This function perform a ratio test: 
+   - Clear matches for which NN ratio is > than threshold
+   - return the number of removed points
+   =============================================================================================== */
+int ratioTest(vector<vector<cv::DMatch> > &matches, double ratio) 
+{
+  int removed=0;
+
+	for (vector<vector<cv::DMatch> >::iterator
+		matchIterator= matches.begin();
+		matchIterator!= matches.end(); ++matchIterator) 
+	{
+/*      	==================================================================================
+                if 2 NN have been identified
+        	================================================================================== */
+
+		if (matchIterator->size() > 1)
+    {
+/*      	==================================================================================
+                check distance ratio
+        	================================================================================== */
+
+			if ((*matchIterator)[0].distance/ (*matchIterator)[1].distance > ratio)
+      {
+				matchIterator->clear(); // remove match
+				removed++;
+     	}
+
+		} 
+
+/*      	==================================================================================
+                does not have 2 neighbours, then remove match
+        	================================================================================== */
+		else 
+    {
+			matchIterator->clear(); // remove match
+			removed++;
+		}
+	}
+
+	return removed;
+}
+
+/* ===============================================================================================
+   This function perform a symmetry test:
+   matches from 1 to 2 should match with matches from 2 to 1
+   =============================================================================================== */
+void symmetryTest(const vector<vector<DMatch> >& matches1,const vector<vector<DMatch> >& matches2, vector<DMatch>& symMatches) 
+{
+
+/*     	=========================================================================================
+        for all matches image 1 -> image 2
+       	========================================================================================= */
+
+	for (vector<vector<cv::DMatch> >:: const_iterator matchIterator1= matches1.begin();
+           matchIterator1!= matches1.end(); ++matchIterator1) 
+	{
+         	// ignore deleted matches
+         	if (matchIterator1->size() < 2) continue;
+
+/*     		=================================================================================
+        	for all matches image 2 -> image 1
+       		================================================================================= */
+
+		for (vector<vector<cv::DMatch> >:: const_iterator matchIterator2= matches2.begin();
+		matchIterator2!= matches2.end(); ++matchIterator2) 
+		{
+
+			// ignore deleted matches
+			if (matchIterator2->size() < 2) continue;
+
+/*     			=========================================================================
+        		Symmetry test
+       			========================================================================= */
+
+			if ((*matchIterator1)[0].queryIdx == (*matchIterator2)[0].trainIdx &&
+			(*matchIterator2)[0].queryIdx == (*matchIterator1)[0].trainIdx) 
+			{
+
+				symMatches.push_back(cv::DMatch((*matchIterator1)[0].queryIdx,
+				(*matchIterator1)[0].trainIdx,(*matchIterator1)[0].distance));
+
+				break; // next match in image 1 -> image 2
+
+			}
+		}
+	}
+}
+
+/* ===============================================================================================
+   Identify good matches using RANSAC; return fundamental matrix
+   =============================================================================================== */
+Mat ransacTest(const vector<cv::DMatch>& matches,const vector<cv::KeyPoint>& keypoints1, const vector<cv::KeyPoint>& keypoints2, vector<cv::DMatch>& outMatches) 
+{
+
+/*     	=========================================================================================
+        Convert keypoints1 and keypoints2 into Point2f
+       	========================================================================================= */
+
+	vector<cv::Point2f> points1, points2;
+
+	Mat fundemental;
+
+	for (vector<cv::DMatch>::const_iterator it= matches.begin();it!= matches.end(); ++it) 
+	{
+
+		double x= keypoints1[it->queryIdx].pt.x;
+		double y= keypoints1[it->queryIdx].pt.y;
+		points1.push_back(Point2f(x,y));
+
+		x= keypoints2[it->trainIdx].pt.x;
+		y= keypoints2[it->trainIdx].pt.y;
+		points2.push_back(cv::Point2f(x,y));
+	}
+
+/*     	=========================================================================================
+        Compute fundamental matrix using RANSAC
+       	========================================================================================= */
+
+	vector<uchar> inliers(points1.size(),0);
+
+	double confidence = 0.99;
+	double distance = 3.0;
+	int refineF = 1;
+
+	if (points1.size()>0&&points2.size()>0)
+	{
+
+		Mat fundemental= cv::findFundamentalMat(
+                        cv::Mat(points1),cv::Mat(points2), // matching points
+                        inliers,       // match status (inlier or outlier)
+                        CV_FM_RANSAC, // RANSAC method
+                        distance,      // distance to epipolar line
+                        confidence); // confidence probability
+
+		// extract the surviving (inliers) matches
+
+		vector<uchar>::const_iterator itIn= inliers.begin();
+		vector<cv::DMatch>::const_iterator itM= matches.begin();
+
+		for ( ;itIn!= inliers.end(); ++itIn, ++itM) 
+		{
+			if (*itIn) { // it is a valid match
+				outMatches.push_back(*itM);
+			}
+		}
+
+		if (refineF) {
+
+			// The F matrix will be recomputed with all accepted matches
+			// Convert keypoints into Point2f for final F computation
+
+			points1.clear();
+			points2.clear();
+
+			for (std::vector<cv::DMatch>::const_iterator it= outMatches.begin();it!= outMatches.end(); ++it) 
+			{
+				double x= keypoints1[it->queryIdx].pt.x;
+				double y= keypoints1[it->queryIdx].pt.y;
+				points1.push_back(cv::Point2f(x,y));
+
+				x= keypoints2[it->trainIdx].pt.x;
+				y= keypoints2[it->trainIdx].pt.y;
+				points2.push_back(cv::Point2f(x,y));
+			}
+
+			// Compute 8-point F from all accepted matches
+
+			if (points1.size()>0&&points2.size()>0){
+
+				fundemental= cv::findFundamentalMat(cv::Mat(points1),cv::Mat(points2), // matches
+						CV_FM_8POINT); // 8-point method
+
+			}
+		}
+	}
+
+ return fundemental;
+}
+
+/* ===============================================================================================
+   Two nearest neighbours of every descriptor of set 1 in set 2 and of set 2 in set 1, found
+   in a single pass over all pairs (each distance is computed once and serves both
+   directions). Results go to fixed-stride arrays: neighbours of descriptor i at 2i and 2i+1
+   (-1 if there is none), squared distances alongside: squared L2 for float descriptors, the
+   square of the Hamming distance for binary ones, so that the ratio test and the match
+   distances are the same for both.
+   =============================================================================================== */
+static inline void keep_two (int *best, float *dist, int i, int j, float d)
+{
+  // strict comparisons: among equal distances the first neighbour wins, as in BFMatcher
+  if (d < dist[2*i+1])
+  {
+    if (d < dist[2*i])
+    {
+      dist[2*i+1] = dist[2*i]; best[2*i+1] = best[2*i];
+      dist[2*i] = d; best[2*i] = j;
+    }
+    else
+    {
+      dist[2*i+1] = d; best[2*i+1] = j;
+    }
+  }
+}
+
+static void best_two (const Mat &descriptors1, const Mat &descriptors2, MatchScratch &scratch)
+{
+  int n1 = descriptors1.rows;
+  int n2 = descriptors2.rows;
+  int dim = descriptors1.cols;
+  bool binary = descriptors1.type() == CV_8U;
+
+  scratch.best12.assign (2*n1, -1);
+  scratch.best21.assign (2*n2, -1);
+  scratch.dist12.assign (2*n1, FLT_MAX);
+  scratch.dist21.assign (2*n2, FLT_MAX);
+
+  int *best12 = &scratch.best12[0];
+  int *best21 = &scratch.best21[0];
+  float *dist12 = &scratch.dist12[0];
+  float *dist21 = &scratch.dist21[0];
+
+  for (int i = 0; i < n1; i++)
+  {
+    if (binary)
+    {
+      const uchar *a = descriptors1.ptr<uchar>(i);
+      for (int j = 0; j < n2; j++)
+      {
+        int h = hamming_distance (a, descriptors2.ptr<uchar>(j), dim);
+        float d = (float) (h*h);
+        keep_two (best12, dist12, i, j, d);
+        keep_two (best21, dist21, j, i, d);
+      }
+      continue;
+    }
+
+    const float *a = descriptors1.ptr<float>(i);
+    for (int j = 0; j < n2; j++)
+    {
+      const float *b = descriptors2.ptr<float>(j);
+      float d = 0;
+      for (int k = 0; k < dim; k++)
+      {
+        float t = a[k] - b[k];
+        d += t*t;
+      }
+      keep_two (best12, dist12, i, j, d);
+      keep_two (best21, dist21, j, i, d);
+    }
+  }
+}
+
+/* ===============================================================================================
+   Ratio test on the best two neighbours of descriptor i, on the true (not squared) distances,
+   with the same expression as ratioTest
+   =============================================================================================== */
+static bool pass_ratio (const int *best, const float *dist, int i, double ratio)
+{
+  if (best[2*i+1] < 0)
+    return false;
+  return !(sqrt (dist[2*i])/sqrt (dist[2*i+1]) > ratio);
+}
+
+/* ===============================================================================================
+   Original implementation of the chain, with BFMatcher and the three tests above
+   =============================================================================================== */
+int match_features_knn (const Features &features1, const Features &features2, vector<DMatch> &matches, double ratio)
+{
+  matches.clear();
+  if (features1.size() == 0 || features2.size() == 0)
+    return 0;
+
+  // ransacTest needs KeyPoint objects: rebuild them from the points if needed
+  vector<KeyPoint> points1, points2;
+  for (int i = 0; features1.keypoints.size() == 0 && i < features1.size(); i++)
+    points1.push_back (KeyPoint (features1.point (i), 1));
+  for (int i = 0; features2.keypoints.size() == 0 && i < features2.size(); i++)
+    points2.push_back (KeyPoint (features2.point (i), 1));
+  const vector<KeyPoint> &keypoints1 = features1.keypoints.size() > 0 ? features1.keypoints : points1;
+  const vector<KeyPoint> &keypoints2 = features2.keypoints.size() > 0 ? features2.keypoints : points2;
+
+  BFMatcher matcher (features1.descriptors.type() == CV_8U ? NORM_HAMMING : NORM_L2);
+  vector < vector<DMatch> > matches1;
+  vector < vector<DMatch> > matches2;
+  vector <DMatch> sym_matches;
+
+  matcher.knnMatch(features1.descriptors,features2.descriptors,matches1,2);
+  matcher.knnMatch(features2.descriptors,features1.descriptors,matches2,2);
+
+  ratioTest(matches1,ratio);
+  ratioTest(matches2,ratio);
+
+  symmetryTest(matches1,matches2,sym_matches);
+
+  ransacTest(sym_matches,keypoints1,keypoints2,matches);
+
+  return matches.size();
+}
+
+/* ===============================================================================================
+   Full matching chain between two sets of features: knn matches both ways, ratio test,
+   symmetry test and RANSAC. Returns the number of remaining matches.
+   =============================================================================================== */
+int match_features (const Features &features1, const Features &features2, vector<DMatch> &matches, double ratio)
+{
+  static thread_local MatchScratch scratch;
+  return match_features (features1, features2, matches, ratio, scratch);
+}
+
+int match_features (const Features &features1, const Features &features2, vector<DMatch> &matches, double ratio, MatchScratch &scratch)
+{
+  matches.clear();
+  if (features1.size() == 0 || features2.size() == 0)
+    return 0;
+
+  match_descriptors (features1, features2, ratio, scratch);
+  return match_geometry (features1, features2, matches, scratch);
+}
+
+/* ===============================================================================================
+   First phase: knn matches both ways, ratio and symmetry tests, on the descriptors alone. The
+   symmetric matches are left in scratch.symMatches; returns their number.
+   =============================================================================================== */
+int match_descriptors (const Features &features1, const Features &features2, double ratio, MatchScratch &scratch)
+{
+  vector<DMatch> &symMatches = scratch.symMatches;
+  symMatches.clear();
+
+  const Mat &descriptors1 = features1.descriptors;
+  const Mat &descriptors2 = features2.descriptors;
+  if (descriptors1.empty() || descriptors2.empty() || descriptors1.cols != descriptors2.cols)
+    return 0;
+
+  if (descriptors1.type() != descriptors2.type())
+    return 0;
+  if (descriptors1.type() != CV_32F && descriptors1.type() != CV_8U)
+  {
+    BFMatcher matcher;
+    vector < vector<DMatch> > matches1;
+    vector < vector<DMatch> > matches2;
+    matcher.knnMatch(descriptors1,descriptors2,matches1,2);
+    matcher.knnMatch(descriptors2,descriptors1,matches2,2);
+    ratioTest(matches1,ratio);
+    ratioTest(matches2,ratio);
+    symmetryTest(matches1,matches2,symMatches);
+    return symMatches.size();
+  }
+
+  // best two neighbours both ways, then ratio and symmetry tests: i and j are kept when they
+  // are each other's nearest neighbour and both pass the ratio test
+  best_two (descriptors1, descriptors2, scratch);
+
+  const int *best12 = &scratch.best12[0];
+  const int *best21 = &scratch.best21[0];
+  const float *dist12 = &scratch.dist12[0];
+  const float *dist21 = &scratch.dist21[0];
+
+  for (int i = 0; i < descriptors1.rows; i++)
+  {
+    if (!pass_ratio (best12, dist12, i, ratio))
+      continue;
+    int j = best12[2*i];
+    if (best21[2*j] == i && pass_ratio (best21, dist21, j, ratio))
+      symMatches.push_back (DMatch (i, j, sqrt (dist12[2*i])));
+  }
+  return symMatches.size();
+}
+
+/* ===============================================================================================
+   Strongest keypoints: the indices are sorted by decreasing response (ties by index), the
+   first n are put back in their original order and their keypoints and descriptor rows copied
+   =============================================================================================== */
+struct Stronger
+{
+  const vector<KeyPoint> &keypoints;
+  Stronger (const vector<KeyPoint> &k) : keypoints (k) {}
+
+  bool operator() (int a, int b) const
+  {
+    if (keypoints[a].response != keypoints[b].response)
+      return keypoints[a].response > keypoints[b].response;
+    return a < b;
+  }
+};
+
+int strongest_features (const Features &features, int n, Features &strongest)
+{
+  int nkeypoints = features.keypoints.size();
+  if (n >= features.size() || nkeypoints == 0 || features.descriptors.rows != nkeypoints)
+  {
+    strongest = features;
+    return features.size();
+  }
+
+  vector<int> order (nkeypoints);
+  for (int i = 0; i < nkeypoints; i++)
+    order[i] = i;
+  partial_sort (order.begin(), order.begin() + n, order.end(), Stronger (features.keypoints));
+  order.resize (n);
+  sort (order.begin(), order.end());
+
+  strongest.points.release();
+  strongest.shape.release();
+  strongest.keypoints.resize (n);
+  strongest.descriptors.create (n, features.descriptors.cols, features.descriptors.type());
+  for (int k = 0; k < n; k++)
+  {
+    strongest.keypoints[k] = features.keypoints[order[k]];
+    Mat row = strongest.descriptors.row (k);
+    features.descriptors.row (order[k]).copyTo (row);
+  }
+  return n;
+}
+
+/* ===============================================================================================
+   Principal component projection of descriptors
+   =============================================================================================== */
+double train_projection (const Mat &samples, int dims, bool whiten, Projection &projection)
+{
+  Mat data;
+  samples.convertTo (data, CV_32F);
+  dims = min (dims, data.cols);
+
+  PCA pca (data, noArray(), CV_PCA_DATA_AS_ROW, dims);
+
+  // at most min (rows, cols) components when there are few samples
+  dims = min (dims, pca.eigenvectors.rows);
+  projection.mean = pca.mean.clone();
+  projection.basis = pca.eigenvectors.rowRange (0, dims).clone();
+  projection.scale.release();
+  if (whiten)
+  {
+    projection.scale.create (1, dims, CV_32F);
+    for (int c = 0; c < dims; c++)
+      projection.scale.at<float>(c) = 1.0/sqrt (max (pca.eigenvalues.at<float>(c), FLT_EPSILON));
+  }
+
+  // total variance: the mean squared distance to the mean
+  double total = 0, kept = 0;
+  const float *mean = pca.mean.ptr<float>(0);
+  for (int r = 0; r < data.rows; r++)
+  {
+    const float *x = data.ptr<float>(r);
+    for (int c = 0; c < data.cols; c++)
+      total += (x[c] - mean[c])*(x[c] - mean[c]);
+  }
+  total /= max (data.rows, 1);
+  for (int c = 0; c < dims; c++)
+    kept += pca.eigenvalues.at<float>(c);
+  return total > 0 ? kept/total : 0;
+}
+
+void project_descriptors (const Projection &projection, const Mat &descriptors, Mat &reduced)
+{
+  if (descriptors.empty())
+  {
+    reduced.release();
+    return;
+  }
+
+  // (x - mean) B^T = x B^T - mean B^T: one matrix product, then the offset and the scale per row
+  Mat data = descriptors;
+  if (data.type() != CV_32F)
+    descriptors.convertTo (data, CV_32F);
+  Mat offset;
+  gemm (data, projection.basis, 1, noArray(), 0, reduced, GEMM_2_T);
+  gemm (projection.mean, projection.basis, 1, noArray(), 0, offset, GEMM_2_T);
+
+  int dims = reduced.cols;
+  const float *o = offset.ptr<float>(0);
+  const float *scale = projection.scale.empty() ? NULL : projection.scale.ptr<float>(0);
+  for (int r = 0; r < reduced.rows; r++)
+  {
+    float *x = reduced.ptr<float>(r);
+    for (int c = 0; c < dims; c++)
+      x[c] = scale ? (x[c] - o[c])*scale[c] : x[c] - o[c];
+  }
+}
+
+int write_projection (string filename, const Projection &projection)
+{
+  FileStorage fs (filename, FileStorage::WRITE);
+  if (!fs.isOpened())
+    return -1;
+
+  fs << "mean" << projection.mean;
+  fs << "basis" << projection.basis;
+  if (!projection.scale.empty())
+    fs << "scale" << projection.scale;
+
+  fs.release();
+  return 0;
+}
+
+int read_projection (string filename, Projection &projection)
+{
+  FileStorage fs (filename, FileStorage::READ);
+  if (!fs.isOpened())
+    return -1;
+
+  fs["mean"] >> projection.mean;
+  fs["basis"] >> projection.basis;
+  projection.scale.release();
+  if (!fs["scale"].empty())
+    fs["scale"] >> projection.scale;
+
+  fs.release();
+  if (projection.basis.empty() || projection.mean.cols != projection.basis.cols)
+    return -1;
+  return 0;
+}
+
+/* ===============================================================================================
+   Batched first phase: a block holds the descriptors of several images; images whose
+   descriptors are not float or not of the width of the block take no rows
+   =============================================================================================== */
+static const int SEED_TILE = 256;        // seed rows per matrix product
+
+BatchScratch::BatchScratch ()
+{
+  starts.push_back (0);
+}
+
+void BatchScratch::clear ()
+{
+  if (!block.empty())
+    block.resize (0);
+  starts.assign (1, 0);
+}
+
+void BatchScratch::add (const Mat &descriptors, int width)
+{
+  // the width is that of the seed when given, of the first set of the block otherwise (the
+  // block keeps its columns when cleared); sets of another width are left out, as unmatched
+  if (width <= 0)
+    width = block.cols;
+  if (!descriptors.empty() && descriptors.type() == CV_32F && (width <= 0 || descriptors.cols == width))
+  {
+    if (block.rows == 0 && block.cols != descriptors.cols)
+      block.release();
+    block.push_back (descriptors);
+  }
+  starts.push_back (block.rows);
+}
+
+static void squared_norms (const Mat &descriptors, vector<float> &norms)
+{
+  norms.resize (descriptors.rows);
+  for (int r = 0; r < descriptors.rows; r++)
+  {
+    const float *a = descriptors.ptr<float>(r);
+    float n = 0;
+    for (int k = 0; k < descriptors.cols; k++)
+      n += a[k]*a[k];
+    norms[r] = n;
+  }
+}
+
+void match_descriptors_batch (const Features &seed, double ratio, BatchScratch &batch, vector< vector<DMatch> > &symMatches)
+{
+  int nimages = batch.images();
+  symMatches.resize (nimages);
+  for (int b = 0; b < nimages; b++)
+    symMatches[b].clear();
+
+  const Mat &descriptors = seed.descriptors;
+  int n1 = descriptors.rows;
+  int n2 = batch.rows();
+  if (n1 == 0 || n2 == 0 || descriptors.type() != CV_32F || descriptors.cols != batch.block.cols)
+    return;
+
+  // best two neighbours of seed row i in image b at 2 (b n1 + i), of block row j at 2 j
+  batch.best12.assign (2*n1*nimages, -1);
+  batch.best21.assign (2*n2, -1);
+  batch.dist12.assign (2*n1*nimages, FLT_MAX);
+  batch.dist21.assign (2*n2, FLT_MAX);
+  int *best12 = &batch.best12[0];
+  int *best21 = &batch.best21[0];
+  float *dist12 = &batch.dist12[0];
+  float *dist21 = &batch.dist21[0];
+  const int *starts = &batch.starts[0];
+
+  squared_norms (descriptors, batch.seedNorms);
+  squared_norms (batch.block, batch.blockNorms);
+  const float *seedNorms = &batch.seedNorms[0];
+  const float *blockNorms = &batch.blockNorms[0];
+
+  // tiles of seed rows in increasing order, images and their rows in increasing order: the
+  // neighbours are visited in the order of best_two, so ties are resolved the same way
+  for (int r0 = 0; r0 < n1; r0 += SEED_TILE)
+  {
+    int r1 = min (n1, r0 + SEED_TILE);
+    gemm (descriptors.rowRange (r0, r1), batch.block, -2, noArray(), 0, batch.products, GEMM_2_T);
+
+    for (int i = r0; i < r1; i++)
+    {
+      const float *p = batch.products.ptr<float>(i - r0);
+      for (int b = 0; b < nimages; b++)
+      {
+        int *best = best12 + 2*n1*b;
+        float *dist = dist12 + 2*n1*b;
+        for (int j = starts[b]; j < starts[b+1]; j++)
+        {
+          float d = max (0.0f, seedNorms[i] + blockNorms[j] + p[j]);
+          keep_two (best, dist, i, j - starts[b], d);
+          keep_two (best21, dist21, j, i, d);
+        }
+      }
+    }
+  }
+
+  // ratio and symmetry tests, image by image
+  for (int b = 0; b < nimages; b++)
+  {
+    const int *best = best12 + 2*n1*b;
+    const float *dist = dist12 + 2*n1*b;
+    for (int i = 0; i < n1; i++)
+    {
+      if (!pass_ratio (best, dist, i, ratio))
+        continue;
+      int j = best[2*i];
+      int row = starts[b] + j;
+      if (best21[2*row] == i && pass_ratio (best21, dist21, row, ratio))
+        symMatches[b].push_back (DMatch (i, j, sqrt (dist[2*i])));
+    }
+  }
+}
+
+/* ===============================================================================================
+   Second phase: RANSAC on the fundamental matrix over the symmetric matches of the first
+   phase, using the keypoint coordinates of both images. findFundamentalMat needs at least
+   RANSAC_MIN_MATCHES matches and keeps none below that, so callers can skip loading the
+   geometry of an image when the first phase found fewer. Only the inliers are needed, so the
+   8-point refinement of ransacTest (whose result is not used) is not done.
+   =============================================================================================== */
+int match_geometry (const Features &features1, const Features &features2, vector<DMatch> &matches, MatchScratch &scratch)
+{
+  matches.clear();
+
+  const vector<DMatch> &symMatches = scratch.symMatches;
+  if (symMatches.size() < RANSAC_MIN_MATCHES)
+    return 0;
+
+  vector<Point2f> &points1 = scratch.points1;
+  vector<Point2f> &points2 = scratch.points2;
+  points1.clear();
+  points2.clear();
+  for (int m = 0; m < symMatches.size(); m++)
+  {
+    points1.push_back (features1.point (symMatches[m].queryIdx));
+    points2.push_back (features2.point (symMatches[m].trainIdx));
+  }
+
+  scratch.inliers.assign (points1.size(), 0);
+  findFundamentalMat (Mat (points1), Mat (points2), scratch.inliers, CV_FM_RANSAC, 3.0, 0.99);
+
+  for (int m = 0; m < symMatches.size(); m++)
+    if (scratch.inliers[m])
+      matches.push_back (symMatches[m]);
+
+  return matches.size();
+}
+
+/* ===============================================================================================
+   Corpus: list of images of a directory and location of their feature files
+   =============================================================================================== */
+Corpus::Corpus ()
+  : isloaded (false), selected (FIELDS_ALL)
+{
+}
+
+/* ===============================================================================================
+   Open a corpus: get the image list of the image directory; returns errno on failure
+   =============================================================================================== */
+int Corpus::open (string imgdirectory, string infodirectory)
+{
+  imgdir = imgdirectory;
+  infodir = infodirectory;
+  if (infodir != "" && *infodir.rbegin() != '/')
+    infodir.append ("/");
+
+  images.clear();
+  featurefiles.clear();
+  resident.clear();
+  isloaded = false;
+  lru.reset();
+
+  int ierr = get_imagelist (imgdir, images);
+
+  // sorted, so that every process (or machine) sees the images in the same order
+  sort (images.begin(), images.end());
+
+  // binary feature files are used when present, YAML files otherwise
+  struct stat sb;
+  for (int i = 0; i < images.size(); i++)
+  {
+    string base = infodir + images[i].substr (0, images[i].find_last_of("."));
+    if (stat ((base + ".akf").c_str(), &sb) == 0)
+      featurefiles.push_back (base + ".akf");
+    else
+      featurefiles.push_back (base + ".yml");
+  }
+  return ierr;
+}
+
+/* ===============================================================================================
+   Read all feature files into memory, so that the corpus can be queried repeatedly
+   without going back to disk
+   =============================================================================================== */
+int Corpus::load ()
+{
+  resident.resize (images.size());
+  for (int i = 0; i < images.size(); i++)
+    read_features (featurefile(i), resident[i], selected);
+
+  isloaded = true;
+  return 0;
+}
+
+/* ===============================================================================================
+   Name of an image without its extension, as written in the results
+   =============================================================================================== */
+string Corpus::name (int i) const
+{
+  return images[i].substr (0, images[i].find_last_of("."));
+}
+
+/* ===============================================================================================
+   Size of the feature file of an image in bytes (0 if it does not exist)
+   =============================================================================================== */
+long Corpus::featurebytes (int i) const
+{
+  struct stat sb;
+  if (stat (featurefile(i).c_str(), &sb) != 0)
+    return 0;
+  return sb.st_size;
+}
+
+/* ===============================================================================================
+   Features of an image: returned from memory if the corpus was loaded, otherwise read from
+   disk into the buffer provided by the caller
+   =============================================================================================== */
+const Features &Corpus::features (int i, Features &buffer) const
+{
+  if (isloaded)
+    return resident[i];
+
+  if (lru)
+  {
+    // entries are never modified once cached: a miss is read into a new entry, and the
+    // buffer only gets the keypoints and headers sharing the cached matrices
+    shared_ptr<const Features> entry = lru->find (i);
+    if (!entry)
+    {
+      shared_ptr<Features> loaded = make_shared<Features>();
+      if (read_features (featurefile(i), *loaded, selected) != 0)
+      {
+        // missing or corrupt file: no features, and nothing cached so that it is read again
+        buffer = Features();
+        return buffer;
+      }
+      lru->insert (i, loaded, featurebytes (i));
+      entry = loaded;
+    }
+    buffer.keypoints = entry->keypoints;
+    buffer.descriptors = entry->descriptors;
+    buffer.points = entry->points;
+    buffer.shape = entry->shape;
+    return buffer;
+  }
+
+  read_features (featurefile(i), buffer, selected);
+  return buffer;
+}
+
+/* ===============================================================================================
+   Keypoint coordinates of an image alone, for corpora selected without them; with binary
+   feature files only their points section is read
+   =============================================================================================== */
+int Corpus::geometry (int i, Features &buffer) const
+{
+  return read_features (featurefile(i), buffer, FIELD_POINTS);
+}
+
+/* ===============================================================================================
+   True if all the feature files of the corpus are binary, so that any subset of their fields
+   can be read without reading the rest
+   =============================================================================================== */
+bool Corpus::binary () const
+{
+  for (int i = 0; i < featurefiles.size(); i++)
+    if (!is_binary_featurefile (featurefiles[i]))
+      return false;
+  return featurefiles.size() > 0;
+}
+
+/* ===============================================================================================
+   Keep the feature files in an LRU cache of "budget" bytes instead of reading them at each
+   access (ignored once the corpus is loaded)
+   =============================================================================================== */
+void Corpus::cache (long budget)
+{
+  lru = make_shared<FeatureCache> (budget);
+}
+
+CacheStats Corpus::cacheStats () const
+{
+  return lru ? lru->stats() : CacheStats();
+}
+
+/* ===============================================================================================
+   LRU feature cache
+   =============================================================================================== */
+CacheStats::CacheStats ()
+  : hits (0), misses (0), evictions (0), bytesRead (0), bytesCached (0), entries (0)
+{
+}
+
+FeatureCache::FeatureCache (long budget)
+  : budgetBytes (budget)
+{
+}
+
+/* ===============================================================================================
+   Look up an image; a hit moves it to the front of the list (most recently used)
+   =============================================================================================== */
+shared_ptr<const Features> FeatureCache::find (int i)
+{
+  lock_guard<mutex> guard (lock);
+  unordered_map<int, Entries::iterator>::iterator it = where.find (i);
+  if (it == where.end())
+  {
+    counters.misses++;
+    return shared_ptr<const Features>();
+  }
+
+  counters.hits++;
+  entries.splice (entries.begin(), entries, it->second);
+  return it->second->features;
+}
+
+/* ===============================================================================================
+   Add the features of an image just read from disk, then evict the least recently used
+   entries until the cache fits in its budget. An entry larger than the whole budget is not
+   kept; an image inserted twice (two threads missed it at the same time) is kept once.
+   =============================================================================================== */
+void FeatureCache::insert (int i, shared_ptr<const Features> features, long filebytes)
+{
+  long bytes = sizeof(Features) + features->keypoints.size()*sizeof(KeyPoint);
+  bytes += features->descriptors.total()*features->descriptors.elemSize();
+  bytes += features->points.total()*features->points.elemSize() + features->shape.total()*features->shape.elemSize();
+
+  lock_guard<mutex> guard (lock);
+  counters.bytesRead += filebytes;
+  if (bytes > budgetBytes || where.count (i) > 0)
+    return;
+
+  Entry entry;
+  entry.index = i;
+  entry.bytes = bytes;
+  entry.features = features;
+  entries.push_front (entry);
+  where[i] = entries.begin();
+  counters.bytesCached += bytes;
+
+  while (counters.bytesCached > budgetBytes)
+  {
+    Entry &last = entries.back();
+    counters.bytesCached -= last.bytes;
+    counters.evictions++;
+    where.erase (last.index);
+    entries.pop_back();
+  }
+}
+
+CacheStats FeatureCache::stats () const
+{
+  lock_guard<mutex> guard (lock);
+  CacheStats result = counters;
+  result.entries = entries.size();
+  return result;
+}
+
+/* ===============================================================================================
+   Prefetcher: start "nthreads" threads reading the feature files of the images "indices" of
+   the corpus, in order, at most "depth" images ahead of the caller
+   =============================================================================================== */
+PrefetchStats::PrefetchStats ()
+  : nimages (0), readSeconds (0), waitSeconds (0)
+{
+}
+
+FeaturePrefetcher::FeaturePrefetcher (const Corpus &c, const vector<int> &idx, int depth, int nthreads)
+  : corpus (c), indices (idx), claimed (0), released (0), holding (false), stopping (false),
+    readSeconds (0), waitSeconds (0)
+{
+  if (depth < 1)
+    depth = 1;
+  if (nthreads < 1)
+    nthreads = 1;
+
+  slots.resize (depth);
+  slotitem.assign (depth, -1);
+  for (int t = 0; t < nthreads; t++)
+    workers.push_back (thread (&FeaturePrefetcher::work, this));
+}
+
+FeaturePrefetcher::~FeaturePrefetcher ()
+{
+  {
+    unique_lock<mutex> guard (lock);
+    stopping = true;
+  }
+  changed.notify_all();
+  for (int t = 0; t < workers.size(); t++)
+    workers[t].join();
+}
+
+/* ===============================================================================================
+   Reading thread: claim the next image as soon as its slot is free (the image "depth" places
+   before it has been released by the caller), read it outside the lock, and publish it
+   =============================================================================================== */
+void FeaturePrefetcher::work ()
+{
+  int depth = slots.size();
+  int nimages = indices.size();
+  double freq = getTickFrequency();
+
+  unique_lock<mutex> guard (lock);
+  while (true)
+  {
+    while (!stopping && claimed < nimages && claimed >= released + depth)
+      changed.wait (guard);
+    if (stopping || claimed >= nimages)
+      return;
+
+    int k = claimed++;
+    guard.unlock();
+
+    int64 t0 = getTickCount();
+    Features &slot = slots[k % depth];
+    const Features &features = corpus.features (indices[k], slot);
+    if (&features != &slot)
+      slot = features;
+    double seconds = (getTickCount() - t0)/freq;
+
+    guard.lock();
+    slotitem[k % depth] = k;
+    readSeconds += seconds;
+    changed.notify_all();
+  }
+}
+
+/* ===============================================================================================
+   Hand out the features of the next image (NULL once all images have been handed out). The
+   previous image is released, so the pointer is only valid until the following call.
+   =============================================================================================== */
+const Features *FeaturePrefetcher::next ()
+{
+  int depth = slots.size();
+  int nimages = indices.size();
+
+  unique_lock<mutex> guard (lock);
+  if (holding)
+  {
+    released++;
+    holding = false;
+    changed.notify_all();
+  }
+  if (released >= nimages)
+    return NULL;
+
+  int64 t0 = getTickCount();
+  while (slotitem[released % depth] != released)
+    changed.wait (guard);
+  waitSeconds += (getTickCount() - t0)/getTickFrequency();
+
+  holding = true;
+  return &slots[released % depth];
+}
+
+PrefetchStats FeaturePrefetcher::stats () const
+{
+  unique_lock<mutex> guard (lock);
+  PrefetchStats stats;
+  stats.nimages = released + (holding ? 1 : 0);
+  stats.readSeconds = readSeconds;
+  stats.waitSeconds = waitSeconds;
+  return stats;
+}
+
+/* ===============================================================================================
+   Default query options
+   =============================================================================================== */
+QueryOptions::QueryOptions ()
+  : ratio (0.8), progress (0), shard (0), nshards (1), prefetch (0), prefetchThreads (1), keepMatches (false),
+    candidates (NULL), coarseKeypoints (0), coarseMatches (2), rerank (0), batch (0)
+{
+}
+
+QueryStats::QueryStats ()
+  : seconds (0), geometryLoads (0), escalated (0), verified (0), certain (0)
+{
+}
+
+/* ===============================================================================================
+   Distance of one image: the full matching chain (verify_image), or its second phase once the
+   symmetric matches are in scratch.symMatches (verify_geometry). With descriptors only (see
+   Corpus::select), the coordinates are read only for the images with enough symmetric matches
+   for RANSAC to keep any.
+   =============================================================================================== */
+static void verify_geometry (const Corpus &corpus, const Features &seed, const Features &features, const QueryOptions &options, MatchScratch &scratch,
+                             Features &geometry, vector<DMatch> &matches, QueryResult &result, int *ngeometry)
+{
+  if (features.size() > 0)
+  {
+    result.distance = match_geometry (seed, features, matches, scratch);
+    result.region = match_region (features, matches);
+  }
+  else
+  {
+    if (scratch.symMatches.size() < RANSAC_MIN_MATCHES)
+      return;
+    corpus.geometry (result.index, geometry);
+    (*ngeometry)++;
+    result.distance = match_geometry (seed, geometry, matches, scratch);
+    result.region = match_region (geometry, matches);
+  }
+  if (options.keepMatches)
+    result.matches = matches;
+}
+
+static void verify_image (const Corpus &corpus, const Features &seed, const Features &features, const QueryOptions &options, MatchScratch &scratch,
+                          Features &geometry, vector<DMatch> &matches, QueryResult &result, int *ngeometry)
+{
+  match_descriptors (seed, features, options.ratio, scratch);
+  verify_geometry (corpus, seed, features, options, scratch, geometry, matches, result, ngeometry);
+}
+
+/* ===============================================================================================
+   Images waiting in a block of batched matching, with a copy of their coordinates (the
+   buffers of the prefetcher are reused by the next images)
+   =============================================================================================== */
+struct PendingBlock
+{
+  BatchScratch batch;
+  vector<int> items;                     // positions in the results
+  vector<Features> coordinates;
+  vector< vector<DMatch> > symMatches;
+
+  void add (int k, const Features &features, int width)
+  {
+    if (coordinates.size() <= items.size())
+      coordinates.resize (items.size() + 1);
+    Features &copy = coordinates[items.size()];
+    copy.keypoints = features.keypoints;
+    features.points.copyTo (copy.points);
+    items.push_back (k);
+    batch.add (features.descriptors, width);
+  }
+};
+
+static void flush_block (const Corpus &corpus, const Features &seed, const QueryOptions &options, PendingBlock &pending, vector<QueryResult> &results,
+                         vector<int> &proxy, MatchScratch &scratch, Features &geometry, vector<DMatch> &matches, int *ngeometry)
+{
+  if (pending.items.size() == 0)
+    return;
+
+  match_descriptors_batch (seed, options.ratio, pending.batch, pending.symMatches);
+  for (int b = 0; b < pending.items.size(); b++)
+  {
+    int k = pending.items[b];
+    if (options.rerank > 0)
+    {
+      proxy[k] = pending.symMatches[b].size();
+      continue;
+    }
+    scratch.symMatches.swap (pending.symMatches[b]);
+    verify_geometry (corpus, seed, pending.coordinates[b], options, scratch, geometry, matches, results[k], ngeometry);
+  }
+
+  pending.items.clear();
+  pending.batch.clear();
+}
+
+/* ===============================================================================================
+   Query a corpus with the features of a seed image: each image of the corpus is compared to the
+   seed with the robust matching filter; its distance is the number of remaining matches.
+   With a list of candidates, the other images are not read and keep a distance of 0. In
+   progressive mode, the coarse pass only needs the descriptors, so it comes before the
+   coordinates of a descriptors-only corpus are read.
+   =============================================================================================== */
+int query (const Corpus &corpus, const Features &seed, vector<QueryResult> &results, const QueryOptions &options, QueryStats *stats)
+{
+  int64 start = getTickCount();
+
+  vector<int> indices;
+  int ierr = shard_corpus (corpus, options.shard, options.nshards, indices);
+  if (ierr != 0)
+    return ierr;
+
+  int nimages = indices.size();
+  vector<char> selected (corpus.size(), options.candidates == NULL);
+  if (options.candidates != NULL)
+    for (int c = 0; c < options.candidates->size(); c++)
+    {
+      int i = (*options.candidates)[c];
+      if (i >= 0 && i < corpus.size())
+        selected[i] = 1;
+    }
+  vector<int> scanned;
+  for (int k = 0; k < nimages; k++)
+    if (selected[indices[k]])
+      scanned.push_back (indices[k]);
+
+  Features buffer, geometry;
+  vector <DMatch> matches;
+  MatchScratch scratch;
+  int ngeometry = 0;
+
+  Features coarse;
+  bool progressive = options.coarseKeypoints > 0 && strongest_features (seed, options.coarseKeypoints, coarse) < seed.size();
+  int nescalated = 0;
+  vector<int> proxy (nimages, 0);
+
+  bool batched = options.batch > 0 && seed.descriptors.type() == CV_32F;
+  PendingBlock pending;
+
+  // feature files are read ahead on background threads, unless they already are in memory
+  // or there is nothing to match them with
+  FeaturePrefetcher *prefetcher = NULL;
+  if (options.prefetch > 0 && !corpus.loaded() && seed.size() > 0)
+    prefetcher = new FeaturePrefetcher (corpus, scanned, options.prefetch, options.prefetchThreads);
+
+  results.resize (nimages);
+  for (int k = 0; k < nimages; k++)
+  {
+    if (options.progress > 0 && ((k+1) % options.progress == 0 || k == nimages-1))
+      cout << "Processing image # " << k+1 << " out of " << nimages << " images in the database" << endl;
+
+    int i = indices[k];
+    results[k].index = i;
+    results[k].name = corpus.name (i);
+    results[k].distance = 0;
+    results[k].region = Rect();
+    results[k].matches.clear();
+
+    if (seed.size() == 0 || !selected[i])
+      continue;
+
+    const Features &features = prefetcher ? *prefetcher->next() : corpus.features (i, buffer);
+    if (progressive)
+    {
+      if (match_descriptors (coarse, features, options.ratio, scratch) < options.coarseMatches)
+        continue;
+      nescalated++;
+    }
+
+    if (batched)
+    {
+      pending.add (k, features, seed.descriptors.cols);
+      if (pending.batch.rows() >= options.batch)
+        flush_block (corpus, seed, options, pending, results, proxy, scratch, geometry, matches, &ngeometry);
+      continue;
+    }
+
+    // two-stage ranking: only the symmetric match count for now
+    if (options.rerank > 0)
+    {
+      proxy[k] = match_descriptors (seed, features, options.ratio, scratch);
+      continue;
+    }
+
+    verify_image (corpus, seed, features, options, scratch, geometry, matches, results[k], &ngeometry);
+  }
+  if (batched)
+    flush_block (corpus, seed, options, pending, results, proxy, scratch, geometry, matches, &ngeometry);
+  if (prefetcher && stats != NULL)
+    stats->prefetch = prefetcher->stats();
+  delete prefetcher;
+
+/* ===============================================================================================
+   Two-stage ranking: the "rerank" images with the most symmetric matches are read again and
+   verified. RANSAC only keeps a subset of the symmetric matches, so an image left out cannot
+   score more than its count: the verified images scoring above the best count left out rank
+   exactly as they would in an exhaustive query.
+   =============================================================================================== */
+  int nverified = 0, ncertain = 0;
+  if (options.rerank > 0)
+  {
+    vector< pair<int,int> > order;
+    for (int k = 0; k < nimages; k++)
+      if (proxy[k] >= RANSAC_MIN_MATCHES)
+        order.push_back (make_pair (-proxy[k], k));
+    sort (order.begin(), order.end());
+
+    nverified = min ((int) order.size(), options.rerank);
+    for (int r = 0; r < nverified; r++)
+    {
+      QueryResult &result = results[order[r].second];
+      verify_image (corpus, seed, corpus.features (result.index, buffer), options, scratch, geometry, matches, result, &ngeometry);
+    }
+
+    int bound = nverified < order.size() ? -order[nverified].first : 0;
+    for (int r = 0; r < nverified; r++)
+      if (results[order[r].second].distance > bound)
+        ncertain++;
+  }
+
+  if (stats != NULL)
+  {
+    stats->geometryLoads = ngeometry;
+    stats->escalated = progressive ? nescalated : 0;
+    stats->verified = nverified;
+    stats->certain = ncertain;
+    stats->seconds = (getTickCount() - start)/getTickFrequency();
+  }
+
+  rank_results (results);
+  return 0;
+}
+
+/* ===============================================================================================
+   Sort results by decreasing distance; ties are kept in corpus order
+   =============================================================================================== */
+static bool compare_results (const QueryResult &a, const QueryResult &b)
+{
+  if (a.distance != b.distance)
+    return a.distance > b.distance;
+  return a.index < b.index;
+}
+
+void rank_results (vector<QueryResult> &results)
+{
+  stable_sort (results.begin(), results.end(), compare_results);
+}
+
+/* ===============================================================================================
+   Region of the matched keypoints, as ', "region":[x,y,w,h]' (nothing if there is none)
+   =============================================================================================== */
+static void write_region (ostream &json, const Rect &region)
+{
+  if (region.width > 0 && region.height > 0)
+    json << ", \"region\":[" << region.x << "," << region.y << "," << region.width << "," << region.height << "]";
+}
+
+/* ===============================================================================================
+   Write out ordered list of images, with number of matches, in JSON format
+   =============================================================================================== */
+int write_results (string jsonfile, string imgdir, const vector<QueryResult> &results)
+{
+  ofstream json(jsonfile.c_str());
+  if (!json.is_open())
+    return -1;
+
+  json << "{\"path\":\"" << imgdir << "\"";
+  json << ", \"files\":[";
+  int count = 0;
+
+  for(int i=0; i < results.size(); i++)
+  {
+    if (results[i].distance > 1)
+    {
+      if (count != 0)
+        json << ",";
+      json << "{\"name\":\"" << results[i].name << "\",";
+      json << "\"distance\":" << results[i].distance;
+      write_region (json, results[i].region);
+      json << "}";
+      count++;
+    }
+  }
+  json << "]}" << endl;
+  json.close();
+
+  return 0;
+}
+
+/* ===============================================================================================
+   Parse a shard specification "i/N" (0 <= i < N)
+   =============================================================================================== */
+int parse_shard (string spec, int *shard, int *nshards)
+{
+  int pos = spec.find ("/");
+  if (pos == string::npos)
+    return -1;
+
+  *shard = atoi (spec.substr (0, pos).c_str());
+  *nshards = atoi (spec.substr (pos + 1).c_str());
+  if (*nshards < 1 || *shard < 0 || *shard >= *nshards)
+    return -1;
+  return 0;
+}
+
+/* ===============================================================================================
+   Images of one shard of the corpus, in corpus order. Images are assigned from the largest
+   feature file to the smallest, each to the shard with the smallest load so far (ties: by
+   index), which is deterministic and keeps the shards balanced in number of features.
+   =============================================================================================== */
+static bool heavier_first (const pair<long,int> &a, const pair<long,int> &b)
+{
+  if (a.first != b.first)
+    return a.first > b.first;
+  return a.second < b.second;
+}
+
+int shard_corpus (const Corpus &corpus, int shard, int nshards, vector<int> &indices)
+{
+  int nimages = corpus.size();
+
+  indices.clear();
+  if (nshards < 1 || shard < 0 || shard >= nshards)
+    return -1;
+
+  if (nshards == 1)
+  {
+    for (int i = 0; i < nimages; i++)
+      indices.push_back (i);
+    return 0;
+  }
+
+  vector< pair<long,int> > weights (nimages);
+  for (int i = 0; i < nimages; i++)
+    weights[i] = make_pair (corpus.featurebytes (i) + 1, i);
+  sort (weights.begin(), weights.end(), heavier_first);
+
+  vector<long> load (nshards, 0);
+  for (int k = 0; k < nimages; k++)
+  {
+    int target = 0;
+    for (int s = 1; s < nshards; s++)
+      if (load[s] < load[target])
+        target = s;
+    load[target] += weights[k].first;
+    if (target == shard)
+      indices.push_back (weights[k].second);
+  }
+
+  sort (indices.begin(), indices.end());
+  return 0;
+}
+
+/* ===============================================================================================
+   Write the raw results of one shard (every image, whatever its distance), with the corpus
+   index of each image so that the merge can reproduce the ranking of a single-process scan
+   =============================================================================================== */
+int write_partial_results (string jsonfile, string imgdir, int shard, int nshards, const vector<QueryResult> &results)
+{
+  ofstream json(jsonfile.c_str());
+  if (!json.is_open())
+    return -1;
+
+  json << "{\"path\":\"" << imgdir << "\"";
+  json << ", \"shard\":" << shard << ", \"nshards\":" << nshards;
+  json << ", \"files\":[";
+  for(int i=0; i < results.size(); i++)
+  {
+    if (i != 0)
+      json << ",";
+    json << "{\"name\":\"" << results[i].name << "\",";
+    json << "\"index\":" << results[i].index << ",";
+    json << "\"distance\":" << results[i].distance;
+    write_region (json, results[i].region);
+    json << "}";
+  }
+  json << "]}" << endl;
+  json.close();
+
+  return 0;
+}
+
+/* ===============================================================================================
+   Minimal reader for the JSON files written by the Arch-V programs: objects, arrays, strings
+   and numbers. Values are kept as text; nested values are kept in "items" (arrays) or
+   "fields" (objects).
+   =============================================================================================== */
+struct JsonValue
+{
+  char type;                                  // 'o', 'a', 's', 'n'
+  string text;
+  vector<JsonValue> items;
+  vector< pair<string,JsonValue> > fields;
+
+  const JsonValue *find (string key) const
+  {
+    for (int i = 0; i < fields.size(); i++)
+      if (fields[i].first == key)
+        return &fields[i].second;
+    return NULL;
+  }
+};
+
+static void skip_blanks (const string &text, size_t *pos)
+{
+  while (*pos < text.size() && isspace ((unsigned char) text[*pos]))
+    (*pos)++;
+}
+
+static int parse_json (const string &text, size_t *pos, JsonValue &value)
+{
+  skip_blanks (text, pos);
+  if (*pos >= text.size())
+    return -1;
+
+  char c = text[*pos];
+  if (c == '{' || c == '[')
+  {
+    value.type = (c == '{') ? 'o' : 'a';
+    char close = (c == '{') ? '}' : ']';
+    (*pos)++;
+    skip_blanks (text, pos);
+    if (*pos < text.size() && text[*pos] == close)
+    {
+      (*pos)++;
+      return 0;
+    }
+    while (*pos < text.size())
+    {
+      JsonValue item;
+      if (value.type == 'o')
+      {
+        JsonValue key;
+        if (parse_json (text, pos, key) != 0 || key.type != 's')
+          return -1;
+        skip_blanks (text, pos);
+        if (*pos >= text.size() || text[*pos] != ':')
+          return -1;
+        (*pos)++;
+        if (parse_json (text, pos, item) != 0)
+          return -1;
+        value.fields.push_back (make_pair (key.text, item));
+      }
+      else
+      {
+        if (parse_json (text, pos, item) != 0)
+          return -1;
+        value.items.push_back (item);
+      }
+      skip_blanks (text, pos);
+      if (*pos < text.size() && text[*pos] == ',')
+      {
+        (*pos)++;
+        continue;
+      }
+      if (*pos < text.size() && text[*pos] == close)
+      {
+        (*pos)++;
+        return 0;
+      }
+      return -1;
+    }
+    return -1;
+  }
+
+  if (c == '"')
+  {
+    value.type = 's';
+    (*pos)++;
+    while (*pos < text.size() && text[*pos] != '"')
+    {
+      if (text[*pos] == '\\' && *pos + 1 < text.size())
+        (*pos)++;
+      value.text += text[*pos];
+      (*pos)++;
+    }
+    if (*pos >= text.size())
+      return -1;
+    (*pos)++;
+    return 0;
+  }
+
+  value.type = 'n';
+  while (*pos < text.size() && text[*pos] != ',' && text[*pos] != '}' && text[*pos] != ']' && !isspace ((unsigned char) text[*pos]))
+  {
+    value.text += text[*pos];
+    (*pos)++;
+  }
+  return value.text.empty() ? -1 : 0;
+}
+
+/* ===============================================================================================
+   Read a result file: complete (written by write_results) or partial (written by
+   write_partial_results). Images of a complete file have no index: their rank is used.
+   =============================================================================================== */
+int read_results (string jsonfile, ResultSet &resultset)
+{
+  ifstream json (jsonfile.c_str());
+  if (!json.is_open())
+    return -1;
+  stringstream ss;
+  ss << json.rdbuf();
+  string text = ss.str();
+
+  JsonValue root;
+  size_t pos = 0;
+  if (parse_json (text, &pos, root) != 0 || root.type != 'o')
+    return -1;
+
+  const JsonValue *path = root.find ("path");
+  const JsonValue *shard = root.find ("shard");
+  const JsonValue *nshards = root.find ("nshards");
+  const JsonValue *files = root.find ("files");
+  if (files == NULL || files->type != 'a')
+    return -1;
+
+  resultset.path = path ? path->text : "";
+  resultset.shard = shard ? atoi (shard->text.c_str()) : -1;
+  resultset.nshards = nshards ? atoi (nshards->text.c_str()) : 1;
+  resultset.results.clear();
+
+  for (int i = 0; i < files->items.size(); i++)
+  {
+    const JsonValue *name = files->items[i].find ("name");
+    const JsonValue *index = files->items[i].find ("index");
+    const JsonValue *distance = files->items[i].find ("distance");
+    if (name == NULL || distance == NULL)
+      return -1;
+
+    QueryResult result;
+    result.name = name->text;
+    result.index = index ? atoi (index->text.c_str()) : i;
+    result.distance = atof (distance->text.c_str());
+    const JsonValue *region = files->items[i].find ("region");
+    if (region && region->type == 'a' && region->items.size() == 4)
+      result.region = Rect (atoi (region->items[0].text.c_str()), atoi (region->items[1].text.c_str()),
+                            atoi (region->items[2].text.c_str()), atoi (region->items[3].text.c_str()));
+    resultset.results.push_back (result);
+  }
+  return 0;
+}
+
+/* ===============================================================================================
+   Merge the partial results of all the shards of a scan into one ranking. Fails (returns -1)
+   if the parts do not come from the same scan or if a shard is missing or repeated.
+   =============================================================================================== */
+int merge_results (const vector<ResultSet> &parts, vector<QueryResult> &results)
+{
+  results.clear();
+  if (parts.size() == 0)
+    return -1;
+
+  int nshards = parts[0].nshards;
+  vector<int> seen (nshards, 0);
+  for (int p = 0; p < parts.size(); p++)
+  {
+    if (parts[p].nshards != nshards || parts[p].path != parts[0].path)
+      return -1;
+    if (parts[p].shard < 0 || parts[p].shard >= nshards || seen[parts[p].shard]++ > 0)
+      return -1;
+    results.insert (results.end(), parts[p].results.begin(), parts[p].results.end());
+  }
+  if (parts.size() != nshards)
+    return -1;
+
+  rank_results (results);
+  return 0;
+}
+
+}
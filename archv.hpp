@@ -0,0 +1,522 @@
+/* ============================================================================================
+  archv.hpp                        Version 1           Last Update: 10/19/2026
+
+  Public interface of libarchv, the core of the Arch-V programs: reading of the SURF parameter
+  file, keypoint detection and description, the robust matching filter (ratio, symmetry and
+  RANSAC tests), and a corpus of feature files that can be loaded once and queried many times
+  from within the same process.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#ifndef ARCHV_HPP
+#define ARCHV_HPP
+
+#include <string>
+#include <vector>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/features2d/features2d.hpp"
+#include "opencv2/nonfree/nonfree.hpp"
+
+namespace archv
+{
+
+/* ===============================================================================================
+   Feature parameters, as found in the parameter file. SURF is the default; the parameter file
+   can select a binary descriptor instead ("descriptor: orb" or "descriptor: brisk"), which
+   is about an order of magnitude faster to compute and to match and takes 32 (ORB) or 64
+   (BRISK) bytes per keypoint instead of 256. "octaves" is then the number of pyramid levels,
+   "max Features" the number of ORB keypoints and "threshold" the BRISK FAST threshold;
+   minHessian and octaveLayers only apply to SURF. The filter on size and response applies to
+   all, but ORB and BRISK responses are not on the SURF scale (set both minimums to 0 to keep
+   every keypoint). read_surfparams reads all the keys; read_descriptorparams only the keys of
+   the binary descriptors, for the tools that read the SURF keys themselves.
+   =============================================================================================== */
+enum { DESCRIPTOR_SURF = 0, DESCRIPTOR_ORB = 1, DESCRIPTOR_BRISK = 2 };
+
+struct SurfParams
+{
+  int minHessian;
+  int octaves;
+  int octaveLayers;
+  int sizeMin;
+  double responseMin;
+  int descriptor;        // DESCRIPTOR_SURF, DESCRIPTOR_ORB or DESCRIPTOR_BRISK
+  int maxFeatures;       // ORB: number of keypoints kept
+  int threshold;         // BRISK: FAST threshold
+
+  SurfParams ();
+  SurfParams (int minHessian, int octaves, int octaveLayers, int sizeMin, double responseMin);
+};
+
+void read_surfparams (std::string param, int *minHessian, int *octaves, int *octaveLayers, int *sizeMin, double *responseMin);
+void read_surfparams (std::string param, SurfParams &params);
+void read_descriptorparams (std::string param, SurfParams &params);
+int descriptor_type (std::string name);
+std::string descriptor_name (int descriptor);
+cv::Ptr<cv::Feature2D> create_feature2d (const SurfParams &params);
+
+/* ===============================================================================================
+   Directory listings: all entries, or only the image files (.jpg extension)
+   =============================================================================================== */
+int get_filelist (std::string directory, std::vector<std::string> &files);
+int get_imagelist (std::string directory, std::vector<std::string> &images);
+
+/* ===============================================================================================
+   Run a cv::ParallelLoopBody over a range on "nthreads" worker threads (0: one per core).
+   The range is handed out in chunks of "chunk" indices, so uneven work is balanced.
+   =============================================================================================== */
+int default_threads ();
+void run_parallel (const cv::Range &range, const cv::ParallelLoopBody &body, int nthreads = 0, int chunk = 1);
+
+/* ===============================================================================================
+   Keypoints and descriptors of one image. When only some of the keypoint fields are read
+   (matching needs the coordinates alone), the keypoints are kept by columns instead of as
+   KeyPoint objects: "points" (x, y) and optionally "shape" (size, angle), n x 1 CV_32FC2
+   matrices, and "keypoints" is empty. size() and point() work with both layouts.
+   =============================================================================================== */
+enum
+{
+  FIELD_POINTS = 1, FIELD_SHAPE = 2, FIELD_DETECTION = 4, FIELD_DESCRIPTORS = 8,
+  FIELDS_KEYPOINTS = FIELD_POINTS | FIELD_SHAPE | FIELD_DETECTION,
+  FIELDS_MATCH = FIELD_POINTS | FIELD_DESCRIPTORS,
+  FIELDS_ALL = FIELDS_KEYPOINTS | FIELD_DESCRIPTORS
+};
+
+struct Features
+{
+  std::vector<cv::KeyPoint> keypoints;
+  cv::Mat descriptors;
+  cv::Mat points;
+  cv::Mat shape;
+
+  int size () const { return keypoints.size() > 0 ? (int) keypoints.size() : points.rows; }
+  cv::Point2f point (int i) const { return keypoints.size() > 0 ? keypoints[i].pt : points.at<cv::Point2f>(i); }
+};
+
+int read_features (std::string filename, Features &features, int fields = FIELDS_ALL);
+int write_features (std::string filename, const Features &features);
+void select_fields (Features &features, int fields);
+
+/* ===============================================================================================
+   Detection mask of a seed image restricted to a region: a rectangle given as "x,y,w,h"
+   and/or a polygon read from a file (one "x y" vertex per line). Returns -1 if either cannot
+   be parsed; the mask is left empty (whole image) when neither is given. match_region is the
+   bounding box of the keypoints of "features" used by a list of matches (as train side).
+   =============================================================================================== */
+int seed_mask (cv::Size size, std::string roi, std::string polygonfile, cv::Mat &mask);
+cv::Rect match_region (const Features &features, const std::vector<cv::DMatch> &matches);
+
+/* ===============================================================================================
+   Contact sheet: the images on a white background, "columns" per row, each scaled to a width
+   of "cellwidth" pixels (the width of the widest image if 0) with its title written above it.
+   Empty images leave their cell blank.
+   =============================================================================================== */
+cv::Mat combine_images (const std::vector<cv::Mat> &images, const std::vector<std::string> &titles, int columns = 2, int cellwidth = 0);
+
+/* ===============================================================================================
+   Thumbnails: processImages can write reduced copies of every image (1/4 and 1/16 of its
+   width and height) while it has the image decoded, so that the tools drawing results do not
+   decode the full resolution originals again. load_image reads the smallest thumbnail that is
+   still at least "minwidth" pixels wide (the original if there is none) and returns its
+   reduction factor; scale_keypoints brings keypoints to the same scale.
+   =============================================================================================== */
+const int NTHUMBNAILS = 2;
+const int THUMBNAIL_FACTORS[NTHUMBNAILS] = { 4, 16 };
+
+std::string thumbnail_file (std::string thumbdir, std::string imagefile, int factor);
+int write_thumbnails (const cv::Mat &image, std::string thumbdir, std::string imagefile);
+int load_image (std::string imagefile, std::string thumbdir, int minwidth, cv::Mat &image);
+void scale_keypoints (std::vector<cv::KeyPoint> &keypoints, double scale);
+
+/* ===============================================================================================
+   Feature extraction: detection, filter on size and response, description, with SURF or the
+   binary descriptor of the parameters. One object is meant to be created once and used for all the images of a run, and can be
+   shared by threads. The image is converted to grey levels into a per-thread buffer that is
+   reused from one image to the next unless the image is larger.
+
+   extract() runs in one of two ways:
+     - EXTRACT_FUSED: a single SURF pass (one integral image) detects the keypoints and
+       describes all of them, then the keypoints rejected by the filter and their descriptor
+       rows are dropped;
+     - EXTRACT_SPLIT: detection, filter, then a second pass describes the kept keypoints.
+   A SURF detection already computes the orientation of every keypoint, so the fused pass
+   saves an integral image and the orientation of the kept keypoints but describes keypoints
+   that are then dropped: it pays off when the filter keeps (nearly) everything.
+   EXTRACT_AUTO, the default, takes it when the filter cannot reject anything, and always for
+   ORB and BRISK, whose description alone would build the image pyramid again. benchExtract
+   times both against the original two calls.
+   =============================================================================================== */
+void filter_keypoints (std::vector<cv::KeyPoint> &keypoints, int sizemin, double responsemin);
+
+enum { EXTRACT_AUTO = 0, EXTRACT_SPLIT = 1, EXTRACT_FUSED = 2 };
+
+class FeatureExtractor
+{
+public:
+  FeatureExtractor (const SurfParams &params);
+
+  int detect (const cv::Mat &image, std::vector<cv::KeyPoint> &keypoints, const cv::Mat &mask = cv::Mat()) const;
+  void describe (const cv::Mat &image, std::vector<cv::KeyPoint> &keypoints, cv::Mat &descriptors) const;
+  int extract (const cv::Mat &image, Features &features, const cv::Mat &mask = cv::Mat(), double *detectSeconds = NULL, double *describeSeconds = NULL) const;
+
+  const SurfParams &params () const { return surfparams; }
+  void setMode (int m) { mode = m; }
+  bool fused () const;
+
+private:
+  SurfParams surfparams;
+  int mode;
+  cv::Ptr<cv::Feature2D> engine; // SURF: 64-float descriptors, as the original SurfDescriptorExtractor
+};
+
+/* ===============================================================================================
+   Robust matching of two sets of features:
+	- first from 1 to 2 (with 2 NN), then from 2 to 1
+	- filter based on ratio test
+	- filter for symmetry
+	- filter by RANSAC
+   match_features runs the full chain and returns the number of surviving matches. It works
+   on flat scratch buffers (best two neighbours of every descriptor in both directions, stored
+   with a fixed stride of 2, and the point / inlier arrays of RANSAC) that are reused from
+   one comparison to the next: by default one set per thread, or the one given by the caller.
+   match_features_knn is the original, allocating, implementation of the same chain (BFMatcher
+   and the three tests below). Binary descriptors (CV_8U) are compared by Hamming distance;
+   two sets of different descriptor types have no match.
+   =============================================================================================== */
+int ratioTest (std::vector<std::vector<cv::DMatch> > &matches, double ratio);
+void symmetryTest (const std::vector<std::vector<cv::DMatch> > &matches1, const std::vector<std::vector<cv::DMatch> > &matches2, std::vector<cv::DMatch> &symMatches);
+cv::Mat ransacTest (const std::vector<cv::DMatch> &matches, const std::vector<cv::KeyPoint> &keypoints1, const std::vector<cv::KeyPoint> &keypoints2, std::vector<cv::DMatch> &outMatches);
+
+struct MatchScratch
+{
+  std::vector<int> best12, best21;        // indices of the 2 nearest neighbours, 1 -> 2 and 2 -> 1
+  std::vector<float> dist12, dist21;      // their squared distances
+  std::vector<cv::DMatch> symMatches;
+  std::vector<cv::Point2f> points1, points2;
+  std::vector<uchar> inliers;
+};
+
+int match_features (const Features &features1, const Features &features2, std::vector<cv::DMatch> &matches, double ratio = 0.8);
+int match_features (const Features &features1, const Features &features2, std::vector<cv::DMatch> &matches, double ratio, MatchScratch &scratch);
+int match_features_knn (const Features &features1, const Features &features2, std::vector<cv::DMatch> &matches, double ratio = 0.8);
+
+/* ===============================================================================================
+   The two phases of match_features: match_descriptors (knn, ratio and symmetry tests) only
+   needs the descriptors of both images; match_geometry (RANSAC) then needs their keypoint
+   coordinates, and cannot keep anything with fewer than RANSAC_MIN_MATCHES symmetric matches.
+   =============================================================================================== */
+const int RANSAC_MIN_MATCHES = 7;
+
+int match_descriptors (const Features &features1, const Features &features2, double ratio, MatchScratch &scratch);
+int match_geometry (const Features &features1, const Features &features2, std::vector<cv::DMatch> &matches, MatchScratch &scratch);
+
+/* ===============================================================================================
+   The "n" keypoints of highest response and their descriptors (all of them if there are fewer,
+   or if the features have no responses), in their original order; returns their number
+   =============================================================================================== */
+int strongest_features (const Features &features, int n, Features &strongest);
+
+/* ===============================================================================================
+   Projection of float descriptors on their first principal components, trained on a sample
+   of descriptors (one per row): reduced = (descriptor - mean) basis^T, each component then
+   divided by its standard deviation if whitened. train_projection returns the share of the
+   variance of the sample kept by the components; read / write use a YAML file.
+   =============================================================================================== */
+struct Projection
+{
+  cv::Mat mean;          // 1 x d
+  cv::Mat basis;         // k x d, one component per row
+  cv::Mat scale;         // 1 x k, only when whitened
+  bool empty () const { return basis.empty(); }
+  int dims () const { return basis.rows; }
+};
+
+double train_projection (const cv::Mat &samples, int dims, bool whiten, Projection &projection);
+void project_descriptors (const Projection &projection, const cv::Mat &descriptors, cv::Mat &reduced);
+int read_projection (std::string filename, Projection &projection);
+int write_projection (std::string filename, const Projection &projection);
+
+/* ===============================================================================================
+   Batched first phase, for float descriptors: the descriptors of a block of images are
+   concatenated into one matrix (add(), which leaves out those of another width than "width",
+   e.g. the seed's, as unmatched), and the squared distances between the seed and the
+   whole block are computed as |a|^2 + |b|^2 - 2 a.b, the products by one matrix product
+   (cv::gemm) per tile of seed rows, so that the work is dense linear algebra instead of one
+   short loop per pair. The best two neighbours of every descriptor are then taken within the
+   bounds of each image, and the ratio and symmetry tests are those of match_descriptors: the
+   symmetric matches of every image are the same, up to the rounding of the distances.
+   =============================================================================================== */
+struct BatchScratch
+{
+  cv::Mat block;                          // descriptors of the images of the block, one after the other
+  std::vector<int> starts;                // first row of every image in the block, then the end
+  std::vector<float> seedNorms, blockNorms;
+  cv::Mat products;                       // -2 a.b for one tile of seed rows and the whole block
+  std::vector<int> best12, best21;        // as in MatchScratch; 1 -> 2 for every image of the block
+  std::vector<float> dist12, dist21;
+
+  BatchScratch ();
+  void clear ();
+  void add (const cv::Mat &descriptors, int width = 0);
+  int images () const { return (int) starts.size() - 1; }
+  int rows () const { return starts.back(); }
+};
+
+void match_descriptors_batch (const Features &seed, double ratio, BatchScratch &batch, std::vector< std::vector<cv::DMatch> > &symMatches);
+
+/* ===============================================================================================
+   LRU cache of feature files under a memory budget (in bytes): entries are loaded on demand,
+   the least recently used ones are evicted once the budget is exceeded. Entries are shared,
+   so an evicted entry stays valid for whoever still holds it. Thread safe.
+   =============================================================================================== */
+struct CacheStats
+{
+  long hits;
+  long misses;
+  long evictions;
+  long bytesRead;        // size of the feature files read on misses
+  long bytesCached;      // memory held by the cache entries
+  int entries;
+  double hitRate () const { return hits + misses > 0 ? (double) hits/(hits + misses) : 0; }
+
+  CacheStats ();
+};
+
+class FeatureCache
+{
+public:
+  FeatureCache (long budget);
+
+  std::shared_ptr<const Features> find (int i);
+  void insert (int i, std::shared_ptr<const Features> features, long filebytes);
+  long budget () const { return budgetBytes; }
+  CacheStats stats () const;
+
+private:
+  struct Entry
+  {
+    int index;
+    long bytes;
+    std::shared_ptr<const Features> features;
+  };
+  typedef std::list<Entry> Entries;
+
+  long budgetBytes;
+  Entries entries;                                  // most recently used first
+  std::unordered_map<int, Entries::iterator> where;
+  CacheStats counters;
+  mutable std::mutex lock;
+};
+
+/* ===============================================================================================
+   A corpus is the list of images of a directory together with their feature files. It either
+   reads the feature files from disk at each access, keeps them all in memory after load(), or
+   keeps the most recently used ones in memory after cache() (bounded memory). select() limits
+   the fields that are read, e.g. to FIELDS_MATCH for scans, or to FIELD_DESCRIPTORS alone, in
+   which case query() reads the coordinates of an image (geometry()) only when needed.
+   =============================================================================================== */
+class Corpus
+{
+public:
+  Corpus ();
+
+  int open (std::string imgdir, std::string infodir);
+  int load ();
+  void cache (long budget);
+  void select (int fields) { selected = fields; }
+
+  int size () const { return images.size(); }
+  bool loaded () const { return isloaded; }
+  std::string directory () const { return imgdir; }
+  std::string name (int i) const;
+  std::string filename (int i) const { return images[i]; }
+  std::string featurefile (int i) const { return featurefiles[i]; }
+  long featurebytes (int i) const;
+
+  const Features &features (int i, Features &buffer) const;
+  int geometry (int i, Features &buffer) const;
+  bool binary () const;
+  bool cached () const { return lru != NULL; }
+  CacheStats cacheStats () const;
+
+private:
+  std::string imgdir;
+  std::string infodir;
+  std::vector<std::string> images;
+  std::vector<std::string> featurefiles;   // .akf if present, .yml otherwise
+  std::vector<Features> resident;
+  bool isloaded;
+  int selected;                            // fields read from the feature files
+  std::shared_ptr<FeatureCache> lru;
+};
+
+/* ===============================================================================================
+   Prefetcher: background threads read (and parse) the feature files of the upcoming images
+   into a ring of "depth" buffers, while the caller matches the current one. next() hands out
+   the images in order and blocks only when the next one is not ready yet.
+   =============================================================================================== */
+struct PrefetchStats
+{
+  int nimages;
+  double readSeconds;    // time spent by the threads reading feature files
+  double waitSeconds;    // time the caller spent waiting for a feature file
+  double overlap () const { return readSeconds > 0 ? 1 - waitSeconds/readSeconds : 0; }
+
+  PrefetchStats ();
+};
+
+class FeaturePrefetcher
+{
+public:
+  FeaturePrefetcher (const Corpus &corpus, const std::vector<int> &indices, int depth, int nthreads = 1);
+  ~FeaturePrefetcher ();
+
+  const Features *next ();
+  PrefetchStats stats () const;
+
+private:
+  void work ();
+
+  const Corpus &corpus;
+  std::vector<int> indices;
+  std::vector<Features> slots;        // image k is read into slot k % depth
+  std::vector<int> slotitem;          // image held by each slot (-1: none yet)
+  int claimed;                        // next image to be claimed by a thread
+  int released;                       // number of images handed out and released by the caller
+  bool holding;                       // the caller holds image "released"
+  bool stopping;
+  double readSeconds;
+  double waitSeconds;
+
+  mutable std::mutex lock;
+  std::condition_variable changed;
+  std::vector<std::thread> workers;
+
+  FeaturePrefetcher (const FeaturePrefetcher &);
+  FeaturePrefetcher &operator= (const FeaturePrefetcher &);
+};
+
+/* ===============================================================================================
+   Query of a corpus with the features of a seed image. Results cover every image of the corpus
+   (or of one shard of it) and are ranked by decreasing distance (number of matches that
+   survived the filters); ties keep the corpus order.
+   Progressive matching (coarseKeypoints > 0): every image is first matched (descriptors only)
+   with the strongest coarseKeypoints keypoints of the seed, and only the images with at least
+   coarseMatches symmetric matches are then matched with the whole seed; the others keep a
+   distance of 0.
+   Two-stage ranking (rerank > 0): all images are scored by their number of symmetric matches
+   (no RANSAC), and only the "rerank" best are verified by RANSAC for their final distance;
+   the others keep a distance of 0. QueryStats::certain is the number of leading results that
+   are guaranteed to be those of an exhaustive query, in the same order.
+   Batched matching (batch > 0, float descriptors): the images are matched with the seed by
+   blocks of about "batch" descriptors (see match_descriptors_batch).
+   =============================================================================================== */
+struct QueryOptions
+{
+  double ratio;          // ratio used in the ratio test
+  int progress;          // print progress every "progress" images (0: silent)
+  int shard;             // only scan shard "shard" out of "nshards" (see shard_corpus)
+  int nshards;
+  int prefetch;          // number of feature files read ahead (0: read each one when needed)
+  int prefetchThreads;   // number of threads reading ahead
+  bool keepMatches;      // keep the surviving matches of every image in its result
+  const std::vector<int> *candidates;  // only match these images, e.g. from a HammingIndex (NULL: all)
+  int coarseKeypoints;   // progressive matching: number of seed keypoints of the coarse pass (0: off)
+  int coarseMatches;     // symmetric matches of the coarse pass needed to match the whole seed
+  int rerank;            // two-stage ranking: number of images verified by RANSAC (0: all, one stage)
+  int batch;             // batched matching: database descriptors per block (0: one image at a time)
+
+  QueryOptions ();
+};
+
+struct QueryResult
+{
+  int index;
+  std::string name;
+  double distance;
+  cv::Rect region;       // bounding box of the matched keypoints in the image (empty if none)
+  std::vector<cv::DMatch> matches;   // only with QueryOptions::keepMatches
+};
+
+struct QueryStats
+{
+  double seconds;        // total time of the query
+  PrefetchStats prefetch;
+  int geometryLoads;     // images whose coordinates were read in a second phase
+  int escalated;         // progressive matching: images matched with the whole seed
+  int verified;          // two-stage ranking: images verified by RANSAC
+  int certain;           // two-stage ranking: leading results ranked as in an exhaustive query
+
+  QueryStats ();
+};
+
+int query (const Corpus &corpus, const Features &seed, std::vector<QueryResult> &results, const QueryOptions &options = QueryOptions(), QueryStats *stats = NULL);
+void rank_results (std::vector<QueryResult> &results);
+int write_results (std::string jsonfile, std::string imgdir, const std::vector<QueryResult> &results);
+
+/* ===============================================================================================
+   Sharding: the images of a corpus are split in "nshards" deterministic subsets of about the
+   same amount of features (the size of the keypoint files is used as the measure), so that
+   several processes or machines can scan one shard each. Each shard writes partial results
+   with the raw distance of all its images; merge_results combines them into the ranking the
+   single-process scan produces.
+   =============================================================================================== */
+struct ResultSet
+{
+  std::string path;
+  int shard;             // -1 for a complete result file
+  int nshards;
+  std::vector<QueryResult> results;
+};
+
+int parse_shard (std::string spec, int *shard, int *nshards);
+int shard_corpus (const Corpus &corpus, int shard, int nshards, std::vector<int> &indices);
+int write_partial_results (std::string jsonfile, std::string imgdir, int shard, int nshards, const std::vector<QueryResult> &results);
+int read_results (std::string jsonfile, ResultSet &resultset);
+int merge_results (const std::vector<ResultSet> &parts, std::vector<QueryResult> &results);
+
+}
+
+#endif
@@ -0,0 +1,280 @@
+/* ============================================================================================
+  benchCodecs.cpp                  Version 1           Last Update: 10/19/2026
+
+  This program measures, on a sample of the feature files of a keypoints directory, how well
+  and how fast the codecs of the binary feature files (.akf) compress the keypoint and
+  descriptor blocks: compression ratio (against the raw blocks and against the YAML files),
+  encode and decode throughput, with and without byte shuffling.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstring>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "archv.hpp"
+#include "featurestore.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace archv;
+
+int  usage();
+void read_flags(int argc, char** argv, string *infodir, int *nsample, int *level, int *repeat);
+
+struct Block
+{
+  Mat data;
+  int elemsize;
+};
+
+int main(int argc, char** argv)
+{
+/* ===============================================================================================
+   Show usage if needed
+   =============================================================================================== */
+  if (argc < 2)
+    return usage();
+
+  string input = argv[1];
+  if( input == "-h" || input == "-help" )
+    return usage();
+
+  string infodir;
+  int nsample = 200;            // number of feature files in the sample
+  int level = 3;                // zstd compression level
+  int repeat = 5;               // number of times every block is decoded
+
+  read_flags (argc, argv, &infodir, &nsample, &level, &repeat);
+  if (infodir == "")
+    return usage();
+  if (*infodir.rbegin() != '/')
+    infodir.append ("/");
+  if (repeat < 1)
+    repeat = 1;
+  if (nsample < 1)
+  {
+    cout << "the sample must have at least one file (-n)" << endl;
+    return -1;
+  }
+
+/* ===============================================================================================
+   Read a sample of the feature files (YAML or binary), spread evenly over the directory, and
+   keep their keypoint and descriptor blocks in memory
+   =============================================================================================== */
+  vector<string> files, featurefiles;
+  get_filelist (infodir, files);
+  for (int i = 0; i < files.size(); i++)
+    if (files[i].find (".yml") != string::npos || is_binary_featurefile (files[i]))
+      featurefiles.push_back (files[i]);
+
+  if (featurefiles.size() == 0)
+  {
+    cout << "no feature files in " << infodir << endl;
+    return -1;
+  }
+
+  int step = featurefiles.size() > nsample ? featurefiles.size()/nsample : 1;
+  vector<Block> blocks;
+  long rawbytes = 0, filebytes = 0;
+
+  for (int i = 0; i < featurefiles.size() && i/step < nsample; i += step)
+  {
+    string filename = infodir + featurefiles[i];
+    Features features;
+    if (read_features (filename, features) != 0)
+      continue;
+
+    struct stat sb;
+    if (stat (filename.c_str(), &sb) == 0)
+      filebytes += sb.st_size;
+
+    Block kp;
+    kp.data.create (features.keypoints.size(), 7, CV_32F);
+    for (int k = 0; k < features.keypoints.size(); k++)
+    {
+      const KeyPoint &p = features.keypoints[k];
+      float *row = kp.data.ptr<float>(k);
+      row[0] = p.pt.x; row[1] = p.pt.y; row[2] = p.size; row[3] = p.angle;
+      row[4] = p.response; row[5] = p.octave; row[6] = p.class_id;
+    }
+    kp.elemsize = 4;
+    blocks.push_back (kp);
+
+    if (!features.descriptors.empty())
+    {
+      Block desc;
+      desc.data = features.descriptors.clone();
+      desc.elemsize = desc.data.elemSize1();
+      blocks.push_back (desc);
+    }
+  }
+
+  for (int b = 0; b < blocks.size(); b++)
+    rawbytes += blocks[b].data.total()*blocks[b].data.elemSize();
+
+  cout << "Sample: " << blocks.size() << " blocks, " << rawbytes << " raw bytes, " << filebytes << " bytes on disk" << endl;
+  if (rawbytes == 0)
+    return -1;
+
+/* ===============================================================================================
+   Encode every block with every codec (with and without shuffling), then decode it "repeat"
+   times into a reused buffer; decoding is checked against the original block
+   =============================================================================================== */
+  double freq = getTickFrequency();
+  int codecs[3] = { CODEC_NONE, CODEC_LZ4, CODEC_ZSTD };
+
+  cout << endl;
+  cout << "codec   shuffle   ratio(raw)  ratio(file)   encode MB/s   decode MB/s" << endl;
+  cout << fixed << setprecision(2);
+
+  for (int c = 0; c < 3; c++)
+  {
+    if (!codec_available (codecs[c]))
+    {
+      cout << setw(5) << left << codec_name (codecs[c]) << right << "   not compiled in" << endl;
+      continue;
+    }
+
+    for (int sh = 0; sh < 2; sh++)
+    {
+      StoreOptions options;
+      options.codec = codecs[c];
+      options.level = level;
+      options.shuffle = sh == 1;
+
+      vector< vector<uchar> > stored (blocks.size());
+      vector<uchar> scratch, decoded;
+      long storedbytes = 0;
+      bool ok = true;
+
+      int64 t0 = getTickCount();
+      for (int b = 0; b < blocks.size(); b++)
+      {
+        const Mat &m = blocks[b].data;
+        encode_block (m.data, m.total()*m.elemSize(), blocks[b].elemsize, options, stored[b], scratch);
+        storedbytes += stored[b].size();
+      }
+      double tencode = (getTickCount() - t0)/freq;
+
+      t0 = getTickCount();
+      for (int r = 0; r < repeat; r++)
+      {
+        for (int b = 0; b < blocks.size(); b++)
+        {
+          const Mat &m = blocks[b].data;
+          size_t size = m.total()*m.elemSize();
+          decoded.resize (size + 1);
+          int elemsize = options.shuffle ? blocks[b].elemsize : 0;
+          if (decode_block (stored[b].size() ? &stored[b][0] : NULL, stored[b].size(), options.codec, elemsize, &decoded[0], size, scratch) != 0)
+            ok = false;
+          if (r == 0 && size > 0 && memcmp (&decoded[0], m.data, size) != 0)
+            ok = false;
+        }
+      }
+      double tdecode = (getTickCount() - t0)/freq/repeat;
+
+      double mb = rawbytes/1.0e6;
+      cout << setw(5) << left << codec_name (options.codec) << right;
+      cout << setw(10) << (options.shuffle ? "yes" : "no");
+      cout << setw(13) << (double) rawbytes/storedbytes;
+      cout << setw(13) << (double) filebytes/storedbytes;
+      cout << setw(14) << (tencode > 0 ? mb/tencode : 0);
+      cout << setw(14) << (tdecode > 0 ? mb/tdecode : 0);
+      if (!ok)
+        cout << "   DECODE MISMATCH";
+      cout << endl;
+    }
+  }
+
+  return 0;
+}
+
+/* ===============================================================================================
+   Usage
+   =============================================================================================== */
+int usage()
+{
+    cout << "\n\n" <<endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=                                      BenchCodecs                                             ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     This program reports the compression ratio and the encode / decode throughput of the     ="  << endl;
+    cout << "     " << "=     codecs of the binary feature files, on a sample of a keypoints directory.                ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     Usage is:                                                                                ="  << endl;
+    cout << "     " << "=                 benchCodecs.exe                                                              ="  << endl;
+    cout << "     " << "=                                 -k        <path to keypoints directory>                      ="  << endl;
+    cout << "     " << "=                                 -n        <number of feature files in the sample> (200)      ="  << endl;
+    cout << "     " << "=                                 -cl       <compression level for zstd> (3)                   ="  << endl;
+    cout << "     " << "=                                 -rep      <number of decode passes> (5)                      ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "\n\n" <<endl;
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Procedure to read in flag values
+   =============================================================================================== */
+void read_flags(int argc, char** argv, string *infodir, int *nsample, int *level, int *repeat)
+{
+  string input;
+  for(int i = 1; i < argc; i++)
+  {
+    input = argv[i];
+    if (input == "-k")
+      *infodir = argv[i + 1];
+    if (input == "-n")
+      *nsample = atoi(argv[i + 1]);
+    if (input == "-cl")
+      *level = atoi(argv[i + 1]);
+    if (input == "-rep")
+      *repeat = atoi(argv[i + 1]);
+  }
+}
@@ -0,0 +1,283 @@
+/* ============================================================================================
+  benchExtract.cpp                 Version 1           Last Update: 10/19/2026
+
+  This program measures the time to extract the features of an image, on a sample of the
+  images of a directory decoded in memory: the original two calls (SURF detection, filter,
+  then a SURF descriptor extractor), and the extractor of the library in its split and fused
+  modes. It checks that the three give the same keypoints and descriptors.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <algorithm>
+#include <cstdlib>
+#include <cfloat>
+
+#include "opencv2/highgui/highgui.hpp"
+
+#include "archv.hpp"
+#include "featurestore.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace archv;
+
+int  usage();
+void read_flags(int argc, char** argv, string *imgdir, string *param, int *nsample, int *repeat);
+
+/* ===============================================================================================
+   The original extraction: a SURF detector built from the parameters detects on the colour
+   image, the keypoints are filtered, and a SURF descriptor extractor with default parameters
+   (64-float descriptors) computes the descriptors in a second, independent pass. With a binary
+   descriptor in the parameters, the same two calls are made to an ORB or BRISK object.
+   =============================================================================================== */
+class TwoCalls
+{
+public:
+  TwoCalls (const SurfParams &p)
+    : params (p)
+  {
+    if (p.descriptor == DESCRIPTOR_SURF)
+    {
+      detector = new SurfFeatureDetector (p.minHessian, p.octaves, p.octaveLayers);
+      extractor = new SurfDescriptorExtractor();
+    }
+    else
+    {
+      Ptr<Feature2D> engine = create_feature2d (p);
+      detector = engine;
+      extractor = engine;
+    }
+  }
+
+  void extract (const Mat &image, Features &features) const
+  {
+    features.keypoints.clear();
+    detector->detect (image, features.keypoints);
+    filter_keypoints (features.keypoints, params.sizeMin, params.responseMin);
+    features.descriptors.release();
+    if (features.keypoints.size() > 0)
+      extractor->compute (image, features.keypoints, features.descriptors);
+  }
+
+private:
+  SurfParams params;
+  Ptr<FeatureDetector> detector;
+  Ptr<DescriptorExtractor> extractor;
+};
+
+int main(int argc, char** argv)
+{
+/* ===============================================================================================
+   Show usage if needed
+   =============================================================================================== */
+  if (argc < 2)
+    return usage();
+
+  string input = argv[1];
+  if( input == "-h" || input == "-help" )
+    return usage();
+
+  string imgdir;
+  string param = "";
+  int nsample = 20;             // number of images in the sample
+  int repeat = 3;               // passes over the sample; the fastest time of each image counts
+
+  read_flags (argc, argv, &imgdir, &param, &nsample, &repeat);
+  if (imgdir == "")
+    return usage();
+  if (*imgdir.rbegin() != '/')
+    imgdir.append ("/");
+  if (repeat < 1)
+    repeat = 1;
+
+  SurfParams params;
+  if (param != "")
+    read_surfparams (param, params);
+
+/* ===============================================================================================
+   Decode a sample of the images, spread evenly over the directory, before timing anything
+   =============================================================================================== */
+  vector<string> files;
+  get_imagelist (imgdir, files);
+  sort (files.begin(), files.end());
+  if (files.size() == 0)
+  {
+    cout << "no images in " << imgdir << endl;
+    return -1;
+  }
+
+  int step = files.size() > nsample ? files.size()/nsample : 1;
+  vector<Mat> images;
+  double pixels = 0;
+  for (int i = 0; i < files.size() && images.size() < nsample; i += step)
+  {
+    Mat image = imread (imgdir + files[i]);
+    if (image.empty())
+      continue;
+    images.push_back (image);
+    pixels += image.total();
+  }
+  int nimages = images.size();
+  cout << "Sample: " << nimages << " images, " << pixels/nimages/1.0e6 << " Mpixels on average, " << descriptor_name (params.descriptor) << " features" << endl;
+
+/* ===============================================================================================
+   Every pass runs the three ways on each image in turn (so that they see the same cache and
+   CPU frequency conditions); the fastest of the passes is kept for every image and way
+   =============================================================================================== */
+  TwoCalls original (params);
+  FeatureExtractor split (params);
+  split.setMode (EXTRACT_SPLIT);
+  FeatureExtractor fused (params);
+  fused.setMode (EXTRACT_FUSED);
+
+  const char *names[3] = { "two calls", "split", "fused" };
+  vector< vector<double> > best (3, vector<double> (nimages, DBL_MAX));
+  vector<Features> results (3);
+  long kept[3] = { 0, 0, 0 };
+  int identical[3] = { 0, 0, 0 };
+  double freq = getTickFrequency();
+
+  for (int r = 0; r < repeat; r++)
+  {
+    for (int i = 0; i < nimages; i++)
+    {
+      for (int w = 0; w < 3; w++)
+      {
+        int64 t0 = getTickCount();
+        if (w == 0)
+          original.extract (images[i], results[w]);
+        else if (w == 1)
+          split.extract (images[i], results[w]);
+        else
+          fused.extract (images[i], results[w]);
+        best[w][i] = min (best[w][i], (getTickCount() - t0)/freq);
+      }
+
+      if (r != 0)
+        continue;
+      for (int w = 0; w < 3; w++)
+      {
+        kept[w] += results[w].keypoints.size();
+        if (same_features (results[0], results[w]))
+          identical[w]++;
+      }
+    }
+  }
+
+/* ===============================================================================================
+   Report: time per image, keypoints kept, and how many images gave exactly the features of
+   the original two calls
+   =============================================================================================== */
+  double reference = 0;
+  for (int i = 0; i < nimages; i++)
+    reference += best[0][i];
+  reference /= nimages;
+
+  cout << endl;
+  cout << "extraction    ms/image   speedup   kpts/image   identical to two calls" << endl;
+  cout << fixed;
+  for (int w = 0; w < 3; w++)
+  {
+    double mean = 0;
+    for (int i = 0; i < nimages; i++)
+      mean += best[w][i];
+    mean /= nimages;
+
+    cout << setw(9) << left << names[w] << right;
+    cout << setprecision(2) << setw(14) << 1000*mean;
+    cout << setw(10) << (mean > 0 ? reference/mean : 0);
+    cout << setprecision(1) << setw(13) << (double) kept[w]/nimages;
+    cout << setw(15) << identical[w] << " / " << nimages << endl;
+  }
+  cout.unsetf (ios::floatfield);
+  cout << "default mode of the extractor with these parameters: " << (FeatureExtractor (params).fused() ? "fused" : "split") << endl;
+
+  return 0;
+}
+
+/* ===============================================================================================
+   Usage
+   =============================================================================================== */
+int usage()
+{
+    cout << "\n\n" <<endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=                                     BenchExtract                                             ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     This program times feature extraction (detection, filter, description) per image,        ="  << endl;
+    cout << "     " << "=     with the original two calls and with the split and fused modes of the extractor.         ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     Usage is:                                                                                ="  << endl;
+    cout << "     " << "=                 benchExtract.exe                                                             ="  << endl;
+    cout << "     " << "=                                 -i        <path to directory with images>                    ="  << endl;
+    cout << "     " << "=                                 -p        <path to param file for SURF>                      ="  << endl;
+    cout << "     " << "=                                 -n        <number of images in the sample> (20)              ="  << endl;
+    cout << "     " << "=                                 -rep      <number of passes over the sample> (3)             ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "\n\n" <<endl;
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Procedure to read in flag values
+   =============================================================================================== */
+void read_flags(int argc, char** argv, string *imgdir, string *param, int *nsample, int *repeat)
+{
+  string input;
+  for(int i = 1; i < argc; i++)
+  {
+    input = argv[i];
+    if (input == "-i")
+      *imgdir = argv[i + 1];
+    if (input == "-p")
+      *param = argv[i + 1];
+    if (input == "-n")
+      *nsample = atoi(argv[i + 1]);
+    if (input == "-rep")
+      *repeat = atoi(argv[i + 1]);
+  }
+}
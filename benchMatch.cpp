@@ -0,0 +1,265 @@
+/* ============================================================================================
+  benchMatch.cpp                   Version 1           Last Update: 10/19/2026
+
+  This program compares the original matching chain (BFMatcher knn matches, ratio, symmetry
+  and RANSAC tests on vectors of vectors) with the flat, scratch-buffer implementation used by
+  scanDatabase: on a sample of a corpus it counts the heap allocations and bytes allocated
+  per comparison, times both and checks that they keep the same matches.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include "opencv2/highgui/highgui.hpp"
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <atomic>
+
+#include "archv.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace archv;
+
+int  usage();
+void read_flags(int argc, char** argv, string *imgfile, string *imgdir, string *infodir, string *param, int *nsample);
+
+/* ===============================================================================================
+   Allocation counter: every malloc of the process (operator new and cv::fastMalloc both end up
+   there) is counted before being passed on to the C library
+   =============================================================================================== */
+static atomic<long> nallocs (0);
+static atomic<long> nbytes (0);
+
+extern "C"
+{
+extern void *__libc_malloc (size_t size);
+extern void *__libc_calloc (size_t n, size_t size);
+extern void *__libc_realloc (void *p, size_t size);
+
+void *malloc (size_t size)
+{
+  nallocs++;
+  nbytes += size;
+  return __libc_malloc (size);
+}
+
+void *calloc (size_t n, size_t size)
+{
+  nallocs++;
+  nbytes += n*size;
+  return __libc_calloc (n, size);
+}
+
+void *realloc (void *p, size_t size)
+{
+  nallocs++;
+  nbytes += size;
+  return __libc_realloc (p, size);
+}
+}
+
+struct PathStats
+{
+  long allocs, bytes, matches;
+  double seconds;
+};
+
+int main(int argc, char** argv)
+{
+/* ===============================================================================================
+   Show usage if needed
+   =============================================================================================== */
+  if (argc < 2)
+    return usage();
+
+  string input = argv[1];
+  if( input == "-h" || input == "-help" )
+    return usage();
+
+  string imgfile, imgdir, infodir;
+  string param = "";
+  int nsample = 200;            // number of database images compared with the seed
+  double ratio = 0.8;
+
+  read_flags (argc, argv, &imgfile, &imgdir, &infodir, &param, &nsample);
+  if (nsample < 1)
+  {
+    cout << "the sample must have at least one image (-n)" << endl;
+    return -1;
+  }
+
+  Corpus corpus;
+  if (imgdir == "" || corpus.open (imgdir, infodir) != 0 || corpus.size() == 0)
+  {
+    cout << "no images in " << imgdir << endl;
+    return usage();
+  }
+
+/* ===============================================================================================
+   Seed features: extracted from the seed image if one is given, otherwise those of the first
+   image of the corpus. The sample is read into memory first, so that only matching is measured.
+   =============================================================================================== */
+  Features seed;
+  if (imgfile != "")
+  {
+    SurfParams params;
+    if (param != "")
+      read_surfparams (param, params);
+    FeatureExtractor extractor (params);
+    extractor.extract (imread (imgfile), seed);
+  }
+  else
+    read_features (corpus.featurefile (0), seed);
+
+  int step = corpus.size() > nsample ? corpus.size()/nsample : 1;
+  vector<Features> sample;
+  for (int i = 0; i < corpus.size() && sample.size() < nsample; i += step)
+  {
+    sample.push_back (Features());
+    read_features (corpus.featurefile (i), sample.back());
+  }
+  int n = sample.size();
+
+  cout << "Seed: " << seed.keypoints.size() << " keypoints, sample: " << n << " images" << endl;
+
+/* ===============================================================================================
+   Run both chains on the sample; allocations are counted over the whole loop (the output
+   vector is reused, as in a scan). The flat chain is run once beforehand so that its scratch
+   buffers have reached their working size.
+   =============================================================================================== */
+  PathStats knn = { 0, 0, 0, 0 }, flat = { 0, 0, 0, 0 };
+  vector<int> count1 (n), count2 (n);
+  vector<DMatch> matches;
+  MatchScratch scratch;
+  double freq = getTickFrequency();
+
+  for (int k = 0; k < n; k++)
+    match_features (seed, sample[k], matches, ratio, scratch);
+
+  long a0 = nallocs, b0 = nbytes;
+  int64 t0 = getTickCount();
+  for (int k = 0; k < n; k++)
+    knn.matches += count1[k] = match_features_knn (seed, sample[k], matches, ratio);
+  knn.seconds = (getTickCount() - t0)/freq;
+  knn.allocs = nallocs - a0;
+  knn.bytes = nbytes - b0;
+
+  a0 = nallocs, b0 = nbytes;
+  t0 = getTickCount();
+  for (int k = 0; k < n; k++)
+    flat.matches += count2[k] = match_features (seed, sample[k], matches, ratio, scratch);
+  flat.seconds = (getTickCount() - t0)/freq;
+  flat.allocs = nallocs - a0;
+  flat.bytes = nbytes - b0;
+
+  int agree = 0;
+  for (int k = 0; k < n; k++)
+    if (count1[k] == count2[k])
+      agree++;
+
+/* ===============================================================================================
+   Report, per comparison
+   =============================================================================================== */
+  if (n == 0)
+    return 0;
+
+  cout << fixed << setprecision(2);
+  cout << endl;
+  cout << "chain        allocs/cmp     bytes/cmp        ms/cmp     matches" << endl;
+  cout << "knn     " << setw(15) << (double) knn.allocs/n << setw(14) << (double) knn.bytes/n << setw(14) << 1000*knn.seconds/n << setw(12) << knn.matches << endl;
+  cout << "flat    " << setw(15) << (double) flat.allocs/n << setw(14) << (double) flat.bytes/n << setw(14) << 1000*flat.seconds/n << setw(12) << flat.matches << endl;
+  cout << endl;
+  cout << "Same number of matches for " << agree << " of " << n << " images" << endl;
+  cout << "(the remaining allocations of the flat chain are those made inside findFundamentalMat)" << endl;
+
+  return 0;
+}
+
+/* ===============================================================================================
+   Usage
+   =============================================================================================== */
+int usage()
+{
+    cout << "\n\n" <<endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=                                      BenchMatch                                              ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     This program counts the allocations and measures the time per comparison of the          ="  << endl;
+    cout << "     " << "=     original matching chain and of the flat one used by scanDatabase.                        ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     Usage is:                                                                                ="  << endl;
+    cout << "     " << "=                 benchMatch.exe                                                               ="  << endl;
+    cout << "     " << "=                                 -d        <path to directory with images>                    ="  << endl;
+    cout << "     " << "=                                 -k        <path to directory with keypoints of images>       ="  << endl;
+    cout << "     " << "=                                 -i        <path to seed image> (first image of -d)           ="  << endl;
+    cout << "     " << "=                                 -p        <path to param file for SURF>                      ="  << endl;
+    cout << "     " << "=                                 -n        <number of images compared> (200)                  ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "\n\n" <<endl;
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Procedure to read in flag values
+   =============================================================================================== */
+void read_flags(int argc, char** argv, string *imgfile, string *imgdir, string *infodir, string *param, int *nsample)
+{
+  string input;
+  for(int i = 1; i < argc; i++)
+  {
+    input = argv[i];
+    if (input == "-i")
+      *imgfile = argv[i + 1];
+    if (input == "-d")
+      *imgdir = argv[i + 1];
+    if (input == "-k")
+      *infodir = argv[i + 1];
+    if (input == "-p")
+      *param = argv[i + 1];
+    if (input == "-n")
+      *nsample = atoi(argv[i + 1]);
+  }
+}
@@ -0,0 +1,335 @@
+/* ============================================================================================
+  benchQuery.cpp                   Version 1           Last Update: 10/19/2026
+
+  This program measures what the faster query modes of scanDatabase (progressive matching,
+  two-stage ranking, batched matching) cost in ranking quality. Every seed is queried against
+  a corpus held in memory, exhaustively and with each faster mode; for each mode it reports
+  the time per query, the share of the exhaustive top hits that the mode also ranks in its
+  top hits, and the number of seeds whose top hits are exactly the same.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <set>
+#include <cstdlib>
+
+#include "opencv2/highgui/highgui.hpp"
+
+#include "archv.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace archv;
+
+int  usage();
+void read_flags(int argc, char** argv, string *imgdir, string *infodir, string *seedlist, int *nseeds, string *param, int *top, int *coarseKeypoints, int *coarseMatches, int *rerank, int *batch);
+
+/* ===============================================================================================
+   A query mode and its totals over the seeds
+   =============================================================================================== */
+struct Mode
+{
+  string name;
+  QueryOptions options;
+  double seconds;
+  double recall;
+  int identical;
+  int certain;           // seeds whose top hits the query could certify (two-stage ranking)
+  long full;             // images matched with the whole seed and verified by RANSAC
+};
+
+/* ===============================================================================================
+   The top hits of a ranked result list: the first "top" images with a distance above 1 (the
+   hits scanDatabase writes out)
+   =============================================================================================== */
+static vector<QueryResult> top_hits (const vector<QueryResult> &results, int top)
+{
+  vector<QueryResult> hits;
+  for (int r = 0; r < results.size() && hits.size() < top && results[r].distance > 1; r++)
+    hits.push_back (results[r]);
+  return hits;
+}
+
+/* ===============================================================================================
+   Share of the reference hits found among the hits of a mode (1 if there is no reference hit),
+   and whether both lists are the same images with the same distances in the same order
+   =============================================================================================== */
+static double compare_hits (const vector<QueryResult> &reference, const vector<QueryResult> &hits, bool *identical)
+{
+  *identical = reference.size() == hits.size();
+  for (int r = 0; *identical && r < reference.size(); r++)
+    *identical = reference[r].index == hits[r].index && reference[r].distance == hits[r].distance;
+
+  if (reference.size() == 0)
+    return 1;
+  set<int> found;
+  for (int r = 0; r < hits.size(); r++)
+    found.insert (hits[r].index);
+  int nfound = 0;
+  for (int r = 0; r < reference.size(); r++)
+    nfound += found.count (reference[r].index);
+  return (double) nfound/reference.size();
+}
+
+int main(int argc, char** argv)
+{
+/* ===============================================================================================
+   Show usage if needed
+   =============================================================================================== */
+  if (argc < 2)
+    return usage();
+
+  string input = argv[1];
+  if( input == "-h" || input == "-help" )
+    return usage();
+
+  string imgdir, infodir;
+  string seedlist = "";
+  string param = "";
+  int nseeds = 20;              // without -b: number of corpus images used as seeds
+  int top = 10;                 // number of top hits compared
+  int coarseKeypoints = 100;
+  int coarseMatches = 2;
+  int rerank = 50;
+  int batch = 4096;
+
+  read_flags (argc, argv, &imgdir, &infodir, &seedlist, &nseeds, &param, &top, &coarseKeypoints, &coarseMatches, &rerank, &batch);
+
+  Corpus corpus;
+  if (imgdir == "" || corpus.open (imgdir, infodir) != 0 || corpus.size() == 0)
+  {
+    cout << "no images in " << imgdir << endl;
+    return usage();
+  }
+
+/* ===============================================================================================
+   Seeds: the images of the -b list, or corpus images spread over the corpus (their stored
+   features, which have the keypoint responses progressive matching needs)
+   =============================================================================================== */
+  vector<string> names;
+  vector<Features> seeds;
+  if (seedlist != "")
+  {
+    SurfParams params;
+    if (param != "")
+      read_surfparams (param, params);
+    FeatureExtractor extractor (params);
+
+    ifstream list (seedlist.c_str());
+    string line;
+    while (getline (list, line))
+    {
+      if (line == "")
+        continue;
+      seeds.push_back (Features());
+      extractor.extract (imread (line), seeds.back());
+      names.push_back (line);
+    }
+  }
+  else
+  {
+    int step = corpus.size() > nseeds ? corpus.size()/nseeds : 1;
+    for (int i = 0; i < corpus.size() && seeds.size() < nseeds; i += step)
+    {
+      seeds.push_back (Features());
+      read_features (corpus.featurefile (i), seeds.back());
+      names.push_back (corpus.filename (i));
+    }
+  }
+  if (seeds.size() == 0)
+  {
+    cout << "no seeds" << endl;
+    return usage();
+  }
+
+  // the corpus is held in memory, so that the times are those of the matching alone
+  corpus.select (FIELDS_MATCH);
+  corpus.load ();
+  cout << "Corpus: " << corpus.size() << " images in memory, " << seeds.size() << " seeds" << endl;
+
+/* ===============================================================================================
+   Modes: the exhaustive query is the reference
+   =============================================================================================== */
+  vector<Mode> modes;
+  Mode mode;
+  mode.seconds = mode.recall = 0;
+  mode.identical = mode.certain = 0;
+  mode.full = 0;
+
+  mode.name = "exhaustive";
+  modes.push_back (mode);
+
+  mode.name = "progressive";
+  mode.options.coarseKeypoints = coarseKeypoints;
+  mode.options.coarseMatches = coarseMatches;
+  modes.push_back (mode);
+
+  mode.name = "two-stage";
+  mode.options = QueryOptions();
+  mode.options.rerank = rerank;
+  modes.push_back (mode);
+
+  mode.name = "batched";
+  mode.options = QueryOptions();
+  mode.options.batch = batch;
+  modes.push_back (mode);
+
+  for (int s = 0; s < seeds.size(); s++)
+  {
+    vector<QueryResult> reference;
+    for (int m = 0; m < modes.size(); m++)
+    {
+      vector<QueryResult> results;
+      QueryStats stats;
+      query (corpus, seeds[s], results, modes[m].options, &stats);
+      modes[m].seconds += stats.seconds;
+      if (modes[m].options.rerank > 0)
+        modes[m].full += stats.verified;
+      else if (modes[m].options.coarseKeypoints > 0)
+        modes[m].full += stats.escalated;
+      else
+        modes[m].full += results.size();
+
+      if (m == 0)
+        reference = top_hits (results, top);
+      bool identical;
+      modes[m].recall += compare_hits (reference, top_hits (results, top), &identical);
+      if (identical)
+        modes[m].identical++;
+      if (modes[m].options.rerank > 0 && stats.certain >= reference.size())
+        modes[m].certain++;
+    }
+  }
+
+/* ===============================================================================================
+   Report, per query
+   =============================================================================================== */
+  int n = seeds.size();
+  cout << "Progressive: coarse pass with " << coarseKeypoints << " seed keypoints, " << coarseMatches << " matches to go on" << endl;
+  cout << "Two-stage: the " << rerank << " images with the most symmetric matches verified" << endl;
+  cout << "Batched: blocks of " << batch << " database descriptors" << endl;
+  cout << endl;
+  cout << "mode            ms/query   speedup   full matches/query   top " << top << " recall   identical top " << top << endl;
+  cout << fixed;
+  for (int m = 0; m < modes.size(); m++)
+  {
+    double seconds = modes[m].seconds/n;
+    cout << setw(12) << left << modes[m].name << right;
+    cout << setprecision(2) << setw(12) << 1000*seconds;
+    cout << setw(10) << (seconds > 0 ? modes[0].seconds/n/seconds : 0);
+    cout << setprecision(1) << setw(21) << (double) modes[m].full/n;
+    cout << setprecision(3) << setw(15) << modes[m].recall/n;
+    cout << setw(13) << modes[m].identical << " / " << n << endl;
+  }
+  cout.unsetf (ios::floatfield);
+  for (int m = 0; m < modes.size(); m++)
+    if (modes[m].options.rerank > 0)
+      cout << modes[m].name << ": top " << top << " certified by the query itself for " << modes[m].certain << " of " << n << " seeds" << endl;
+
+  return 0;
+}
+
+/* ===============================================================================================
+   Usage
+   =============================================================================================== */
+int usage()
+{
+    cout << "\n\n" <<endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=                                     BenchQuery                                               ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     This program queries a corpus with a set of seeds, exhaustively and with the faster      ="  << endl;
+    cout << "     " << "=     modes of scanDatabase, and compares the times and the top hits.                          ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     Usage is:                                                                                ="  << endl;
+    cout << "     " << "=                 benchQuery.exe                                                               ="  << endl;
+    cout << "     " << "=                                 -d        <path to directory with images>                    ="  << endl;
+    cout << "     " << "=                                 -k        <path to directory with keypoints of images>       ="  << endl;
+    cout << "     " << "=                                 -b        <file listing seed images> (optional)              ="  << endl;
+    cout << "     " << "=                                 -n        <number of corpus images used as seeds> (20)       ="  << endl;
+    cout << "     " << "=                                 -p        <path to param file>                               ="  << endl;
+    cout << "     " << "=                                 -top      <number of top hits compared> (10)                 ="  << endl;
+    cout << "     " << "=                                 -cm       <progressive: seed keypoints of coarse pass> (100) ="  << endl;
+    cout << "     " << "=                                 -ct       <progressive: coarse matches to go on> (2)         ="  << endl;
+    cout << "     " << "=                                 -rr       <two-stage: images verified by RANSAC> (50)        ="  << endl;
+    cout << "     " << "=                                 -batch    <batched: descriptors per block> (4096)            ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "\n\n" <<endl;
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Procedure to read in flag values
+   =============================================================================================== */
+void read_flags(int argc, char** argv, string *imgdir, string *infodir, string *seedlist, int *nseeds, string *param, int *top, int *coarseKeypoints, int *coarseMatches, int *rerank, int *batch)
+{
+  string input;
+  for(int i = 1; i < argc; i++)
+  {
+    input = argv[i];
+    if (input == "-d")
+      *imgdir = argv[i + 1];
+    if (input == "-k")
+      *infodir = argv[i + 1];
+    if (input == "-b")
+      *seedlist = argv[i + 1];
+    if (input == "-n")
+      *nseeds = atoi(argv[i + 1]);
+    if (input == "-p")
+      *param = argv[i + 1];
+    if (input == "-top")
+      *top = atoi(argv[i + 1]);
+    if (input == "-cm")
+      *coarseKeypoints = atoi(argv[i + 1]);
+    if (input == "-ct")
+      *coarseMatches = atoi(argv[i + 1]);
+    if (input == "-rr")
+      *rerank = atoi(argv[i + 1]);
+    if (input == "-batch")
+      *batch = atoi(argv[i + 1]);
+  }
+}
@@ -0,0 +1,571 @@
+/* ============================================================================================
+  clusterCorpus.cpp                Version 1           Last Update: 10/19/2026
+
+  This program finds every group of images of a corpus that share the same pattern (e.g. the
+  same woodblock), without comparing each image with every other one. Each image is summarised
+  by a MinHash signature of its quantized descriptors (random hyperplane codes); locality
+  sensitive hashing of the signatures (banding) proposes candidate pairs, which are then
+  verified with the robust filter (ratio, symmetry and ransac tests). The output is a JSON file
+  with the similarity graph (verified pairs and their distance) and its connected components.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/features2d/features2d.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <algorithm>
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "archv.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace archv;
+
+int  usage();
+void read_flags(int argc, char** argv, string *imgdir, string *infodir, string *output, int *bits, int *bands, int *rows, int *maxbucket, int *minmatches, int *nthreads, bool *inmemory, double *budget);
+
+uint64_t mix64 (uint64_t x);
+void image_tokens (const Mat &descriptors, const Mat &planes, vector<unsigned> &tokens);
+void minhash (const vector<unsigned> &tokens, int nhash, unsigned *signature);
+void candidate_pairs (const vector<unsigned> &signatures, const vector<char> &valid, int bands, int rows, int maxbucket, vector<uint64_t> &pairs);
+int  find_root (vector<int> &parent, int i);
+bool larger_cluster (const vector<int> &a, const vector<int> &b);
+
+/* ===============================================================================================
+   Loop bodies run in parallel: signature of each image, and verification of candidate pairs
+   grouped by their first image
+   =============================================================================================== */
+class SignatureBody : public ParallelLoopBody
+{
+public:
+  SignatureBody (const Corpus &c, const Mat &p, int n, vector<unsigned> &s, vector<char> &v)
+    : corpus (c), planes (p), nhash (n), signatures (s), valid (v) {}
+
+  void operator() (const Range &range) const
+  {
+    Features buffer;
+    vector<unsigned> tokens;
+    for (int i = range.start; i < range.end; i++)
+    {
+      const Features &features = corpus.features (i, buffer);
+      image_tokens (features.descriptors, planes, tokens);
+      valid[i] = tokens.size() > 0;
+      minhash (tokens, nhash, &signatures[(size_t) i*nhash]);
+    }
+  }
+
+private:
+  const Corpus &corpus;
+  const Mat &planes;
+  int nhash;
+  vector<unsigned> &signatures;
+  vector<char> &valid;
+};
+
+class VerifyBody : public ParallelLoopBody
+{
+public:
+  VerifyBody (const Corpus &c, const vector<uint64_t> &p, const vector<int> &g, double r, vector<int> &d)
+    : corpus (c), pairs (p), groups (g), ratio (r), distance (d) {}
+
+  void operator() (const Range &range) const
+  {
+    Features buffer1, buffer2;
+    vector<DMatch> matches;
+    for (int g = range.start; g < range.end; g++)
+    {
+      int i = pairs[groups[g]] >> 32;
+      const Features &features1 = corpus.features (i, buffer1);
+      for (int p = groups[g]; p < groups[g+1]; p++)
+      {
+        int j = pairs[p] & 0xffffffff;
+        const Features &features2 = corpus.features (j, buffer2);
+        distance[p] = match_features (features1, features2, matches, ratio);
+      }
+    }
+  }
+
+private:
+  const Corpus &corpus;
+  const vector<uint64_t> &pairs;
+  const vector<int> &groups;
+  double ratio;
+  vector<int> &distance;
+};
+
+
+int main(int argc, char** argv)
+{
+/* ===============================================================================================
+   Show usage if needed
+   =============================================================================================== */
+  if (argc < 2)
+    return usage();
+
+  string input = argv[1];
+  if( input == "-h" || input == "-help" )
+    return usage();
+
+/* ===============================================================================================
+   (1) Initialize all variables (2) parse command line
+	- bits       : number of random hyperplanes used to quantize a descriptor (token size)
+	- bands, rows: LSH banding of the MinHash signature (bands*rows hash functions); two images
+	               become candidates if their signatures agree on all rows of one band
+	- maxbucket  : buckets larger than this are ignored (tokens common to too many images)
+	- minmatches : minimum number of matches after the robust filter to link two images
+   =============================================================================================== */
+  string imgdir, infodir, output;
+  int bits = 16;
+  int bands = 32;
+  int rows = 2;
+  int maxbucket = 200;
+  int minmatches = 10;
+  int nthreads = 0;
+  bool inmemory = false;
+  double budget = 0;            // memory budget of the feature cache, in MB (0: no cache)
+  double ratio = 0.8;
+
+  read_flags (argc, argv, &imgdir, &infodir, &output, &bits, &bands, &rows, &maxbucket, &minmatches, &nthreads, &inmemory, &budget);
+
+  if (bits < 1 || bits > 32 || bands < 1 || rows < 1)
+  {
+    cout << "bits must be between 1 and 32, bands and rows must be positive" << endl;
+    return -1;
+  }
+
+/* ===============================================================================================
+   Open the corpus; keep it in memory if requested (faster verification, but needs RAM for the
+   whole corpus), or keep the most recently used keypoint files within a memory budget
+   =============================================================================================== */
+  struct stat sb;
+  if (stat(imgdir.c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode))
+  {
+    cout << imgdir << " does not exist, or is not a directory; try again" << endl;
+    return -1;
+  }
+
+  Corpus corpus;
+  if (corpus.open (imgdir, infodir) != 0)
+  {
+    cout << " Problem while trying to read in list of images; check the directory!" << endl;
+    return -1;
+  }
+
+  // matching only needs the keypoint coordinates and the descriptors
+  corpus.select (FIELDS_MATCH);
+  if (inmemory)
+    corpus.load ();
+  else if (budget > 0)
+    corpus.cache ((long) (budget*1024*1024));
+
+  int nimages = corpus.size();
+  int nhash = bands*rows;
+  double freq = getTickFrequency();
+  int64 t0 = getTickCount();
+
+/* ===============================================================================================
+   Signatures: quantize each descriptor with random hyperplanes (one bit per plane), and
+   compute the MinHash signature of the set of codes of each image. The planes have the width
+   of the descriptors of the corpus; binary descriptors (ORB, BRISK) are quantized by sampling
+   "bits" random bits of each instead
+   =============================================================================================== */
+  Mat descriptors;
+  {
+    Features buffer;
+    for (int i = 0; i < nimages && descriptors.empty(); i++)
+      descriptors = corpus.features (i, buffer).descriptors.clone();
+  }
+  if (descriptors.empty() || (descriptors.type() != CV_32F && descriptors.type() != CV_8U))
+  {
+    cout << "no float (SURF) or binary (ORB, BRISK) descriptors in " << infodir << endl;
+    return -1;
+  }
+
+  Mat planes;
+  RNG rng (12345);
+  if (descriptors.type() == CV_32F)
+  {
+    planes.create (bits, descriptors.cols, CV_32F);
+    rng.fill (planes, RNG::NORMAL, Scalar(0), Scalar(1));
+  }
+  else
+  {
+    planes.create (1, bits, CV_32S);
+    for (int b = 0; b < bits; b++)
+      planes.at<int>(b) = rng.uniform (0, 8*descriptors.cols);
+  }
+
+  vector<unsigned> signatures ((size_t) nimages*nhash);
+  vector<char> valid (nimages);
+
+  run_parallel (Range (0, nimages), SignatureBody (corpus, planes, nhash, signatures, valid), nthreads, 16);
+
+  cout << "Signatures computed for " << nimages << " images in " << (getTickCount() - t0)/freq << " s" << endl;
+
+/* ===============================================================================================
+   Candidate pairs from LSH banding of the signatures
+   =============================================================================================== */
+  t0 = getTickCount();
+  vector<uint64_t> pairs;
+  candidate_pairs (signatures, valid, bands, rows, maxbucket, pairs);
+
+  double allpairs = 0.5*nimages*(nimages - 1.0);
+  cout << "Candidate pairs: " << pairs.size() << " out of " << allpairs << " (" << (getTickCount() - t0)/freq << " s)" << endl;
+
+/* ===============================================================================================
+   Verify candidates with the robust filter. Pairs are sorted by first image, so each group
+   loads its first image only once
+   =============================================================================================== */
+  t0 = getTickCount();
+  vector<int> groups;
+  for (int p = 0; p < pairs.size(); p++)
+    if (p == 0 || (pairs[p] >> 32) != (pairs[p-1] >> 32))
+      groups.push_back (p);
+  int ngroups = groups.size();
+  groups.push_back (pairs.size());
+
+  vector<int> distance (pairs.size(), 0);
+  run_parallel (Range (0, ngroups), VerifyBody (corpus, pairs, groups, ratio, distance), nthreads, 1);
+
+  cout << "Candidates verified in " << (getTickCount() - t0)/freq << " s" << endl;
+  if (corpus.cached())
+  {
+    CacheStats cache = corpus.cacheStats();
+    cout << "Feature cache (" << budget << " MB): " << cache.hits << " hits, " << cache.misses << " misses, hit rate ";
+    cout << 100*cache.hitRate() << " %, " << cache.evictions << " evictions, " << cache.bytesRead << " bytes read" << endl;
+  }
+
+/* ===============================================================================================
+   Connected components of the similarity graph (union-find)
+   =============================================================================================== */
+  vector<int> parent (nimages);
+  for (int i = 0; i < nimages; i++)
+    parent[i] = i;
+
+  int nedges = 0;
+  for (int p = 0; p < pairs.size(); p++)
+  {
+    if (distance[p] < minmatches)
+      continue;
+    nedges++;
+    int ri = find_root (parent, pairs[p] >> 32);
+    int rj = find_root (parent, pairs[p] & 0xffffffff);
+    if (ri != rj)
+      parent[max (ri, rj)] = min (ri, rj);
+  }
+
+  vector< vector<int> > members (nimages);
+  for (int i = 0; i < nimages; i++)
+    members[find_root (parent, i)].push_back (i);
+
+  vector< vector<int> > clusters;
+  for (int i = 0; i < nimages; i++)
+    if (members[i].size() > 1)
+      clusters.push_back (members[i]);
+
+  stable_sort (clusters.begin(), clusters.end(), larger_cluster);
+
+  cout << "Edges: " << nedges << ", clusters: " << clusters.size() << endl;
+
+/* ===============================================================================================
+   Write out the similarity graph and the clusters in JSON format
+   =============================================================================================== */
+  ofstream json (output.c_str());
+  json << "{\"path\":\"" << imgdir << "\"";
+  json << ", \"edges\":[";
+  int count = 0;
+  for (int p = 0; p < pairs.size(); p++)
+  {
+    if (distance[p] < minmatches)
+      continue;
+    if (count != 0)
+      json << ",";
+    json << "{\"a\":\"" << corpus.name (pairs[p] >> 32) << "\",";
+    json << "\"b\":\"" << corpus.name (pairs[p] & 0xffffffff) << "\",";
+    json << "\"distance\":" << distance[p] << "}";
+    count++;
+  }
+  json << "], \"clusters\":[";
+  for (int c = 0; c < clusters.size(); c++)
+  {
+    if (c != 0)
+      json << ",";
+    json << "[";
+    for (int m = 0; m < clusters[c].size(); m++)
+    {
+      if (m != 0)
+        json << ",";
+      json << "\"" << corpus.name (clusters[c][m]) << "\"";
+    }
+    json << "]";
+  }
+  json << "]}" << endl;
+  json.close();
+
+  return 0;
+}
+
+/* ===============================================================================================
+   Usage
+   =============================================================================================== */
+int usage()
+{
+    cout << "\n\n" <<endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=                                      ClusterCorpus                                           ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     This program finds all groups of near-duplicate images of a corpus. Candidate pairs      ="  << endl;
+    cout << "     " << "=     are proposed by MinHash / LSH over quantized descriptors, then verified with the         ="  << endl;
+    cout << "     " << "=     robust filter (ratio, symmetry and ransac tests). Output is the similarity graph and     ="  << endl;
+    cout << "     " << "=     its connected components (clusters), in JSON format.                                     ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     Usage is:                                                                                ="  << endl;
+    cout << "     " << "=                 clusterCorpus.exe                                                            ="  << endl;
+    cout << "     " << "=                                 -d        <path to directory with images>                    ="  << endl;
+    cout << "     " << "=                                 -k        <path to directory with keypoints of images>       ="  << endl;
+    cout << "     " << "=                                 -o        <path to output file>                              ="  << endl;
+    cout << "     " << "=                                 -bits     <bits per quantized descriptor> (16)               ="  << endl;
+    cout << "     " << "=                                 -bands    <number of LSH bands> (32)                         ="  << endl;
+    cout << "     " << "=                                 -rows     <rows per LSH band> (2)                            ="  << endl;
+    cout << "     " << "=                                 -maxb     <largest LSH bucket considered> (200)              ="  << endl;
+    cout << "     " << "=                                 -m        <minimum number of matches for an edge> (10)       ="  << endl;
+    cout << "     " << "=                                 -t        <number of threads> (one per core)                 ="  << endl;
+    cout << "     " << "=                                 -load     keep all keypoint files in memory                  ="  << endl;
+    cout << "     " << "=                                 --mem-budget <MB: keep keypoint files in an LRU cache>       ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "\n\n" <<endl;
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Procedure to read in flag values
+   =============================================================================================== */
+void read_flags(int argc, char** argv, string *imgdir, string *infodir, string *output, int *bits, int *bands, int *rows, int *maxbucket, int *minmatches, int *nthreads, bool *inmemory, double *budget)
+{
+  string input;
+  for(int i = 1; i < argc; i++)
+  {
+    input = argv[i];
+    if (input == "-d") 
+      *imgdir = argv[i + 1];
+    if (input == "-k") 
+      *infodir = argv[i + 1];
+    if (input == "-o") 
+      *output = argv[i + 1];
+
+    if (input == "-bits")
+      *bits = atoi(argv[i+1]);
+    if (input == "-bands")
+      *bands = atoi(argv[i+1]);
+    if (input == "-rows")
+      *rows = atoi(argv[i+1]);
+    if (input == "-maxb")
+      *maxbucket = atoi(argv[i+1]);
+    if (input == "-m")
+      *minmatches = atoi(argv[i+1]);
+    if (input == "-t")
+      *nthreads = atoi(argv[i+1]);
+    if (input == "-load")
+      *inmemory = true;
+    if (input == "-mem-budget" || input == "--mem-budget")
+      *budget = atof(argv[i + 1]);
+  }
+}
+
+/* ===============================================================================================
+   64 bit mixing function (splitmix64 finalizer), used as the family of hash functions
+   =============================================================================================== */
+uint64_t mix64 (uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* ===============================================================================================
+   Quantize the descriptors of an image: bit b of the code of a descriptor is the sign of its
+   projection on plane b. For binary descriptors "planes" holds bit positions (1 x bits, CV_32S)
+   and bit b of the code is the descriptor bit at position b. Descriptors of another type or
+   width than the planes give no codes. Returns the sorted set of distinct codes.
+   =============================================================================================== */
+void image_tokens (const Mat &descriptors, const Mat &planes, vector<unsigned> &tokens)
+{
+  tokens.clear();
+  if (descriptors.rows == 0)
+    return;
+
+  if (planes.type() == CV_32S)
+  {
+    if (descriptors.type() != CV_8U)
+      return;
+    for (int b = 0; b < planes.cols; b++)
+      if (planes.at<int>(b) >= 8*descriptors.cols)
+        return;
+    for (int i = 0; i < descriptors.rows; i++)
+    {
+      const uchar *desc = descriptors.ptr<uchar>(i);
+      unsigned code = 0;
+      for (int b = 0; b < planes.cols; b++)
+      {
+        int bit = planes.at<int>(b);
+        if (desc[bit >> 3] & (1 << (bit & 7)))
+          code |= 1u << b;
+      }
+      tokens.push_back (code);
+    }
+    sort (tokens.begin(), tokens.end());
+    tokens.erase (unique (tokens.begin(), tokens.end()), tokens.end());
+    return;
+  }
+
+  if (descriptors.type() != CV_32F || descriptors.cols != planes.cols)
+    return;
+
+  Mat projections;
+  gemm (descriptors, planes, 1, Mat(), 0, projections, GEMM_2_T);
+
+  for (int i = 0; i < projections.rows; i++)
+  {
+    const float *proj = projections.ptr<float>(i);
+    unsigned code = 0;
+    for (int b = 0; b < projections.cols; b++)
+      if (proj[b] > 0)
+        code |= 1u << b;
+    tokens.push_back (code);
+  }
+
+  sort (tokens.begin(), tokens.end());
+  tokens.erase (unique (tokens.begin(), tokens.end()), tokens.end());
+}
+
+/* ===============================================================================================
+   MinHash signature of a set of tokens: for each hash function, the minimum hash over the set
+   =============================================================================================== */
+void minhash (const vector<unsigned> &tokens, int nhash, unsigned *signature)
+{
+  for (int k = 0; k < nhash; k++)
+  {
+    uint64_t seed = mix64 (k + 1);
+    unsigned hmin = 0xffffffffu;
+    for (int t = 0; t < tokens.size(); t++)
+    {
+      unsigned h = mix64 (seed ^ tokens[t]) >> 32;
+      if (h < hmin)
+        hmin = h;
+    }
+    signature[k] = hmin;
+  }
+}
+
+/* ===============================================================================================
+   LSH banding: images whose signatures are identical on all rows of a band fall in the same
+   bucket. Each pair of images sharing a bucket (of at most maxbucket images) is a candidate.
+   Pairs are returned sorted and without duplicates, encoded as (i << 32) | j with i < j.
+   =============================================================================================== */
+void candidate_pairs (const vector<unsigned> &signatures, const vector<char> &valid, int bands, int rows, int maxbucket, vector<uint64_t> &pairs)
+{
+  int nimages = valid.size();
+  int nhash = bands*rows;
+  vector< pair<uint64_t,int> > buckets;
+
+  pairs.clear();
+  for (int b = 0; b < bands; b++)
+  {
+    buckets.clear();
+    for (int i = 0; i < nimages; i++)
+    {
+      if (!valid[i])
+        continue;
+      uint64_t key = b;
+      for (int r = 0; r < rows; r++)
+        key = mix64 (key ^ signatures[(size_t) i*nhash + b*rows + r]);
+      buckets.push_back (make_pair (key, i));
+    }
+    sort (buckets.begin(), buckets.end());
+
+    int start = 0;
+    for (int e = 1; e <= buckets.size(); e++)
+    {
+      if (e < buckets.size() && buckets[e].first == buckets[start].first)
+        continue;
+      if (e - start > 1 && e - start <= maxbucket)
+        for (int p = start; p < e; p++)
+          for (int q = p+1; q < e; q++)
+            pairs.push_back (((uint64_t) buckets[p].second << 32) | buckets[q].second);
+      start = e;
+    }
+
+    sort (pairs.begin(), pairs.end());
+    pairs.erase (unique (pairs.begin(), pairs.end()), pairs.end());
+  }
+}
+
+/* ===============================================================================================
+   Union-find: root of the component of image i, with path halving
+   =============================================================================================== */
+int find_root (vector<int> &parent, int i)
+{
+  while (parent[i] != i)
+  {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
+
+/* ===============================================================================================
+   Order of the clusters in the output: largest first
+   =============================================================================================== */
+bool larger_cluster (const vector<int> &a, const vector<int> &b)
+{
+  return a.size() > b.size();
+}
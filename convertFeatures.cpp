@@ -0,0 +1,309 @@
+/* ============================================================================================
+  convertFeatures.cpp              Version 1           Last Update: 10/19/2026
+
+  This program converts a directory of feature files between the YAML format written by
+  processImages (.yml) and the binary format (.akf), in either direction, on several threads.
+  Every converted file is read back and compared bit for bit with its source. Files are
+  written under a temporary name and renamed when complete, so that an interrupted
+  conversion can simply be run again: files already converted are skipped.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "archv.hpp"
+#include "featurestore.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace archv;
+
+int  usage();
+void read_flags(int argc, char** argv, string *indir, string *outdir, string *format, string *codec, int *level, int *nthreads, bool *verify);
+long file_size (string filename);
+
+enum { CONVERTED = 0, SKIPPED = 1, FAILED = 2, MISMATCH = 3 };
+
+/* ===============================================================================================
+   Conversion of one file: read the source, write the target under a temporary name, read it
+   back and compare, then rename it. A target that already exists was completed by an earlier
+   run and is skipped.
+   =============================================================================================== */
+struct FileResult
+{
+  int status;
+  long bytesIn, bytesOut;
+};
+
+class ConvertBody : public ParallelLoopBody
+{
+public:
+  ConvertBody (const vector<string> &i, const vector<string> &o, const vector<string> &t, bool b, const StoreOptions &s, bool v, vector<FileResult> &r)
+    : inputs (i), outputs (o), temps (t), binary (b), options (s), verify (v), results (r) {}
+
+  void operator() (const Range &range) const
+  {
+    Features features, check;
+    struct stat sb;
+    for (int i = range.start; i < range.end; i++)
+    {
+      FileResult &result = results[i];
+      result.bytesIn = result.bytesOut = 0;
+
+      if (stat (outputs[i].c_str(), &sb) == 0)
+      {
+        result.status = SKIPPED;
+        continue;
+      }
+
+      result.status = FAILED;
+      if (read_features (inputs[i], features) != 0)
+        continue;
+
+      int ierr = binary ? write_binary_features (temps[i], features, options) : write_features (temps[i], features);
+      if (ierr != 0)
+      {
+        remove (temps[i].c_str());
+        continue;
+      }
+
+      if (verify && (read_features (temps[i], check) != 0 || !same_features (features, check)))
+      {
+        result.status = MISMATCH;
+        remove (temps[i].c_str());
+        continue;
+      }
+
+      if (rename (temps[i].c_str(), outputs[i].c_str()) != 0)
+        continue;
+
+      result.status = CONVERTED;
+      result.bytesIn = file_size (inputs[i]);
+      result.bytesOut = file_size (outputs[i]);
+    }
+  }
+
+private:
+  const vector<string> &inputs, &outputs, &temps;
+  bool binary;
+  const StoreOptions &options;
+  bool verify;
+  vector<FileResult> &results;
+};
+
+
+int main(int argc, char** argv)
+{
+/* ===============================================================================================
+   Show usage if needed
+   =============================================================================================== */
+  if (argc < 2)
+    return usage();
+
+  string input = argv[1];
+  if( input == "-h" || input == "-help" )
+    return usage();
+
+  string indir, outdir;
+  string format = "akf";        // target format: akf or yml
+  string codec = "lz4";
+  int level = 3;
+  int nthreads = 0;             // 0: one thread per core
+  bool verify = true;
+
+  read_flags (argc, argv, &indir, &outdir, &format, &codec, &level, &nthreads, &verify);
+  if (indir == "" || outdir == "" || (format != "akf" && format != "yml"))
+    return usage();
+  if (*indir.rbegin() != '/')
+    indir.append ("/");
+  if (*outdir.rbegin() != '/')
+    outdir.append ("/");
+
+  bool binary = format == "akf";
+  StoreOptions options;
+  options.codec = parse_codec (codec);
+  options.level = level;
+  if (binary && (options.codec < 0 || !codec_available (options.codec)))
+  {
+    cout << "codec " << codec << " is not available" << endl;
+    return -1;
+  }
+
+/* ===============================================================================================
+   List the source files (the other format) and the names of their targets; temporary files
+   are hidden files of the output directory, so they are never taken for sources
+   =============================================================================================== */
+  vector<string> files, inputs, outputs, temps;
+  if (get_filelist (indir, files) != 0)
+  {
+    cout << "cannot read directory " << indir << endl;
+    return -1;
+  }
+
+  string source = binary ? ".yml" : ".akf";
+  string target = binary ? ".akf" : ".yml";
+  for (int i = 0; i < files.size(); i++)
+  {
+    int pos = files[i].find_last_of (".");
+    if (files[i][0] == '.' || pos == string::npos || files[i].substr (pos) != source)
+      continue;
+    string base = files[i].substr (0, pos);
+    inputs.push_back (indir + files[i]);
+    outputs.push_back (outdir + base + target);
+    temps.push_back (outdir + "." + base + target);
+  }
+
+  if (inputs.size() == 0)
+  {
+    cout << "no " << source << " files in " << indir << endl;
+    return -1;
+  }
+
+/* ===============================================================================================
+   Convert in parallel, and report the throughput
+   =============================================================================================== */
+  vector<FileResult> results (inputs.size());
+  int64 t0 = getTickCount();
+  run_parallel (Range (0, inputs.size()), ConvertBody (inputs, outputs, temps, binary, options, verify, results), nthreads, 16);
+  double seconds = (getTickCount() - t0)/getTickFrequency();
+
+  int count[4] = { 0, 0, 0, 0 };
+  long bytesIn = 0, bytesOut = 0;
+  for (int i = 0; i < results.size(); i++)
+  {
+    count[results[i].status]++;
+    bytesIn += results[i].bytesIn;
+    bytesOut += results[i].bytesOut;
+    if (results[i].status == FAILED)
+      cout << "conversion failed   : " << inputs[i] << endl;
+    if (results[i].status == MISMATCH)
+      cout << "round trip mismatch : " << inputs[i] << endl;
+  }
+
+  cout << fixed << setprecision(2);
+  cout << "Converted " << count[CONVERTED] << " of " << inputs.size() << " files to " << target;
+  if (binary)
+    cout << " (" << codec_name (options.codec) << ")";
+  cout << " in " << seconds << " s" << endl;
+  cout << "  already converted : " << count[SKIPPED] << endl;
+  cout << "  failed            : " << count[FAILED] << endl;
+  cout << "  mismatches        : " << count[MISMATCH] << (verify ? "" : " (not verified)") << endl;
+  if (seconds > 0)
+    cout << "  throughput        : " << count[CONVERTED]/seconds << " files/s, " << bytesIn/seconds/1.0e6 << " MB/s read, " << bytesOut/seconds/1.0e6 << " MB/s written" << endl;
+  if (bytesOut > 0)
+    cout << "  size ratio        : " << (double) bytesIn/bytesOut << " (" << bytesIn << " -> " << bytesOut << " bytes)" << endl;
+
+  return (count[FAILED] + count[MISMATCH]) > 0 ? -1 : 0;
+}
+
+/* ===============================================================================================
+   Usage
+   =============================================================================================== */
+int usage()
+{
+    cout << "\n\n" <<endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=                                      ConvertFeatures                                         ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     This program converts feature files from YAML (.yml) to binary (.akf) or back,           ="  << endl;
+    cout << "     " << "=     checks that every converted file is bit for bit identical to its source, and can be      ="  << endl;
+    cout << "     " << "=     run again after an interruption (converted files are skipped).                           ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     Usage is:                                                                                ="  << endl;
+    cout << "     " << "=                 convertFeatures.exe                                                          ="  << endl;
+    cout << "     " << "=                                 -i        <path to input keypoints directory>                ="  << endl;
+    cout << "     " << "=                                 -o        <path to output keypoints directory>               ="  << endl;
+    cout << "     " << "=                                 -to       <akf|yml: target format> (akf)                     ="  << endl;
+    cout << "     " << "=                                 -c        <none|lz4|zstd: codec for akf> (lz4)               ="  << endl;
+    cout << "     " << "=                                 -cl       <compression level for zstd> (3)                   ="  << endl;
+    cout << "     " << "=                                 -t        <number of threads> (all cores)                    ="  << endl;
+    cout << "     " << "=                                 -noverify (do not read back the converted files)             ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "\n\n" <<endl;
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Procedure to read in flag values
+   =============================================================================================== */
+void read_flags(int argc, char** argv, string *indir, string *outdir, string *format, string *codec, int *level, int *nthreads, bool *verify)
+{
+  string input;
+  for(int i = 1; i < argc; i++)
+  {
+    input = argv[i];
+    if (input == "-i")
+      *indir = argv[i + 1];
+    if (input == "-o")
+      *outdir = argv[i + 1];
+    if (input == "-to")
+      *format = argv[i + 1];
+    if (input == "-c")
+      *codec = argv[i + 1];
+    if (input == "-cl")
+      *level = atoi(argv[i + 1]);
+    if (input == "-t")
+      *nthreads = atoi(argv[i + 1]);
+    if (input == "-noverify")
+      *verify = false;
+  }
+}
+
+/* ===============================================================================================
+   Procedure returning the size of a file in bytes (0 if it does not exist)
+   =============================================================================================== */
+long file_size (string filename)
+{
+  struct stat sb;
+  if (stat (filename.c_str(), &sb) != 0)
+    return 0;
+  return sb.st_size;
+}
@@ -54,6 +54,9 @@
 
 #include <fstream>
 #include <iostream>
+#include <sstream>
+#include <iomanip>
+#include <unordered_map>
 #include <math.h>
 
 #include <sys/types.h>
@@ -61,20 +64,20 @@
 #include <dirent.h>
 #include <errno.h>
 
+#include "archv.hpp"
+#include "featurestore.hpp"
+
 using namespace cv;
 using namespace std;
+using namespace archv;
 
 int usage();
-void read_flags (int argc, char** argv, string *imgfile1, string *imgfile2, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin);
-void read_surfparams(string param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin);
-
-int ratioTest(vector<vector<cv::DMatch> > &matches, double ratio);
-void symmetryTest(const vector<vector<DMatch> >& matches1,const vector<vector<DMatch> >& matches2, vector<DMatch>& symMatches);
-Mat ransacTest(const vector<cv::DMatch>& matches,const vector<cv::KeyPoint>& keypoints1, const vector<cv::KeyPoint>& keypoints2, vector<cv::DMatch>& outMatches);
+void read_flags (int argc, char** argv, string *imgfile1, string *imgfile2, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin, string *matchfile, int *rank, string *jsonfile, string *infodir, string *sheetfile, int *top, int *nthreads, string *thumbdir, int *minwidth, string *roi, string *polygonfile);
 
-void filter_keypoints (vector <KeyPoint> &keypoints, int sizemin, double responsemin);
 void show_keypoints (vector<KeyPoint>& keypoints, Mat& drawImg);
-Mat DrawMatch(Mat& image1, vector<KeyPoint>& keypoints1, Mat& image2, vector<KeyPoint>& keypoints2, vector<DMatch>& matches1to2);
+Mat DrawMatch(const Mat& image1, const vector<KeyPoint>& keypoints1, const Mat& image2, const vector<KeyPoint>& keypoints2, const vector<DMatch>& matches1to2);
+Mat render_matches (const Mat& img1, const vector<KeyPoint>& keypoints1, const Mat& img2, const vector<KeyPoint>& keypoints2, const vector<DMatch>& matches);
+int draw_results (string jsonfile, string seedfile, string infodir, string outdir, string sheetfile, int top, int nthreads, string thumbdir, int minwidth, const FeatureExtractor &extractor, double ratio, string roi, string polygonfile);
 
 int main(int argc, char** argv)
 {
@@ -93,6 +96,17 @@ int main(int argc, char** argv)
    =============================================================================================== */
   string imgfile1, imgfile2, output;
   string param = "";
+  string matchfile = "";                   // .akm file saved by scanDatabase -sm
+  int rank = 0;                            // which of its hits to draw
+  string jsonfile = "";                    // scanDatabase result file (batch mode)
+  string infodir = "";                     // keypoint files of the corpus (batch mode, optional)
+  string sheetfile = "";                   // contact sheet of the batch (optional)
+  int top = 10;                            // number of hits drawn in batch mode
+  int nthreads = 0;                        // 0: one per core
+  string thumbdir = "";                    // thumbnails written by processImages -th
+  int minwidth = 800;                      // smallest width of an image read from its thumbnails
+  string roi = "";                         // region of the seed searched by scanDatabase -roi
+  string polygonfile = "";                 // or its polygon (scanDatabase -mask)
 
   int minh= 2000 ;
   int octaves = 8;
@@ -102,61 +116,97 @@ int main(int argc, char** argv)
   double scale = 1;
   double ratio = 0.8;
 
-  read_flags (argc, argv, &imgfile1, &imgfile2, &output, &param, &minh, &octaves, &layers, &sizemin, &responsemin);
+  read_flags (argc, argv, &imgfile1, &imgfile2, &output, &param, &minh, &octaves, &layers, &sizemin, &responsemin, &matchfile, &rank, &jsonfile, &infodir, &sheetfile, &top, &nthreads, &thumbdir, &minwidth, &roi, &polygonfile);
 
   if (param != "")
     read_surfparams (param, &minh, &octaves, &layers, &sizemin, &responsemin);
 
 /* ===============================================================================================
-   Create all structures that are needed to process the images:
-        - use SURF for key points detection and feature extraction
-	- use Brute Force Matching to match descriptors between two images
+   Create the feature extractor: detection, filter on size and response, description (SURF,
+   or the binary descriptor selected in the parameter file)
    =============================================================================================== */
-  SurfFeatureDetector detector (minh, octaves, layers);  // Define SURF detector
-
-  Ptr<DescriptorExtractor> extractor = new SurfDescriptorExtractor(); // Feature extractor from keypoints
-
-
-  vector<KeyPoint> keypoints1;                                        // Vector of keypoints for image 1
-  vector<KeyPoint> keypoints2;                                        // Vector of keypoints for image 2
+  SurfParams params (minh, octaves, layers, sizemin, responsemin);
+  if (param != "")
+    read_descriptorparams (param, params);
+  FeatureExtractor extractor (params);
 
-  BFMatcher matcher;							 // Brute Force Matcher
+  if (jsonfile != "")
+    return draw_results (jsonfile, imgfile1, infodir, output, sheetfile, top, nthreads, thumbdir, minwidth, extractor, ratio, roi, polygonfile);
 
-  vector <vector <DMatch> > matches1;	 // Matches when comparing image 1 -> image 2
-  vector <vector <DMatch> > matches2;	 // Matches when comparing image 2 -> image 1
-  vector <DMatch> sym_matches;				 // Matches after symmetry filter
-  vector <DMatch> matches;						 // Matches after RANSAC filter
+  Features features1;                      // Keypoints and descriptors for image 1
+  Features features2;                      // Keypoints and descriptors for image 2
+  vector <DMatch> matches;                 // Matches after RANSAC filter
 
 /* ===============================================================================================
    Process images:
 	- detect keypoints
 	- filter keypoints
+	- generate descriptors from key points
    =============================================================================================== */
   Mat img1;
   Mat img2;
 
-  img1 = imread(imgfile1);
-  img2 = imread(imgfile2);
+  if (matchfile != "")
+  {
+/* ===============================================================================================
+   Render a hit saved by scanDatabase: the seed keypoints and the matches are in the .akm file,
+   the keypoints of the hit are in its feature file, so nothing is detected or matched again
+   =============================================================================================== */
+    MatchFile saved;
+    if (read_matchfile (matchfile, saved) != 0)
+    {
+      cerr << "could not read match file: " << matchfile << endl;
+      return -1;
+    }
+    if (rank < 0 || rank >= saved.hits.size())
+    {
+      cerr << matchfile << " has " << saved.hits.size() << " hits, no hit of rank " << rank << endl;
+      return -1;
+    }
+    const MatchRecord& hit = saved.hits[rank];
+    if (read_features (hit.featurefile, features2, FIELDS_KEYPOINTS) != 0)
+    {
+      cerr << "could not read features: " << hit.featurefile << endl;
+      return -1;
+    }
+    features1.keypoints = saved.seedKeypoints;
+    matches = hit.matches;
+    imgfile1 = saved.seed;
+    imgfile2 = hit.image;
+    cout << "hit " << rank << ": " << imgfile2 << " (" << hit.distance << ")" << endl;
+  }
 
-  detector.detect( img1, keypoints1 );
-  detector.detect( img2, keypoints2 );
+  vector<KeyPoint>& keypoints1 = features1.keypoints;
+  vector<KeyPoint>& keypoints2 = features2.keypoints;
 
+  if (matchfile != "")
+  {
+    // nothing to extract: the images can be read from their thumbnails, at the scale of which
+    // the keypoints are then drawn
+    int factor1 = load_image (imgfile1, thumbdir, minwidth, img1);
+    int factor2 = load_image (imgfile2, thumbdir, minwidth, img2);
+    scale_keypoints (keypoints1, 1.0/factor1);
+    scale_keypoints (keypoints2, 1.0/factor2);
+  }
+  else
+  {
+    img1 = imread(imgfile1);
+    img2 = imread(imgfile2);
 
-  int nk1, nk2;
-  nk1 = keypoints1.size();
-  nk2 = keypoints2.size();
-  filter_keypoints (keypoints1, sizemin, responsemin);
-  filter_keypoints (keypoints2, sizemin, responsemin);
+    // as in scanDatabase, only the keypoints of the seed region are used when one is given
+    Mat mask;
+    if (seed_mask (img1.size(), roi, polygonfile, mask) != 0)
+    {
+      cerr << "Region should be given as x,y,w,h, polygons as one x y vertex per line (at least 3)" << endl;
+      return -1;
+    }
 
-  cout << "Number of keypoints 1 : " << nk1 << " After filter : " << keypoints1.size() << endl;
-  cout << "Number of keypoints 2 : " << nk2 << " After filter : " << keypoints2.size() <<endl;
+    int nk1, nk2;
+    nk1 = extractor.extract (img1, features1, mask);
+    nk2 = extractor.extract (img2, features2);
 
-/* ===============================================================================================
-   Generate descriptors from key points
-   =============================================================================================== */
-  Mat descriptors1, descriptors2;
-  extractor->compute(img1, keypoints1, descriptors1);
-  extractor->compute(img2, keypoints2, descriptors2);
+    cout << "Number of keypoints 1 : " << nk1 << " After filter : " << keypoints1.size() << endl;
+    cout << "Number of keypoints 2 : " << nk2 << " After filter : " << keypoints2.size() <<endl;
 
 /* ===============================================================================================
    Find matches based on descriptors: 
@@ -165,50 +215,16 @@ int main(int argc, char** argv)
 	- filter for symmetry
 	- filter by RANSAC
    =============================================================================================== */
-  matcher.knnMatch(descriptors1,descriptors2,matches1,2);
-  matcher.knnMatch(descriptors2,descriptors1,matches2,2);
-
-  int removed= ratioTest(matches1,ratio);
-  removed= ratioTest(matches2,ratio);
-
-  symmetryTest(matches1,matches2,sym_matches);
-
-  Mat fundamental= ransacTest(sym_matches,keypoints1,keypoints2, matches);
-
-/* ===============================================================================================
-   Only keep "good" keypoints (i.e. those that correspond to good matches
-   =============================================================================================== */
-  vector<KeyPoint> keypt1;
-  vector<KeyPoint> keypt2;
-
-  int count = 0;
-  for (int m = 0; m < matches.size(); m++)
-  {
-	  int i1 = matches[m].queryIdx;
-	  int i2 = matches[m].trainIdx;
-
-	  keypt1.push_back(keypoints1[i1]);
-	  keypt2.push_back(keypoints2[i2]);
-
-	  count++;
+    match_features (features1, features2, matches, ratio);
   }
 
-  cout << "number of remaining matches after homography: " << count << endl;
+  cout << "number of remaining matches after homography: " << matches.size() << endl;
 
 /* ===============================================================================================
    Generate image with keypoints and good matches
    =============================================================================================== */
-  Mat imgkpts1;
-  Mat imgkpts2;
-
-  img1.copyTo(imgkpts1);
-  img2.copyTo(imgkpts2);
-
-  drawKeypoints (img1, keypt1, imgkpts1, Scalar (0, 0, 155), 4);
-  drawKeypoints (img2, keypt2, imgkpts2, Scalar (0, 0, 155), 4);
-
   Mat img_matches;
-  img_matches = DrawMatch (imgkpts1, keypoints1, imgkpts2, keypoints2, matches);
+  img_matches = render_matches (img1, keypoints1, img2, keypoints2, matches);
 
 
 /* ===============================================================================================
@@ -250,6 +266,27 @@ int usage()
     cout << "     " << "=                                 -o  <path to output image file>                              ="  <<  endl;
     cout << "     " << "=                                 -p  <path to param file for SURF>                            ="  <<  endl;
     cout << "     " << "=                                                                                              ="  <<  endl;
+    cout << "     " << "=     or, to draw a hit saved by scanDatabase -sm (no detection or matching):                  ="  <<  endl;
+    cout << "     " << "=                                 -m  <path to .akm match file>                                ="  <<  endl;
+    cout << "     " << "=                                 -n  <rank of the hit to draw, default 0>                     ="  <<  endl;
+    cout << "     " << "=                                 -o  <path to output image file>                              ="  <<  endl;
+    cout << "     " << "=                                                                                              ="  <<  endl;
+    cout << "     " << "=     or, to draw the top hits of a scanDatabase result file at once:                          ="  <<  endl;
+    cout << "     " << "=                                 -j  <path to scanDatabase result file (.json)>               ="  <<  endl;
+    cout << "     " << "=                                 -i1  <path to seed image (default: from the .akm file)>      ="  <<  endl;
+    cout << "     " << "=                                 -o  <path to output directory>                               ="  <<  endl;
+    cout << "     " << "=                                 -top  <number of hits to draw, default 10>                   ="  <<  endl;
+    cout << "     " << "=                                 -k  <path to keypoint files, optional>                       ="  <<  endl;
+    cout << "     " << "=                                 -sheet  <path to contact sheet image, optional>              ="  <<  endl;
+    cout << "     " << "=                                 -t  <number of threads, default: one per core>               ="  <<  endl;
+    cout << "     " << "=                                 -roi  <x,y,w,h: seed region given to scanDatabase -roi>      ="  <<  endl;
+    cout << "     " << "=                                 -mask  <seed polygon file given to scanDatabase -mask>       ="  <<  endl;
+    cout << "     " << "=                                                                                              ="  <<  endl;
+    cout << "     " << "=     with -m or -j, images whose keypoints are stored can be read from their thumbnails:      ="  <<  endl;
+    cout << "     " << "=                                 -th  <path to thumbnails written by processImages -th>       ="  <<  endl;
+    cout << "     " << "=                                 -w  <smallest width of a thumbnail to use, default 800>      ="  <<  endl;
+    cout << "     " << "=                                 -p  <path to param file for SURF>                            ="  <<  endl;
+    cout << "     " << "=                                                                                              ="  <<  endl;
     cout << "     " << "================================================================================================"  <<  endl;
     cout << "     " << "================================================================================================"  <<  endl;
     cout << "\n\n" <<endl;
@@ -265,7 +302,7 @@ int usage()
 /* ===============================================================================================
    Procedure to read in flag values
    =============================================================================================== */
-void read_flags (int argc, char** argv, string *imgfile1, string *imgfile2, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin)
+void read_flags (int argc, char** argv, string *imgfile1, string *imgfile2, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin, string *matchfile, int *rank, string *jsonfile, string *infodir, string *sheetfile, int *top, int *nthreads, string *thumbdir, int *minwidth, string *roi, string *polygonfile)
 {
   string input;
   for(int i = 1; i < argc; i++)
@@ -290,87 +327,39 @@ void read_flags (int argc, char** argv, string *imgfile1, string *imgfile2, stri
       *sizemin = atoi(argv[i+1]);
     if (input == "-r")
       *responsemin = atoi(argv[i+1]);
-  }
-}
-
 
-
-/* ===============================================================================================
-   Procedure to read parameters for SURF
-   =============================================================================================== */
-void read_surfparams(string param, int *minHessian, int *octaves, int *octaveLayers, int *SizeMin, double *RespMin)
-{
-  ifstream inFile;
-  inFile.open(param.c_str());
-	string record;
-	stringstream ss;
-
-	while ( !inFile.eof () ) 
-  {    
-		getline(inFile,record);
-		if (record.find("minHessian") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *minHessian;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("octaves") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *octaves;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("octaveLayers") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *octaveLayers;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("min Size") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *SizeMin;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("min Resp") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *RespMin;
-			ss.str("");
-			ss.clear();
-		}
-	}
-}
-
-/* ===============================================================================================
-   Procedure to filter the keypoints from the keypoint vector by minimum size and response
-   =============================================================================================== */
-void filter_keypoints (vector <KeyPoint> &keypoints, int sizemin, double responsemin)
-{
-  vector <KeyPoint> temp;
-  int npoints = keypoints.size();
-  int size;
-  double response;
-
-  //filter based on size and response size
-  for (int i = 0; i < npoints; i++)
-  {
-    size = keypoints[i].size;
-    response = keypoints[i].response;
-    if (size > sizemin && response > responsemin)
-      temp.push_back(keypoints[i]);
+    if (input == "-m")
+      *matchfile = argv[i + 1];
+    if (input == "-n")
+      *rank = atoi(argv[i+1]);
+
+    if (input == "-j")
+      *jsonfile = argv[i + 1];
+    if (input == "-k")
+      *infodir = argv[i + 1];
+    if (input == "-sheet")
+      *sheetfile = argv[i + 1];
+    if (input == "-top")
+      *top = atoi(argv[i+1]);
+    if (input == "-t")
+      *nthreads = atoi(argv[i+1]);
+    if (input == "-th")
+      *thumbdir = argv[i + 1];
+    if (input == "-w")
+      *minwidth = atoi(argv[i+1]);
+    if (input == "-roi")
+      *roi = argv[i + 1];
+    if (input == "-mask")
+      *polygonfile = argv[i + 1];
   }
-
-  keypoints.clear();
-  keypoints = temp;
-
-  return;
 }
 
 
+
 /* ===============================================================================================
    This function combines multiple images into a single image
    =============================================================================================== */
-Mat DrawMatch(Mat& image1, vector<KeyPoint>& keypoints1, Mat& image2, vector<KeyPoint>& keypoints2, vector<DMatch>& matches1to2)
+Mat DrawMatch(const Mat& image1, const vector<KeyPoint>& keypoints1, const Mat& image2, const vector<KeyPoint>& keypoints2, const vector<DMatch>& matches1to2)
 {
 	Mat NewImage;
 
@@ -447,170 +436,285 @@ Mat DrawMatch(Mat& image1, vector<KeyPoint>& keypoints1, Mat& image2, vector<Key
 	return NewImage;
 }
 
-/* ===============================================================================================
-   This function perform a ratio test: 
-   - Clear matches for which NN ratio is > than threshold
-   - return the number of removed points
-   =============================================================================================== */
-int ratioTest(vector<vector<cv::DMatch> > &matches, double ratio) 
-{
-	int removed=0;
-
-	for (vector<vector<cv::DMatch> >::iterator
-		matchIterator= matches.begin();
-		matchIterator!= matches.end(); ++matchIterator) 
-	{
-    //if 2 NN have been identified
-	  if (matchIterator->size() > 1)
-    {
-    // check distance ratio
-   	 if ((*matchIterator)[0].distance/ (*matchIterator)[1].distance > ratio) 
-     {
-				matchIterator->clear(); // remove match
-				removed++;
-     }
-    } 
-
-    //does not have 2 neighbours, then remove match
-    else 
-    {
-  	  matchIterator->clear(); // remove match
-  	  removed++;
-	  }
-	}
-
-	return removed;
-}
-
 
 
 /* ===============================================================================================
-   This function perform a symmetry test:
-   matches from 1 to 2 should match with matches from 2 to 1
+   Draw the keypoints used by the matches on both images, put them side by side and connect
+   the matching keypoints
    =============================================================================================== */
-void symmetryTest(const vector<vector<DMatch> >& matches1,const vector<vector<DMatch> >& matches2, vector<DMatch>& symMatches) 
+Mat render_matches (const Mat& img1, const vector<KeyPoint>& keypoints1, const Mat& img2, const vector<KeyPoint>& keypoints2, const vector<DMatch>& matches)
 {
-/*    	=========================================================================================
-        for all matches image 1 -> image 2
-       	========================================================================================= */
-	for (vector<vector<cv::DMatch> >:: const_iterator matchIterator1= matches1.begin();
-           matchIterator1!= matches1.end(); ++matchIterator1) 
-	{
-    // ignore deleted matches
-  	if (matchIterator1->size() < 2) continue;
-/*     		=================================================================================
-        	for all matches image 2 -> image 1
-       		================================================================================= */
-		for (std::vector<std::vector<cv::DMatch> >:: const_iterator matchIterator2= matches2.begin();
-		matchIterator2!= matches2.end(); ++matchIterator2) 
-		{
-			// ignore deleted matches
-			if (matchIterator2->size() < 2) continue;
-
-/*     			=========================================================================
-        		Symmetry test
-       			========================================================================= */
-			if ((*matchIterator1)[0].queryIdx == (*matchIterator2)[0].trainIdx &&
-			(*matchIterator2)[0].queryIdx == (*matchIterator1)[0].trainIdx) 
-			{
-				symMatches.push_back(cv::DMatch((*matchIterator1)[0].queryIdx,
-				(*matchIterator1)[0].trainIdx,(*matchIterator1)[0].distance));
-
-				break; // next match in image 1 -> image 2
-			}
-		}
-	}
-}
-
-
-
 /* ===============================================================================================
-   Identify good matches using RANSAC; return fundamental matrix
+   Only keep "good" keypoints (i.e. those that correspond to good matches
    =============================================================================================== */
-Mat ransacTest(const vector<cv::DMatch>& matches,const vector<cv::KeyPoint>& keypoints1, const vector<cv::KeyPoint>& keypoints2, vector<cv::DMatch>& outMatches) 
-{
-
-/*     	=========================================================================================
-        Convert keypoints1 and keypoints2 into Point2f
-       	========================================================================================= */
-
-	vector<cv::Point2f> points1, points2;
-
-	Mat fundemental;
+  vector<KeyPoint> keypt1;
+  vector<KeyPoint> keypt2;
 
-	for (vector<cv::DMatch>::const_iterator it= matches.begin();it!= matches.end(); ++it) 
-	{
+  for (int m = 0; m < matches.size(); m++)
+  {
+	  keypt1.push_back(keypoints1[matches[m].queryIdx]);
+	  keypt2.push_back(keypoints2[matches[m].trainIdx]);
+  }
 
-		double x= keypoints1[it->queryIdx].pt.x;
-		double y= keypoints1[it->queryIdx].pt.y;
-		points1.push_back(Point2f(x,y));
+  Mat imgkpts1;
+  Mat imgkpts2;
 
-		x= keypoints2[it->trainIdx].pt.x;
-		y= keypoints2[it->trainIdx].pt.y;
-		points2.push_back(cv::Point2f(x,y));
-	}
+  img1.copyTo(imgkpts1);
+  img2.copyTo(imgkpts2);
 
-/*     	=========================================================================================
-        Compute fundamental matrix using RANSAC
-       	========================================================================================= */
+  drawKeypoints (img1, keypt1, imgkpts1, Scalar (0, 0, 155), 4);
+  drawKeypoints (img2, keypt2, imgkpts2, Scalar (0, 0, 155), 4);
 
-	vector<uchar> inliers(points1.size(),0);
+  return DrawMatch (imgkpts1, keypoints1, imgkpts2, keypoints2, matches);
+}
 
-	double confidence = 0.99;
-	double distance = 3.0;
-	int refineF = 1;
 
-	if (points1.size()>0&&points2.size()>0)
-	{
 
-		Mat fundemental= cv::findFundamentalMat(
-                        cv::Mat(points1),cv::Mat(points2), // matching points
-                        inliers,       // match status (inlier or outlier)
-                        CV_FM_RANSAC, // RANSAC method
-                        distance,      // distance to epipolar line
-                        confidence); // confidence probability
+/* ===============================================================================================
+   Batch mode: one hit of the result file to draw. When scanDatabase saved the matches of the
+   hit (-sm), "saved" points to them and nothing is matched again.
+   =============================================================================================== */
+struct Hit
+{
+  int rank;
+  string name;
+  string image;
+  string featurefile;
+  double distance;
+  const MatchRecord *saved;
+  int nmatches;
+  int status;            // 0 if drawn
+};
+
+const int SHEET_CELL_WIDTH = 800;          // width of a pair image on the contact sheet
+
+class RenderBody : public ParallelLoopBody
+{
+public:
+  RenderBody (const Mat &i, int sf, const Features &f, const vector<KeyPoint> &k, const FeatureExtractor &e, double r, string o, string t, int w, bool s, vector<Hit> &h, vector<Mat> &c)
+    : seedimage (i), seedfactor (sf), seed (f), savedKeypoints (k), extractor (e), ratio (r), outdir (o), thumbdir (t), minwidth (w), sheet (s), hits (h), cells (c) {}
 
-		// extract the surviving (inliers) matches
+  void operator() (const Range &range) const
+  {
+    Features features;
+    vector<DMatch> matches;
+    for (int i = range.start; i < range.end; i++)
+    {
+      Hit &hit = hits[i];
+      hit.status = -1;
+
+      // keypoints of the hit: from its keypoint file when there is one, extracted otherwise
+      vector<KeyPoint> keypoints1 = seed.keypoints;
+      bool stored;
+      if (hit.saved != NULL)
+      {
+        if (read_features (hit.featurefile, features, FIELDS_KEYPOINTS) != 0)
+          continue;
+        matches = hit.saved->matches;
+        keypoints1 = savedKeypoints;
+        stored = true;
+      }
+      else
+        stored = hit.featurefile != "" && read_features (hit.featurefile, features) == 0;
+
+      // only images whose keypoints are stored can be drawn from a thumbnail
+      Mat image;
+      int factor = 1;
+      if (stored)
+        factor = load_image (hit.image, thumbdir, minwidth, image);
+      else
+        image = imread (hit.image);
+      if (image.empty())
+        continue;
+
+      if (hit.saved == NULL)
+      {
+        if (!stored)
+          extractor.extract (image, features);
+        match_features (seed, features, matches, ratio);
+      }
+
+      vector<KeyPoint> keypoints2 = features.keypoints;
+      scale_keypoints (keypoints1, 1.0/seedfactor);
+      scale_keypoints (keypoints2, 1.0/factor);
+      Mat pair = render_matches (seedimage, keypoints1, image, keypoints2, matches);
+
+      ostringstream name;
+      name << outdir << setw (3) << setfill ('0') << hit.rank << "_" << hit.name << ".jpg";
+      if (!imwrite (name.str(), pair))
+        continue;
+
+      // only a reduced copy is kept for the contact sheet
+      if (sheet)
+      {
+        double scale = min (1.0, (double) SHEET_CELL_WIDTH/pair.cols);
+        resize (pair, cells[i], Size(), scale, scale, INTER_AREA);
+      }
+
+      hit.nmatches = matches.size();
+      hit.status = 0;
+    }
+  }
 
-		vector<uchar>::const_iterator itIn= inliers.begin();
-		vector<cv::DMatch>::const_iterator itM= matches.begin();
+private:
+  const Mat &seedimage;
+  int seedfactor;
+  const Features &seed;
+  const vector<KeyPoint> &savedKeypoints;
+  const FeatureExtractor &extractor;
+  double ratio;
+  string outdir;
+  string thumbdir;
+  int minwidth;
+  bool sheet;
+  vector<Hit> &hits;
+  vector<Mat> &cells;
+};
 
-		for ( ;itIn!= inliers.end(); ++itIn, ++itM) 
-		{
-			if (*itIn) { // it is a valid match
-				outMatches.push_back(*itM);
-			}
-		}
+/* ===============================================================================================
+   Draw the top hits of a scanDatabase result file in one process: the seed image is read (and
+   its features extracted) once, the pairs are drawn in parallel into "outdir", named after
+   their rank and image, and optionally combined into a contact sheet.
+   =============================================================================================== */
+int draw_results (string jsonfile, string seedfile, string infodir, string outdir, string sheetfile, int top, int nthreads, string thumbdir, int minwidth, const FeatureExtractor &extractor, double ratio, string roi, string polygonfile)
+{
+  ResultSet resultset;
+  if (read_results (jsonfile, resultset) != 0 || resultset.shard >= 0)
+  {
+    cerr << "could not read result file (partial results must be merged first): " << jsonfile << endl;
+    return -1;
+  }
+  if (outdir != "" && *outdir.rbegin() != '/')
+    outdir.append ("/");
 
-		if (refineF) {
-			// The F matrix will be recomputed with all accepted matches
-			// Convert keypoints into Point2f for final F computation
+/* ===============================================================================================
+   The image (and keypoint) files of the hits come from the corpus the scan was run on
+   =============================================================================================== */
+  Corpus corpus;
+  corpus.open (resultset.path, infodir);
+  string imgdir = corpus.directory();
+  if (imgdir != "" && *imgdir.rbegin() != '/')
+    imgdir.append ("/");
 
-			points1.clear();
-			points2.clear();
+  unordered_map<string,int> index;
+  for (int i = 0; i < corpus.size(); i++)
+    index[corpus.name (i)] = i;
 
-			for (std::vector<cv::DMatch>::const_iterator it= outMatches.begin();it!= outMatches.end(); ++it) 
-			{
-				double x= keypoints1[it->queryIdx].pt.x;
-				double y= keypoints1[it->queryIdx].pt.y;
-				points1.push_back(cv::Point2f(x,y));
+/* ===============================================================================================
+   Matches saved by scanDatabase -sm next to the result file, if any
+   =============================================================================================== */
+  MatchFile saved;
+  bool havesaved = read_matchfile (jsonfile + ".akm", saved) == 0;
+  unordered_map<string,const MatchRecord*> savedhits;
+  if (havesaved)
+  {
+    for (int h = 0; h < saved.hits.size(); h++)
+      savedhits[saved.hits[h].image] = &saved.hits[h];
+    if (seedfile == "")
+      seedfile = saved.seed;
+  }
+  if (seedfile == "")
+  {
+    cerr << "no seed image: give it with -i1" << endl;
+    return -1;
+  }
 
-				x= keypoints2[it->trainIdx].pt.x;
-				y= keypoints2[it->trainIdx].pt.y;
-				points2.push_back(cv::Point2f(x,y));
-			}
+  vector<Hit> hits;
+  bool extractseed = false;
+  for (int r = 0; r < resultset.results.size() && hits.size() < top; r++)
+  {
+    unordered_map<string,int>::const_iterator found = index.find (resultset.results[r].name);
+    if (found == index.end())
+    {
+      cerr << "image not found in " << imgdir << ": " << resultset.results[r].name << endl;
+      continue;
+    }
+
+    Hit hit;
+    hit.rank = r;
+    hit.name = resultset.results[r].name;
+    hit.image = imgdir + corpus.filename (found->second);
+    hit.featurefile = infodir != "" ? corpus.featurefile (found->second) : "";
+    hit.distance = resultset.results[r].distance;
+    hit.nmatches = 0;
+    hit.status = -1;
+
+    unordered_map<string,const MatchRecord*>::const_iterator s = savedhits.find (hit.image);
+    hit.saved = s != savedhits.end() ? s->second : NULL;
+    if (hit.saved != NULL && hit.featurefile == "")
+      hit.featurefile = s->second->featurefile;
+    if (hit.saved == NULL)
+      extractseed = true;
+    hits.push_back (hit);
+  }
 
-			// Compute 8-point F from all accepted matches
+/* ===============================================================================================
+   The seed: read once (drawn from its thumbnail if there is one), features extracted once
+   from the original, only if some hit has no saved matches
+   =============================================================================================== */
+  int64 t0 = getTickCount();
+  Mat seedimage;
+  int seedfactor = load_image (seedfile, thumbdir, minwidth, seedimage);
+  if (seedimage.empty())
+  {
+    cerr << "could not read seed image: " << seedfile << endl;
+    return -1;
+  }
 
-			if (points1.size()>0&&points2.size()>0){
+  // restricted to the region of the scan (-roi / -mask), so that the matches drawn are those
+  // that scanDatabase counted
+  Features seed;
+  if (extractseed)
+  {
+    Mat original = seedfactor == 1 ? seedimage : imread (seedfile);
+    Mat mask;
+    if (seed_mask (original.size(), roi, polygonfile, mask) != 0)
+    {
+      cerr << "Region should be given as x,y,w,h, polygons as one x y vertex per line (at least 3)" << endl;
+      return -1;
+    }
+    extractor.extract (original, seed, mask);
+  }
 
-				fundemental= cv::findFundamentalMat(cv::Mat(points1),cv::Mat(points2), // matches
-						CV_FM_8POINT); // 8-point method
+  vector<Mat> cells (hits.size());
+  run_parallel (Range (0, hits.size()), RenderBody (seedimage, seedfactor, seed, saved.seedKeypoints, extractor, ratio, outdir, thumbdir, minwidth, sheetfile != "", hits, cells), nthreads);
+  double seconds = (getTickCount() - t0)/getTickFrequency();
 
-			}
-		}
-	}
+  int drawn = 0;
+  for (int h = 0; h < hits.size(); h++)
+  {
+    if (hits[h].status != 0)
+    {
+      cerr << "could not draw " << hits[h].image << endl;
+      continue;
+    }
+    cout << setw (3) << hits[h].rank << "  " << hits[h].name << "  distance " << hits[h].distance << "  matches " << hits[h].nmatches << (hits[h].saved ? " (saved)" : "") << endl;
+    drawn++;
+  }
+  cout << "Drew " << drawn << " of " << hits.size() << " hits in " << seconds << " s" << endl;
 
-	return fundemental;
+/* ===============================================================================================
+   Contact sheet: the pair images two per row, with rank, name and distance above each
+   =============================================================================================== */
+  if (sheetfile != "")
+  {
+    vector<Mat> images;
+    vector<string> titles;
+    for (int h = 0; h < hits.size(); h++)
+    {
+      if (hits[h].status != 0)
+        continue;
+      ostringstream title;
+      title << hits[h].rank << ": " << hits[h].name << " (" << hits[h].distance << ")";
+      images.push_back (cells[h]);
+      titles.push_back (title.str());
+    }
+    if (images.size() > 0 && !imwrite (sheetfile, combine_images (images, titles, 2)))
+    {
+      cerr << "could not write contact sheet: " << sheetfile << endl;
+      return -1;
+    }
+  }
 
+  return drawn == hits.size() ? 0 : -1;
 }
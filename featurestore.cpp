@@ -0,0 +1,777 @@
+/* ============================================================================================
+  featurestore.cpp                 Version 1           Last Update: 10/19/2026
+
+  Implementation of the binary feature files (.akf): section table, byte shuffling of the
+  blocks and their compression with LZ4 or zstd. The codecs are compiled in with
+  -DARCHV_WITH_LZ4 and -DARCHV_WITH_ZSTD (see the Makefile).
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include "featurestore.hpp"
+
+#include <fstream>
+#include <iterator>
+#include <cstring>
+
+#ifdef ARCHV_WITH_LZ4
+#include <lz4.h>
+#endif
+#ifdef ARCHV_WITH_ZSTD
+#include <zstd.h>
+#endif
+
+using namespace cv;
+using namespace std;
+
+namespace archv
+{
+
+static const char MAGIC[4] = { 'A', 'K', 'F', '1' };
+static const unsigned VERSION = 2;           // 1: keypoints in a single block
+static const int HEADER_SIZE = 16;
+static const int ENTRY_SIZE = 48;
+static const int KEYPOINT_FIELDS = 7;
+
+/* ===============================================================================================
+   One entry of the section table
+   =============================================================================================== */
+struct Section
+{
+  unsigned id;
+  int codec;
+  int shuffle;
+  unsigned rows, cols;
+  int type;
+  uint64 offset, rawsize, storedsize;
+};
+
+/* ===============================================================================================
+   Little endian encoding / decoding of integers
+   =============================================================================================== */
+static void put_uint (vector<uchar> &buf, uint64 value, int nbytes)
+{
+  for (int i = 0; i < nbytes; i++)
+    buf.push_back ((value >> (8*i)) & 0xff);
+}
+
+static uint64 get_uint (const uchar *buf, int nbytes)
+{
+  uint64 value = 0;
+  for (int i = 0; i < nbytes; i++)
+    value |= (uint64) buf[i] << (8*i);
+  return value;
+}
+
+/* ===============================================================================================
+   Codec names, as given on the command line
+   =============================================================================================== */
+int parse_codec (string name)
+{
+  if (name == "none")
+    return CODEC_NONE;
+  if (name == "lz4")
+    return CODEC_LZ4;
+  if (name == "zstd")
+    return CODEC_ZSTD;
+  return -1;
+}
+
+string codec_name (int codec)
+{
+  if (codec == CODEC_LZ4)
+    return "lz4";
+  if (codec == CODEC_ZSTD)
+    return "zstd";
+  return "none";
+}
+
+bool codec_available (int codec)
+{
+  if (codec == CODEC_NONE)
+    return true;
+#ifdef ARCHV_WITH_LZ4
+  if (codec == CODEC_LZ4)
+    return true;
+#endif
+#ifdef ARCHV_WITH_ZSTD
+  if (codec == CODEC_ZSTD)
+    return true;
+#endif
+  return false;
+}
+
+StoreOptions::StoreOptions ()
+  : codec (CODEC_NONE), level (3), shuffle (true)
+{
+}
+
+StoreStats::StoreStats ()
+  : rawBytes (0), storedBytes (0), seconds (0)
+{
+}
+
+/* ===============================================================================================
+   Byte shuffling: byte j of every element is grouped in plane j. The high bytes (sign and
+   exponent) of neighbouring floats are similar, which makes the block much more compressible.
+   =============================================================================================== */
+static void shuffle_bytes (const uchar *in, uchar *out, size_t size, int elemsize)
+{
+  size_t nelem = size/elemsize;
+  for (int j = 0; j < elemsize; j++)
+  {
+    uchar *plane = out + j*nelem;
+    for (size_t e = 0; e < nelem; e++)
+      plane[e] = in[e*elemsize + j];
+  }
+  memcpy (out + nelem*elemsize, in + nelem*elemsize, size - nelem*elemsize);
+}
+
+static void unshuffle_bytes (const uchar *in, uchar *out, size_t size, int elemsize)
+{
+  size_t nelem = size/elemsize;
+  for (int j = 0; j < elemsize; j++)
+  {
+    const uchar *plane = in + j*nelem;
+    for (size_t e = 0; e < nelem; e++)
+      out[e*elemsize + j] = plane[e];
+  }
+  memcpy (out + nelem*elemsize, in + nelem*elemsize, size - nelem*elemsize);
+}
+
+#ifdef ARCHV_WITH_ZSTD
+/* ===============================================================================================
+   zstd contexts are reused by all the blocks handled by a thread
+   =============================================================================================== */
+struct ZstdContexts
+{
+  ZSTD_CCtx *cctx;
+  ZSTD_DCtx *dctx;
+  ZstdContexts () : cctx (ZSTD_createCCtx()), dctx (ZSTD_createDCtx()) {}
+  ~ZstdContexts () { ZSTD_freeCCtx (cctx); ZSTD_freeDCtx (dctx); }
+};
+
+static thread_local ZstdContexts zstd;
+#endif
+
+/* ===============================================================================================
+   Encode a block: shuffle (if requested and the elements are wider than a byte), then
+   compress. Returns 0, or -1 if the codec is not available.
+   =============================================================================================== */
+int encode_block (const uchar *data, size_t size, int elemsize, const StoreOptions &options, vector<uchar> &stored, vector<uchar> &scratch)
+{
+  if (!codec_available (options.codec))
+    return -1;
+
+  const uchar *src = data;
+  if (options.shuffle && elemsize > 1)
+  {
+    scratch.resize (size);
+    shuffle_bytes (data, &scratch[0], size, elemsize);
+    src = &scratch[0];
+  }
+
+  if (options.codec == CODEC_NONE || size == 0)
+  {
+    stored.assign (src, src + size);
+    return 0;
+  }
+
+#ifdef ARCHV_WITH_LZ4
+  if (options.codec == CODEC_LZ4)
+  {
+    stored.resize (LZ4_compressBound (size));
+    int n = LZ4_compress_default ((const char *) src, (char *) &stored[0], size, stored.size());
+    if (n <= 0)
+      return -1;
+    stored.resize (n);
+    return 0;
+  }
+#endif
+
+#ifdef ARCHV_WITH_ZSTD
+  if (options.codec == CODEC_ZSTD)
+  {
+    stored.resize (ZSTD_compressBound (size));
+    size_t n = ZSTD_compressCCtx (zstd.cctx, &stored[0], stored.size(), src, size, options.level);
+    if (ZSTD_isError (n))
+      return -1;
+    stored.resize (n);
+    return 0;
+  }
+#endif
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Decode a block into "out" (which must hold rawsize bytes): decompress, then unshuffle if the
+   block was shuffled ("elemsize" > 0). Returns 0, or -1 if the block is corrupted or the codec
+   is not available.
+   =============================================================================================== */
+int decode_block (const uchar *stored, size_t storedsize, int codec, int elemsize, uchar *out, size_t rawsize, vector<uchar> &scratch)
+{
+  if (!codec_available (codec))
+    return -1;
+  if (rawsize == 0)
+    return 0;
+
+  bool shuffled = elemsize > 1;
+  uchar *dst = out;
+  if (shuffled)
+  {
+    scratch.resize (rawsize);
+    dst = &scratch[0];
+  }
+
+  if (codec == CODEC_NONE)
+  {
+    if (storedsize != rawsize)
+      return -1;
+    memcpy (dst, stored, rawsize);
+  }
+
+#ifdef ARCHV_WITH_LZ4
+  if (codec == CODEC_LZ4)
+  {
+    int n = LZ4_decompress_safe ((const char *) stored, (char *) dst, storedsize, rawsize);
+    if (n < 0 || (size_t) n != rawsize)
+      return -1;
+  }
+#endif
+
+#ifdef ARCHV_WITH_ZSTD
+  if (codec == CODEC_ZSTD)
+  {
+    size_t n = ZSTD_decompressDCtx (zstd.dctx, dst, rawsize, stored, storedsize);
+    if (ZSTD_isError (n) || n != rawsize)
+      return -1;
+  }
+#endif
+
+  if (shuffled)
+    unshuffle_bytes (dst, out, rawsize, elemsize);
+  return 0;
+}
+
+/* ===============================================================================================
+   A binary feature file is recognised by its extension
+   =============================================================================================== */
+bool is_binary_featurefile (string filename)
+{
+  return filename.size() > 4 && filename.substr (filename.size() - 4) == ".akf";
+}
+
+/* ===============================================================================================
+   Write the keypoints and descriptors of an image in a binary feature file. Keypoints are
+   written by columns: points (x, y), shape (size, angle) and detection (response, octave,
+   class_id), so that a reader can load only the columns it needs. Features that only hold
+   columns are written as such.
+   =============================================================================================== */
+int write_binary_features (string filename, const Features &features, const StoreOptions &options, StoreStats *stats)
+{
+  int64 t0 = getTickCount();
+
+  Mat points, shape, detection;
+  if (features.keypoints.size() > 0)
+  {
+    int npoints = features.keypoints.size();
+    points.create (npoints, 1, CV_32FC2);
+    shape.create (npoints, 1, CV_32FC2);
+    detection.create (npoints, 3, CV_32F);
+    for (int i = 0; i < npoints; i++)
+    {
+      const KeyPoint &kp = features.keypoints[i];
+      points.at<Point2f>(i) = kp.pt;
+      shape.at<Point2f>(i) = Point2f (kp.size, kp.angle);
+      float *row = detection.ptr<float>(i);
+      row[0] = kp.response;
+      row[1] = kp.octave;
+      row[2] = kp.class_id;
+    }
+  }
+  else
+  {
+    points = features.points;
+    shape = features.shape;
+  }
+
+  Mat descriptors = features.descriptors;
+  if (!descriptors.empty() && !descriptors.isContinuous())
+    descriptors = descriptors.clone();
+
+  // sections: the points are always written (possibly empty), the others when present
+  const Mat *blocks[4] = { &points, &shape, &detection, &descriptors };
+  unsigned ids[4] = { SECTION_POINTS, SECTION_SHAPE, SECTION_DETECTION, SECTION_DESCRIPTORS };
+  int which[4];
+  int nsections = 0;
+  for (int b = 0; b < 4; b++)
+    if (b == 0 || !blocks[b]->empty())
+      which[nsections++] = b;
+
+  // encode the blocks
+  vector<uchar> stored[4];
+  vector<uchar> scratch;
+  Section sections[4];
+  uint64 offset = HEADER_SIZE + nsections*ENTRY_SIZE;
+
+  for (int s = 0; s < nsections; s++)
+  {
+    const Mat &m = *blocks[which[s]];
+    size_t size = m.total()*m.elemSize();
+    int elemsize = m.elemSize1();
+    if (encode_block (m.data, size, elemsize, options, stored[s], scratch) != 0)
+      return -1;
+
+    sections[s].id = ids[which[s]];
+    sections[s].codec = options.codec;
+    sections[s].shuffle = (options.shuffle && elemsize > 1) ? elemsize : 0;
+    sections[s].rows = m.rows;
+    sections[s].cols = m.cols;
+    sections[s].type = m.type();
+    sections[s].offset = offset;
+    sections[s].rawsize = size;
+    sections[s].storedsize = stored[s].size();
+    offset += stored[s].size();
+
+    if (stats)
+    {
+      stats->rawBytes += size;
+      stats->storedBytes += stored[s].size();
+    }
+  }
+
+  // header and section table
+  vector<uchar> header (MAGIC, MAGIC + 4);
+  put_uint (header, VERSION, 4);
+  put_uint (header, nsections, 4);
+  put_uint (header, 0, 4);
+  for (int s = 0; s < nsections; s++)
+  {
+    put_uint (header, sections[s].id, 4);
+    put_uint (header, sections[s].codec, 1);
+    put_uint (header, sections[s].shuffle, 1);
+    put_uint (header, 0, 2);
+    put_uint (header, sections[s].rows, 4);
+    put_uint (header, sections[s].cols, 4);
+    put_uint (header, (unsigned) sections[s].type, 4);
+    put_uint (header, 0, 4);
+    put_uint (header, sections[s].offset, 8);
+    put_uint (header, sections[s].rawsize, 8);
+    put_uint (header, sections[s].storedsize, 8);
+  }
+
+  ofstream out (filename.c_str(), ios::binary);
+  if (!out.is_open())
+    return -1;
+  out.write ((const char *) &header[0], header.size());
+  for (int s = 0; s < nsections; s++)
+    if (stored[s].size() > 0)
+      out.write ((const char *) &stored[s][0], stored[s].size());
+  out.close();
+
+  if (stats)
+    stats->seconds += (getTickCount() - t0)/getTickFrequency();
+  return out.fail() ? -1 : 0;
+}
+
+/* ===============================================================================================
+   Read the section table of a binary feature file
+   =============================================================================================== */
+static int read_sections (ifstream &in, vector<Section> &sections)
+{
+  uchar header[HEADER_SIZE];
+  in.read ((char *) header, HEADER_SIZE);
+  if (!in || memcmp (header, MAGIC, 4) != 0 || get_uint (header + 4, 4) > VERSION)
+    return -1;
+
+  int nsections = get_uint (header + 8, 4);
+  vector<uchar> table (nsections*ENTRY_SIZE + 1);
+  in.read ((char *) &table[0], nsections*ENTRY_SIZE);
+  if (!in)
+    return -1;
+
+  sections.resize (nsections);
+  for (int s = 0; s < nsections; s++)
+  {
+    const uchar *e = &table[s*ENTRY_SIZE];
+    sections[s].id = get_uint (e, 4);
+    sections[s].codec = e[4];
+    sections[s].shuffle = e[5];
+    sections[s].rows = get_uint (e + 8, 4);
+    sections[s].cols = get_uint (e + 12, 4);
+    sections[s].type = (int) get_uint (e + 16, 4);
+    sections[s].offset = get_uint (e + 24, 8);
+    sections[s].rawsize = get_uint (e + 32, 8);
+    sections[s].storedsize = get_uint (e + 40, 8);
+  }
+  return 0;
+}
+
+/* ===============================================================================================
+   Read and decode one section into a matrix; the matrix keeps its memory if it already has
+   the right size and type, and the scratch buffers are kept from one call to the next
+   =============================================================================================== */
+static int read_section (ifstream &in, const Section &section, Mat &m, StoreStats *stats)
+{
+  static thread_local vector<uchar> stored, scratch;
+
+  m.create (section.rows, section.cols, section.type);
+  if (m.total()*m.elemSize() != section.rawsize)
+    return -1;
+
+  stored.resize (section.storedsize + 1);
+  in.seekg (section.offset);
+  in.read ((char *) &stored[0], section.storedsize);
+  if (!in)
+    return -1;
+
+  if (stats)
+  {
+    stats->rawBytes += section.rawsize;
+    stats->storedBytes += section.storedsize;
+  }
+  return decode_block (&stored[0], section.storedsize, section.codec, section.shuffle, m.data, section.rawsize, scratch);
+}
+
+/* ===============================================================================================
+   Read the keypoints and descriptors of an image from a binary feature file; only the
+   sections holding the requested fields are read (see read_features in archv.hpp)
+   =============================================================================================== */
+int read_binary_features (string filename, Features &features, StoreStats *stats, int fields)
+{
+  int64 t0 = getTickCount();
+  static thread_local Mat keypoints, points, shape, detection;
+
+  bool full = (fields & FIELDS_KEYPOINTS) == FIELDS_KEYPOINTS;
+  features.keypoints.clear();
+
+  ifstream in (filename.c_str(), ios::binary);
+  if (!in.is_open())
+    return -1;
+
+  vector<Section> sections;
+  if (read_sections (in, sections) != 0)
+    return -1;
+
+  // columns are decoded straight into the features, unless full keypoints are rebuilt from them
+  Mat &pointcol = full ? points : features.points;
+  Mat &shapecol = full ? shape : features.shape;
+  bool haspoints = false, hasshape = false, hasdetection = false, hasdescriptors = false;
+
+  for (int s = 0; s < sections.size(); s++)
+  {
+    unsigned id = sections[s].id;
+    if (id == SECTION_KEYPOINTS)
+    {
+      // version 1 files: all the keypoint fields in one block, split into columns here
+      if (read_section (in, sections[s], keypoints, stats) != 0 || keypoints.cols != KEYPOINT_FIELDS)
+        return -1;
+      pointcol.create (keypoints.rows, 1, CV_32FC2);
+      shapecol.create (keypoints.rows, 1, CV_32FC2);
+      detection.create (keypoints.rows, 3, CV_32F);
+      for (int i = 0; i < keypoints.rows; i++)
+      {
+        const float *row = keypoints.ptr<float>(i);
+        pointcol.at<Point2f>(i) = Point2f (row[0], row[1]);
+        shapecol.at<Point2f>(i) = Point2f (row[2], row[3]);
+        float *det = detection.ptr<float>(i);
+        det[0] = row[4]; det[1] = row[5]; det[2] = row[6];
+      }
+      haspoints = hasshape = hasdetection = true;
+    }
+    if (id == SECTION_POINTS && (fields & FIELD_POINTS))
+    {
+      if (read_section (in, sections[s], pointcol, stats) != 0)
+        return -1;
+      haspoints = true;
+    }
+    if (id == SECTION_SHAPE && (fields & FIELD_SHAPE))
+    {
+      if (read_section (in, sections[s], shapecol, stats) != 0)
+        return -1;
+      hasshape = true;
+    }
+    if (id == SECTION_DETECTION && full)
+    {
+      if (read_section (in, sections[s], detection, stats) != 0)
+        return -1;
+      hasdetection = true;
+    }
+    if (id == SECTION_DESCRIPTORS && (fields & FIELD_DESCRIPTORS))
+    {
+      if (read_section (in, sections[s], features.descriptors, stats) != 0)
+        return -1;
+      hasdescriptors = true;
+    }
+  }
+
+  if (full)
+  {
+    // rebuild the keypoints; files written from columns only have no shape / detection
+    int npoints = haspoints ? points.rows : 0;
+    features.keypoints.resize (npoints);
+    for (int i = 0; i < npoints; i++)
+    {
+      KeyPoint &kp = features.keypoints[i];
+      kp = KeyPoint();
+      kp.pt = points.at<Point2f>(i);
+      if (hasshape && shape.rows == npoints)
+      {
+        kp.size = shape.at<Point2f>(i).x;
+        kp.angle = shape.at<Point2f>(i).y;
+      }
+      if (hasdetection && detection.rows == npoints)
+      {
+        const float *det = detection.ptr<float>(i);
+        kp.response = det[0];
+        kp.octave = (int) det[1];
+        kp.class_id = (int) det[2];
+      }
+    }
+    features.points.release();
+    features.shape.release();
+  }
+  else
+  {
+    if (!haspoints || !(fields & FIELD_POINTS))
+      features.points.release();
+    if (!hasshape || !(fields & FIELD_SHAPE))
+      features.shape.release();
+  }
+  if (!hasdescriptors)
+    features.descriptors.release();
+
+  if (stats)
+    stats->seconds += (getTickCount() - t0)/getTickFrequency();
+  return 0;
+}
+
+/* ===============================================================================================
+   Bit exact comparison of two sets of features; floats are compared by their bytes, so that
+   -0 / 0 and NaN payloads count as differences
+   =============================================================================================== */
+static bool same_float (float a, float b)
+{
+  return memcmp (&a, &b, sizeof(float)) == 0;
+}
+
+static bool same_mat (const Mat &a, const Mat &b)
+{
+  if (a.empty() || b.empty())
+    return a.empty() == b.empty();
+  if (a.type() != b.type() || a.rows != b.rows || a.cols != b.cols)
+    return false;
+
+  size_t rowbytes = a.cols*a.elemSize();
+  for (int r = 0; r < a.rows; r++)
+    if (memcmp (a.ptr(r), b.ptr(r), rowbytes) != 0)
+      return false;
+  return true;
+}
+
+bool same_features (const Features &a, const Features &b)
+{
+  if (a.keypoints.size() != b.keypoints.size())
+    return false;
+  for (int i = 0; i < a.keypoints.size(); i++)
+  {
+    const KeyPoint &p = a.keypoints[i];
+    const KeyPoint &q = b.keypoints[i];
+    if (!same_float (p.pt.x, q.pt.x) || !same_float (p.pt.y, q.pt.y) || !same_float (p.size, q.size) ||
+        !same_float (p.angle, q.angle) || !same_float (p.response, q.response) ||
+        p.octave != q.octave || p.class_id != q.class_id)
+      return false;
+  }
+
+  return same_mat (a.points, b.points) && same_mat (a.shape, b.shape) && same_mat (a.descriptors, b.descriptors);
+}
+
+/* ===============================================================================================
+   Match sidecar files
+   =============================================================================================== */
+static const char MATCH_MAGIC[4] = { 'A', 'K', 'M', '1' };
+
+static void put_float (vector<uchar> &buf, float value)
+{
+  unsigned bits;
+  memcpy (&bits, &value, sizeof(float));
+  put_uint (buf, bits, 4);
+}
+
+static void put_string (vector<uchar> &buf, const string &text)
+{
+  put_uint (buf, text.size(), 4);
+  buf.insert (buf.end(), text.begin(), text.end());
+}
+
+/* ===============================================================================================
+   Sequential reader over the bytes of a sidecar; every read is bounds checked and sets "bad"
+   instead of reading past the end
+   =============================================================================================== */
+struct ByteReader
+{
+  const vector<uchar> &buf;
+  size_t pos;
+  bool bad;
+
+  ByteReader (const vector<uchar> &b) : buf (b), pos (0), bad (false) {}
+
+  uint64 uint (int nbytes)
+  {
+    if (bad || pos + nbytes > buf.size())
+    {
+      bad = true;
+      return 0;
+    }
+    uint64 value = get_uint (&buf[pos], nbytes);
+    pos += nbytes;
+    return value;
+  }
+
+  float real ()
+  {
+    unsigned bits = uint (4);
+    float value;
+    memcpy (&value, &bits, sizeof(float));
+    return value;
+  }
+
+  string text ()
+  {
+    size_t n = uint (4);
+    if (bad || pos + n > buf.size())
+    {
+      bad = true;
+      return "";
+    }
+    string value (buf.begin() + pos, buf.begin() + pos + n);
+    pos += n;
+    return value;
+  }
+};
+
+int write_matchfile (string filename, const MatchFile &matchfile)
+{
+  vector<uchar> buf (MATCH_MAGIC, MATCH_MAGIC + 4);
+  put_uint (buf, 1, 4);
+  put_string (buf, matchfile.seed);
+
+  put_uint (buf, matchfile.seedKeypoints.size(), 4);
+  for (int i = 0; i < matchfile.seedKeypoints.size(); i++)
+  {
+    const KeyPoint &kp = matchfile.seedKeypoints[i];
+    put_float (buf, kp.pt.x);
+    put_float (buf, kp.pt.y);
+    put_float (buf, kp.size);
+    put_float (buf, kp.angle);
+    put_float (buf, kp.response);
+    put_float (buf, kp.octave);
+    put_float (buf, kp.class_id);
+  }
+
+  put_uint (buf, matchfile.hits.size(), 4);
+  for (int h = 0; h < matchfile.hits.size(); h++)
+  {
+    const MatchRecord &hit = matchfile.hits[h];
+    put_string (buf, hit.image);
+    put_string (buf, hit.featurefile);
+    put_float (buf, hit.distance);
+    put_uint (buf, hit.matches.size(), 4);
+    for (int m = 0; m < hit.matches.size(); m++)
+    {
+      put_uint (buf, hit.matches[m].queryIdx, 4);
+      put_uint (buf, hit.matches[m].trainIdx, 4);
+      put_float (buf, hit.matches[m].distance);
+    }
+  }
+
+  ofstream out (filename.c_str(), ios::binary);
+  if (!out.is_open())
+    return -1;
+  out.write ((const char *) &buf[0], buf.size());
+  out.close();
+  return out.fail() ? -1 : 0;
+}
+
+int read_matchfile (string filename, MatchFile &matchfile)
+{
+  ifstream in (filename.c_str(), ios::binary);
+  if (!in.is_open())
+    return -1;
+  vector<uchar> buf ((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+
+  ByteReader reader (buf);
+  if (buf.size() < 8 || memcmp (&buf[0], MATCH_MAGIC, 4) != 0)
+    return -1;
+  reader.pos = 4;
+  if (reader.uint (4) != 1)
+    return -1;
+  matchfile.seed = reader.text();
+
+  size_t nkeypoints = reader.uint (4);
+  matchfile.seedKeypoints.clear();
+  for (size_t i = 0; i < nkeypoints && !reader.bad; i++)
+  {
+    float x = reader.real(), y = reader.real(), size = reader.real(), angle = reader.real();
+    float response = reader.real(), octave = reader.real(), class_id = reader.real();
+    matchfile.seedKeypoints.push_back (KeyPoint (x, y, size, angle, response, (int) octave, (int) class_id));
+  }
+
+  size_t nhits = reader.uint (4);
+  matchfile.hits.clear();
+  for (size_t h = 0; h < nhits && !reader.bad; h++)
+  {
+    MatchRecord hit;
+    hit.image = reader.text();
+    hit.featurefile = reader.text();
+    hit.distance = reader.real();
+    size_t nmatches = reader.uint (4);
+    for (size_t m = 0; m < nmatches && !reader.bad; m++)
+    {
+      int query = reader.uint (4);
+      int train = reader.uint (4);
+      float distance = reader.real();
+      hit.matches.push_back (DMatch (query, train, distance));
+    }
+    matchfile.hits.push_back (hit);
+  }
+
+  return reader.bad ? -1 : 0;
+}
+
+}
@@ -0,0 +1,147 @@
+/* ============================================================================================
+  featurestore.hpp                 Version 1           Last Update: 10/19/2026
+
+  Binary feature files (.akf): the keypoints and descriptors of an image stored as raw blocks
+  instead of YAML text, each block optionally byte-shuffled and compressed (LZ4 for speed,
+  zstd for density). Much smaller than the YAML files, and read without any text parsing.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#ifndef ARCHV_FEATURESTORE_HPP
+#define ARCHV_FEATURESTORE_HPP
+
+#include <string>
+#include <vector>
+
+#include "archv.hpp"
+
+namespace archv
+{
+
+/* ===============================================================================================
+   Layout of a .akf file (all integers little endian):
+
+	header   : "AKF1", uint32 version, uint32 number of sections, uint32 reserved
+	sections : one 48 byte entry per section
+	             uint32 id, uint8 codec, uint8 shuffle (element size, 0: not shuffled),
+	             uint16 reserved, uint32 rows, uint32 cols, int32 OpenCV type,
+	             uint32 reserved, uint64 offset, uint64 raw size, uint64 stored size
+	payloads : the blocks, at the offsets given in the section table
+
+   Keypoints are stored by columns, one section each: points (x, y), shape (size, angle) and
+   detection (response, octave, class_id), as float matrices with one row per keypoint, so that
+   a scan can read the points alone. Descriptors are stored as the descriptor matrix itself.
+   Version 1 files stored the keypoints as a single rows x 7 float matrix; they are still read.
+   =============================================================================================== */
+enum { CODEC_NONE = 0, CODEC_LZ4 = 1, CODEC_ZSTD = 2 };
+enum { SECTION_KEYPOINTS = 1, SECTION_DESCRIPTORS = 2, SECTION_POINTS = 3, SECTION_SHAPE = 4, SECTION_DETECTION = 5 };
+
+int parse_codec (std::string name);
+std::string codec_name (int codec);
+bool codec_available (int codec);
+
+struct StoreOptions
+{
+  int codec;
+  int level;             // compression level (zstd only)
+  bool shuffle;          // byte-shuffle the elements of a block before compressing it
+
+  StoreOptions ();
+};
+
+struct StoreStats
+{
+  long rawBytes;         // size of the blocks before compression
+  long storedBytes;      // size of the blocks as stored
+  double seconds;        // time spent encoding or decoding
+
+  StoreStats ();
+  double ratio () const { return storedBytes > 0 ? (double) rawBytes/storedBytes : 0; }
+};
+
+/* ===============================================================================================
+   Whole files
+   =============================================================================================== */
+bool is_binary_featurefile (std::string filename);
+int write_binary_features (std::string filename, const Features &features, const StoreOptions &options = StoreOptions(), StoreStats *stats = NULL);
+int read_binary_features (std::string filename, Features &features, StoreStats *stats = NULL, int fields = FIELDS_ALL);
+
+/* ===============================================================================================
+   True if two sets of features are bit for bit identical (all keypoint fields or columns,
+   descriptor type, size and values)
+   =============================================================================================== */
+bool same_features (const Features &a, const Features &b);
+
+/* ===============================================================================================
+   Match sidecar (.akm): the matches that survived the filters between a seed and its top hits,
+   written by scanDatabase so that drawMatches can render a pair without matching it again.
+   Layout (little endian): "AKM1", uint32 version, seed image path, uint32 number of seed
+   keypoints followed by 7 floats per keypoint (as in version 1 .akf files), uint32 number of
+   hits, then per hit: image path, feature file path, float distance, uint32 number of matches
+   and per match uint32 queryIdx (seed), uint32 trainIdx (hit), float distance. Strings are
+   stored as a uint32 length followed by the bytes.
+   =============================================================================================== */
+struct MatchRecord
+{
+  std::string image;
+  std::string featurefile;
+  double distance;
+  std::vector<cv::DMatch> matches;
+};
+
+struct MatchFile
+{
+  std::string seed;
+  std::vector<cv::KeyPoint> seedKeypoints;
+  std::vector<MatchRecord> hits;
+};
+
+int write_matchfile (std::string filename, const MatchFile &matchfile);
+int read_matchfile (std::string filename, MatchFile &matchfile);
+
+/* ===============================================================================================
+   Single blocks: encode "size" bytes of elements of "elemsize" bytes, or decode a stored block
+   into "rawsize" bytes at "out". Scratch buffers are owned by the caller, so that they can be
+   reused from one block to the next.
+   =============================================================================================== */
+int encode_block (const uchar *data, size_t size, int elemsize, const StoreOptions &options, std::vector<uchar> &stored, std::vector<uchar> &scratch);
+int decode_block (const uchar *stored, size_t storedsize, int codec, int elemsize, uchar *out, size_t rawsize, std::vector<uchar> &scratch);
+
+}
+
+#endif
@@ -0,0 +1,991 @@
+/* ============================================================================================
+  findMotifs.cpp                   Version 1           Last Update: 10/19/2026
+
+  This program looks for patterns that recur across a whole corpus without a seed image. The
+  SURF descriptors are clustered into visual words by mini-batch k-means, streaming over
+  random keypoint files; each keypoint and each of its nearest neighbours in the image then
+  form a pair token (the two words, their distance relative to the keypoint size and their
+  relative angles). Tokens found in enough images are kept, tokens that share keypoints in
+  enough images are joined into motifs, and the motifs are written in JSON format with their
+  member images and the bounding box of the motif in each. Keypoint files are streamed in
+  blocks, and the occurrences kept are bounded by a memory budget, so the corpus is never
+  held in memory.
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include "opencv2/core/core.hpp"
+#include "opencv2/features2d/features2d.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <cstdlib>
+#include <cmath>
+#include <algorithm>
+#include <map>
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "archv.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace archv;
+
+int  usage();
+void read_flags(int argc, char** argv, string *imgdir, string *infodir, string *output, int *nwords, int *batchsize, int *perimage, int *iterations, int *nneighbours, int *minimages, int *maxbucket, double *budget, int *blocksize, int *top, int *nthreads);
+
+uint64_t mix64 (uint64_t x);
+void squared_norms (const Mat &rows, vector<float> &norms);
+void assign_words (const Mat &descriptors, const Mat &centres, const vector<float> &norms, vector<int> &words, double *inertia = NULL);
+int  find_root (vector<int> &parent, int i);
+
+/* ===============================================================================================
+   Pair token: keypoint p of an image and one of its nearest neighbours q. The key hashes their
+   words and the geometry of q seen from p (distance in units of the size of p, direction and
+   orientation relative to the orientation of p), quantized
+   =============================================================================================== */
+struct PairToken
+{
+  uint64_t key;
+  int p, q;
+  int wp, wq;
+};
+
+bool operator< (const PairToken &a, const PairToken &b) { return a.key < b.key; }
+
+void pair_tokens (const Features &features, const vector<int> &words, int nneighbours, vector<PairToken> &tokens);
+
+/* ===============================================================================================
+   Uniform grid over the keypoints of an image, about "percell" points per cell, for their
+   nearest neighbours: nearest() searches rings of cells around the keypoint, and stops once
+   the k closest found are closer than any point of the rings not searched yet. Same result as
+   comparing with every keypoint (ties by index), in about O(k) per keypoint
+   =============================================================================================== */
+class PointGrid
+{
+public:
+  void build (const vector<Point2f> &points, int percell);
+  void nearest (int p, int k, vector< pair<float,int> > &neighbours) const;
+
+private:
+  const vector<Point2f> *pt;
+  float x0, y0, cell;
+  int cols, rows;
+  vector<int> starts, order;             // points of cell c: order[starts[c]] .. order[starts[c+1]-1]
+
+  int column (float x) const { return min (cols - 1, (int) ((x - x0)/cell)); }
+  int row (float y) const { return min (rows - 1, (int) ((y - y0)/cell)); }
+};
+
+/* ===============================================================================================
+   Occurrence of a frequent pair token in an image: the two keypoints and their position
+   =============================================================================================== */
+struct Occurrence
+{
+  int image;
+  int p, q;
+  Point2f a, b;
+};
+
+/* ===============================================================================================
+   Image of a motif: bounding box of the occurrences of its tokens, and their number
+   =============================================================================================== */
+struct Member
+{
+  float x0, y0, x1, y1;
+  int pairs;
+};
+
+/* ===============================================================================================
+   Count-min sketch of the number of images of each pair token: fixed memory whatever the
+   number of distinct tokens; estimates are never below the true count
+   =============================================================================================== */
+class CountSketch
+{
+public:
+  CountSketch (int bits) : mask ((1u << bits) - 1), table ((size_t) 4 << bits, 0) {}
+
+  void add (uint64_t key)
+  {
+    for (int r = 0; r < 4; r++)
+    {
+      uint32_t &cell = table[(size_t) r * (mask + 1) + (mix64 (key + r) & mask)];
+      if (cell < 0xffffffffu)
+        cell++;
+    }
+  }
+
+  unsigned estimate (uint64_t key) const
+  {
+    unsigned count = 0xffffffffu;
+    for (int r = 0; r < 4; r++)
+      count = min (count, table[(size_t) r * (mask + 1) + (mix64 (key + r) & mask)]);
+    return count;
+  }
+
+  size_t memory () const { return table.size()*sizeof(uint32_t); }
+
+private:
+  uint32_t mask;
+  vector<uint32_t> table;
+};
+
+/* ===============================================================================================
+   Loop bodies run in parallel. KMeansBody: one mini-batch, split into chunks of images; each
+   chunk samples descriptors of its images, assigns them to the nearest centre and sums them
+   per centre in its own accumulator. TokenBody: words and pair tokens of a block of images
+   =============================================================================================== */
+class KMeansBody : public ParallelLoopBody
+{
+public:
+  KMeansBody (const Corpus &c, const vector<int> &i, int n, int p, uint64_t s, const Mat &w, const vector<float> &cn, vector<Mat> &su, vector< vector<int> > &co, vector<double> &in, vector<int> &ns)
+    : corpus (c), images (i), nchunks (n), perimage (p), seed (s), centres (w), norms (cn), sums (su), counts (co), inertia (in), nsamples (ns) {}
+
+  void operator() (const Range &range) const
+  {
+    Features buffer;
+    Mat sample;
+    vector<int> rows, words;
+    for (int c = range.start; c < range.end; c++)
+    {
+      sums[c] = Mat::zeros (centres.rows, centres.cols, CV_64F);
+      counts[c].assign (centres.rows, 0);
+      inertia[c] = 0;
+      nsamples[c] = 0;
+
+      int first = (int) ((long) images.size()*c/nchunks), last = (int) ((long) images.size()*(c+1)/nchunks);
+      for (int m = first; m < last; m++)
+      {
+        const Features &features = corpus.features (images[m], buffer);
+        const Mat &descriptors = features.descriptors;
+        if (descriptors.rows == 0 || descriptors.cols != centres.cols || descriptors.type() != CV_32F)
+          continue;
+
+        // "perimage" rows drawn without replacement (partial Fisher-Yates)
+        RNG rng (mix64 (seed ^ ((uint64_t) m << 32)));
+        rows.resize (descriptors.rows);
+        for (int r = 0; r < rows.size(); r++)
+          rows[r] = r;
+        int n = min (perimage, descriptors.rows);
+        sample.create (n, descriptors.cols, CV_32F);
+        for (int r = 0; r < n; r++)
+        {
+          swap (rows[r], rows[r + rng.uniform (0, descriptors.rows - r)]);
+          const float *x = descriptors.ptr<float>(rows[r]);
+          copy (x, x + descriptors.cols, sample.ptr<float>(r));
+        }
+
+        double d = 0;
+        assign_words (sample, centres, norms, words, &d);
+        inertia[c] += d;
+        nsamples[c] += n;
+        for (int r = 0; r < n; r++)
+        {
+          double *sum = sums[c].ptr<double>(words[r]);
+          const float *x = sample.ptr<float>(r);
+          for (int j = 0; j < sample.cols; j++)
+            sum[j] += x[j];
+          counts[c][words[r]]++;
+        }
+      }
+    }
+  }
+
+private:
+  const Corpus &corpus;
+  const vector<int> &images;
+  int nchunks, perimage;
+  uint64_t seed;
+  const Mat &centres;
+  const vector<float> &norms;
+  vector<Mat> &sums;
+  vector< vector<int> > &counts;
+  vector<double> &inertia;
+  vector<int> &nsamples;
+};
+
+class TokenBody : public ParallelLoopBody
+{
+public:
+  TokenBody (const Corpus &c, int s, const Mat &w, const vector<float> &cn, int n, vector< vector<PairToken> > &t, vector<Features> &f)
+    : corpus (c), start (s), centres (w), norms (cn), nneighbours (n), tokens (t), features (f) {}
+
+  void operator() (const Range &range) const
+  {
+    Features buffer;
+    vector<int> words;
+    for (int i = range.start; i < range.end; i++)
+    {
+      tokens[i].clear();
+      const Features &image = corpus.features (start + i, buffer);
+      // the coordinates are kept for the occurrences (the buffer is reused by the next image)
+      features[i].points = image.keypoints.size() == 0 ? image.points.clone() : Mat();
+      features[i].keypoints = image.keypoints;
+      if (image.descriptors.rows == 0 || image.descriptors.cols != centres.cols || image.descriptors.type() != CV_32F)
+        continue;
+      assign_words (image.descriptors, centres, norms, words);
+      pair_tokens (image, words, nneighbours, tokens[i]);
+    }
+  }
+
+private:
+  const Corpus &corpus;
+  int start;
+  const Mat &centres;
+  const vector<float> &norms;
+  int nneighbours;
+  vector< vector<PairToken> > &tokens;
+  vector<Features> &features;
+};
+
+
+int main(int argc, char** argv)
+{
+/* ===============================================================================================
+   Show usage if needed
+   =============================================================================================== */
+  if (argc < 2)
+    return usage();
+
+  string input = argv[1];
+  if( input == "-h" || input == "-help" )
+    return usage();
+
+/* ===============================================================================================
+   (1) Initialize all variables (2) parse command line
+	- nwords     : visual words (k-means centres)
+	- batchsize  : images whose descriptors make one k-means mini-batch, perimage of each
+	- iterations : mini-batches; the learning rate of a centre is 1 / (points it has seen)
+	- nneighbours: nearest keypoints paired with each keypoint
+	- minimages  : images a pair token, and a motif, must be found in
+	- maxbucket  : pair tokens found in more images are too common to be part of a motif
+	- budget     : memory for the occurrences of the frequent pair tokens, in MB
+   =============================================================================================== */
+  string imgdir, infodir, output;
+  int nwords = 1024;
+  int batchsize = 32;
+  int perimage = 100;
+  int iterations = 200;
+  int nneighbours = 5;
+  int minimages = 5;
+  int maxbucket = 500;
+  double budget = 256;
+  int blocksize = 256;
+  int top = 100;
+  int nthreads = 0;
+
+  read_flags (argc, argv, &imgdir, &infodir, &output, &nwords, &batchsize, &perimage, &iterations, &nneighbours, &minimages, &maxbucket, &budget, &blocksize, &top, &nthreads);
+
+  if (nwords < 2 || batchsize < 1 || perimage < 1 || nneighbours < 1 || minimages < 2 || blocksize < 1)
+  {
+    cout << "words must be at least 2, images per motif at least 2, the other sizes positive" << endl;
+    return -1;
+  }
+
+  struct stat sb;
+  if (stat(imgdir.c_str(), &sb) != 0 || !S_ISDIR(sb.st_mode))
+  {
+    cout << imgdir << " does not exist, or is not a directory; try again" << endl;
+    return -1;
+  }
+
+  Corpus corpus;
+  if (corpus.open (imgdir, infodir) != 0 || corpus.size() == 0)
+  {
+    cout << " Problem while trying to read in list of images; check the directory!" << endl;
+    return -1;
+  }
+
+  // words need the descriptors, pair tokens the coordinates, sizes and angles
+  corpus.select (FIELD_POINTS | FIELD_SHAPE | FIELD_DESCRIPTORS);
+
+  // the type of the descriptors is that of the first image that has some
+  int type = -1;
+  {
+    Features buffer;
+    for (int i = 0; i < corpus.size() && type < 0; i++)
+    {
+      const Features &features = corpus.features (i, buffer);
+      if (!features.descriptors.empty())
+        type = features.descriptors.type();
+    }
+  }
+  if (type == CV_8U)
+  {
+    cout << "binary descriptors (ORB, BRISK) cannot be averaged into words: use SURF keypoint files" << endl;
+    return -1;
+  }
+  if (type != CV_32F)
+  {
+    cout << "no float (SURF) descriptors in " << infodir << endl;
+    return -1;
+  }
+
+  int nimages = corpus.size();
+  if (nthreads <= 0)
+    nthreads = default_threads();
+  double freq = getTickFrequency();
+  int64 t0 = getTickCount();
+
+/* ===============================================================================================
+   Visual words by mini-batch k-means (Sculley, 2010). The centres start as random descriptors
+   of random images; each mini-batch draws "batchsize" random images, and each centre moves
+   toward the mean of the descriptors assigned to it with a rate of n / (all points it has
+   been assigned so far). Only the centres and one mini-batch are ever in memory
+   =============================================================================================== */
+  RNG rng (12345);
+  Mat centres;
+  {
+    Mat pool;
+    Features buffer;
+    for (int tries = 0; pool.rows < 4*nwords && tries < 8*nwords/perimage + 64; tries++)
+    {
+      const Features &features = corpus.features (rng.uniform (0, nimages), buffer);
+      for (int r = 0; r < features.descriptors.rows && r < perimage; r++)
+        pool.push_back (features.descriptors.row (rng.uniform (0, features.descriptors.rows)));
+    }
+    if (pool.rows < nwords)
+    {
+      cout << "only " << pool.rows << " descriptors sampled: fewer than the " << nwords << " words; use fewer words (-w)" << endl;
+      return -1;
+    }
+    vector<int> order (pool.rows);
+    for (int r = 0; r < pool.rows; r++)
+      order[r] = r;
+    for (int w = 0; w < nwords; w++)
+    {
+      swap (order[w], order[w + rng.uniform (0, pool.rows - w)]);
+      centres.push_back (pool.row (order[w]));
+    }
+  }
+
+  int nchunks = min (batchsize, 4*nthreads);
+  vector<Mat> sums (nchunks);
+  vector< vector<int> > counts (nchunks);
+  vector<double> inertia (nchunks);
+  vector<int> nsamples (nchunks);
+  vector<double> seen (nwords, 0);
+  vector<float> norms (nwords);
+  vector<int> batch (batchsize);
+
+  for (int it = 0; it < iterations; it++)
+  {
+    squared_norms (centres, norms);
+    for (int m = 0; m < batchsize; m++)
+      batch[m] = rng.uniform (0, nimages);
+
+    run_parallel (Range (0, nchunks), KMeansBody (corpus, batch, nchunks, perimage, (uint64_t) it + 1, centres, norms, sums, counts, inertia, nsamples), nthreads);
+
+    double error = 0;
+    long n = 0;
+    for (int c = 0; c < nchunks; c++)
+    {
+      error += inertia[c];
+      n += nsamples[c];
+    }
+    for (int w = 0; w < nwords; w++)
+    {
+      int count = 0;
+      for (int c = 0; c < nchunks; c++)
+        count += counts[c][w];
+      if (count == 0)
+        continue;
+      seen[w] += count;
+      double rate = count/seen[w];
+      float *centre = centres.ptr<float>(w);
+      for (int j = 0; j < centres.cols; j++)
+      {
+        double sum = 0;
+        for (int c = 0; c < nchunks; c++)
+          sum += sums[c].at<double>(w, j);
+        centre[j] = (float) ((1 - rate)*centre[j] + rate*sum/count);
+      }
+    }
+    if (n > 0 && ((it + 1) % max (1, iterations/10) == 0 || it == iterations - 1))
+      cout << "k-means mini-batch " << it + 1 << " of " << iterations << ": mean squared distance to the words " << error/n << endl;
+  }
+
+  int unused = 0;
+  for (int w = 0; w < nwords; w++)
+    if (seen[w] == 0)
+      unused++;
+  squared_norms (centres, norms);
+  cout << nwords << " words (" << unused << " never assigned) in " << (getTickCount() - t0)/freq << " s" << endl;
+
+/* ===============================================================================================
+   First pass over the corpus, by blocks of images: the number of images of each pair token,
+   counted in a count-min sketch of fixed size
+   =============================================================================================== */
+  t0 = getTickCount();
+  CountSketch sketch (22);
+  vector< vector<PairToken> > tokens (blocksize);
+  vector<Features> points (blocksize);
+  vector<uint64_t> keys;
+  long ntokens = 0;
+
+  for (int start = 0; start < nimages; start += blocksize)
+  {
+    int n = min (blocksize, nimages - start);
+    run_parallel (Range (0, n), TokenBody (corpus, start, centres, norms, nneighbours, tokens, points), nthreads);
+    for (int i = 0; i < n; i++)
+    {
+      keys.clear();
+      for (int t = 0; t < tokens[i].size(); t++)
+        keys.push_back (tokens[i][t].key);
+      sort (keys.begin(), keys.end());
+      keys.erase (unique (keys.begin(), keys.end()), keys.end());
+      for (int t = 0; t < keys.size(); t++)
+        sketch.add (keys[t]);
+      ntokens += keys.size();
+    }
+  }
+  cout << "Counted " << ntokens << " pair tokens of " << nimages << " images in " << (getTickCount() - t0)/freq << " s (sketch: " << sketch.memory()/(1024*1024) << " MB)" << endl;
+
+/* ===============================================================================================
+   Second pass: the occurrences (first one per image) of the tokens found in at least
+   "minimages" and at most "maxbucket" images, within the memory budget
+   =============================================================================================== */
+  t0 = getTickCount();
+  map<uint64_t,int> tokenid;
+  vector< vector<Occurrence> > occurrences;
+  vector< pair<int,int> > tokenwords;
+  size_t maxoccurrences = (size_t) (budget*1024*1024/sizeof(Occurrence));
+  size_t noccurrences = 0, dropped = 0;
+
+  for (int start = 0; start < nimages; start += blocksize)
+  {
+    int n = min (blocksize, nimages - start);
+    run_parallel (Range (0, n), TokenBody (corpus, start, centres, norms, nneighbours, tokens, points), nthreads);
+    for (int i = 0; i < n; i++)
+    {
+      vector<PairToken> &image = tokens[i];
+      stable_sort (image.begin(), image.end());
+      for (int t = 0; t < image.size(); t++)
+      {
+        if (t > 0 && image[t].key == image[t-1].key)
+          continue;
+        unsigned count = sketch.estimate (image[t].key);
+        if (count < minimages || count > maxbucket)
+          continue;
+        if (noccurrences >= maxoccurrences)
+        {
+          dropped++;
+          continue;
+        }
+
+        map<uint64_t,int>::iterator found = tokenid.find (image[t].key);
+        int id;
+        if (found == tokenid.end())
+        {
+          id = occurrences.size();
+          tokenid[image[t].key] = id;
+          occurrences.push_back (vector<Occurrence>());
+          tokenwords.push_back (make_pair (image[t].wp, image[t].wq));
+        }
+        else
+          id = found->second;
+
+        Occurrence occurrence;
+        occurrence.image = start + i;
+        occurrence.p = image[t].p;
+        occurrence.q = image[t].q;
+        occurrence.a = points[i].point (image[t].p);
+        occurrence.b = points[i].point (image[t].q);
+        occurrences[id].push_back (occurrence);
+        noccurrences++;
+      }
+    }
+  }
+  cout << "Kept " << noccurrences << " occurrences of " << occurrences.size() << " frequent pair tokens in " << (getTickCount() - t0)/freq << " s (";
+  cout << noccurrences*sizeof(Occurrence)/(1024*1024) << " of " << budget << " MB)" << endl;
+  if (dropped > 0)
+    cout << "Memory budget reached: " << dropped << " occurrences dropped; raise -mem or -m" << endl;
+
+/* ===============================================================================================
+   Motifs: tokens (found in enough images, the sketch overestimates) that share a keypoint in
+   at least "minimages" images are joined (union-find); the connected components are the motifs
+   =============================================================================================== */
+  t0 = getTickCount();
+  int nkept = occurrences.size();
+  vector<char> frequent (nkept);
+  for (int t = 0; t < nkept; t++)
+    frequent[t] = occurrences[t].size() >= minimages;
+
+  // (image, keypoint, token) of both keypoints of every occurrence, grouped by image and keypoint
+  vector< pair<uint64_t,int> > links;
+  for (int t = 0; t < nkept; t++)
+    for (int o = 0; frequent[t] && o < occurrences[t].size(); o++)
+    {
+      const Occurrence &occurrence = occurrences[t][o];
+      links.push_back (make_pair (((uint64_t) occurrence.image << 32) | occurrence.p, t));
+      links.push_back (make_pair (((uint64_t) occurrence.image << 32) | occurrence.q, t));
+    }
+  sort (links.begin(), links.end());
+
+  // pairs of tokens sharing a keypoint, once per image
+  vector<uint64_t> edges, imageedges;
+  for (int s = 0; s < links.size(); )
+  {
+    uint64_t image = links[s].first >> 32;
+    imageedges.clear();
+    int e = s;
+    while (e < links.size() && (links[e].first >> 32) == image)
+    {
+      int k = e;
+      while (k < links.size() && links[k].first == links[e].first)
+        k++;
+      for (int a = e; a < k; a++)
+        for (int b = a + 1; b < k; b++)
+          if (links[a].second != links[b].second)
+            imageedges.push_back (((uint64_t) links[a].second << 32) | links[b].second);
+      e = k;
+    }
+    sort (imageedges.begin(), imageedges.end());
+    imageedges.erase (unique (imageedges.begin(), imageedges.end()), imageedges.end());
+    edges.insert (edges.end(), imageedges.begin(), imageedges.end());
+    s = e;
+  }
+  sort (edges.begin(), edges.end());
+
+  vector<int> parent (nkept);
+  for (int t = 0; t < nkept; t++)
+    parent[t] = t;
+  int nedges = 0;
+  for (int s = 0; s < edges.size(); )
+  {
+    int e = s;
+    while (e < edges.size() && edges[e] == edges[s])
+      e++;
+    if (e - s >= minimages)
+    {
+      nedges++;
+      int ri = find_root (parent, edges[s] >> 32);
+      int rj = find_root (parent, edges[s] & 0xffffffff);
+      if (ri != rj)
+        parent[max (ri, rj)] = min (ri, rj);
+    }
+    s = e;
+  }
+
+  vector< vector<int> > members (nkept);
+  for (int t = 0; t < nkept; t++)
+    if (frequent[t])
+      members[find_root (parent, t)].push_back (t);
+
+/* ===============================================================================================
+   Images of each motif, with the bounding box of its occurrences in the image; motifs found in
+   fewer than "minimages" images are dropped, the others ranked by number of images then tokens
+   =============================================================================================== */
+  vector< map<int,Member> > motifimages;
+  vector< vector<int> > motiftokens;
+  vector< pair< pair<int,int>, int> > ranking;
+  for (int root = 0; root < nkept; root++)
+  {
+    if (members[root].size() == 0)
+      continue;
+    map<int,Member> images;
+    for (int m = 0; m < members[root].size(); m++)
+    {
+      const vector<Occurrence> &list = occurrences[members[root][m]];
+      for (int o = 0; o < list.size(); o++)
+      {
+        map<int,Member>::iterator found = images.find (list[o].image);
+        if (found == images.end())
+        {
+          Member member;
+          member.x0 = member.x1 = list[o].a.x;
+          member.y0 = member.y1 = list[o].a.y;
+          member.pairs = 0;
+          found = images.insert (make_pair (list[o].image, member)).first;
+        }
+        Member &member = found->second;
+        member.x0 = min (member.x0, min (list[o].a.x, list[o].b.x));
+        member.y0 = min (member.y0, min (list[o].a.y, list[o].b.y));
+        member.x1 = max (member.x1, max (list[o].a.x, list[o].b.x));
+        member.y1 = max (member.y1, max (list[o].a.y, list[o].b.y));
+        member.pairs++;
+      }
+    }
+    if (images.size() < minimages)
+      continue;
+    ranking.push_back (make_pair (make_pair (-(int) images.size(), -(int) members[root].size()), (int) motifimages.size()));
+    motifimages.push_back (map<int,Member>());
+    motifimages.back().swap (images);
+    motiftokens.push_back (members[root]);
+  }
+  sort (ranking.begin(), ranking.end());
+
+  cout << "Motifs: " << ranking.size() << " (" << nedges << " links between tokens) in " << (getTickCount() - t0)/freq << " s" << endl;
+
+/* ===============================================================================================
+   Write out the motifs in JSON format: words of the tokens, then each member image with the
+   bounding box of the motif and the number of pair occurrences inside it
+   =============================================================================================== */
+  ofstream json (output.c_str());
+  json << "{\"path\":\"" << imgdir << "\", \"words\":" << nwords << ", \"motifs\":[";
+  for (int r = 0; r < ranking.size() && r < top; r++)
+  {
+    int m = ranking[r].second;
+    const vector<int> &tokenlist = motiftokens[m];
+    vector<int> words;
+    for (int t = 0; t < tokenlist.size(); t++)
+    {
+      words.push_back (tokenwords[tokenlist[t]].first);
+      words.push_back (tokenwords[tokenlist[t]].second);
+    }
+    sort (words.begin(), words.end());
+    words.erase (unique (words.begin(), words.end()), words.end());
+
+    if (r != 0)
+      json << ",";
+    json << "{\"images\":" << motifimages[m].size() << ", \"tokens\":" << tokenlist.size() << ", \"words\":[";
+    for (int w = 0; w < words.size(); w++)
+      json << (w != 0 ? "," : "") << words[w];
+    json << "], \"members\":[";
+    int count = 0;
+    for (map<int,Member>::const_iterator it = motifimages[m].begin(); it != motifimages[m].end(); it++, count++)
+    {
+      if (count != 0)
+        json << ",";
+      const Member &member = it->second;
+      json << "{\"image\":\"" << corpus.name (it->first) << "\", \"x\":" << member.x0 << ", \"y\":" << member.y0;
+      json << ", \"w\":" << member.x1 - member.x0 << ", \"h\":" << member.y1 - member.y0 << ", \"pairs\":" << member.pairs << "}";
+    }
+    json << "]}";
+  }
+  json << "]}" << endl;
+  json.close();
+
+  return 0;
+}
+
+/* ===============================================================================================
+   Usage
+   =============================================================================================== */
+int usage()
+{
+    cout << "\n\n" <<endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=                                     FindMotifs                                               ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     This program finds patterns recurring across a corpus. Descriptors are clustered         ="  << endl;
+    cout << "     " << "=     into visual words (mini-batch k-means), pairs of neighbouring words with the same        ="  << endl;
+    cout << "     " << "=     geometry are counted over all images, and pairs sharing keypoints in many images         ="  << endl;
+    cout << "     " << "=     are joined into motifs. Output is the motifs, their images and locations (JSON).         ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     Usage is:                                                                                ="  << endl;
+    cout << "     " << "=                 findMotifs.exe                                                               ="  << endl;
+    cout << "     " << "=                                 -d        <path to directory with images>                    ="  << endl;
+    cout << "     " << "=                                 -k        <path to directory with keypoints of images>       ="  << endl;
+    cout << "     " << "=                                 -o        <path to output file>                              ="  << endl;
+    cout << "     " << "=                                 -w        <number of visual words> (1024)                    ="  << endl;
+    cout << "     " << "=                                 -b        <images per k-means mini-batch> (32)               ="  << endl;
+    cout << "     " << "=                                 -per      <descriptors sampled per image> (100)              ="  << endl;
+    cout << "     " << "=                                 -iter     <k-means mini-batches> (200)                       ="  << endl;
+    cout << "     " << "=                                 -nn       <neighbours paired with each keypoint> (5)         ="  << endl;
+    cout << "     " << "=                                 -m        <minimum number of images of a motif> (5)          ="  << endl;
+    cout << "     " << "=                                 -maxb     <pairs found in more images are ignored> (500)     ="  << endl;
+    cout << "     " << "=                                 -mem      <MB for the occurrences kept> (256)                ="  << endl;
+    cout << "     " << "=                                 -block    <images read per block> (256)                      ="  << endl;
+    cout << "     " << "=                                 -top      <motifs written> (100)                             ="  << endl;
+    cout << "     " << "=                                 -t        <number of threads> (one per core)                 ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "\n\n" <<endl;
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Procedure to read in flag values
+   =============================================================================================== */
+void read_flags(int argc, char** argv, string *imgdir, string *infodir, string *output, int *nwords, int *batchsize, int *perimage, int *iterations, int *nneighbours, int *minimages, int *maxbucket, double *budget, int *blocksize, int *top, int *nthreads)
+{
+  string input;
+  for(int i = 1; i < argc; i++)
+  {
+    input = argv[i];
+    if (input == "-d") 
+      *imgdir = argv[i + 1];
+    if (input == "-k") 
+      *infodir = argv[i + 1];
+    if (input == "-o") 
+      *output = argv[i + 1];
+
+    if (input == "-w")
+      *nwords = atoi(argv[i+1]);
+    if (input == "-b")
+      *batchsize = atoi(argv[i+1]);
+    if (input == "-per")
+      *perimage = atoi(argv[i+1]);
+    if (input == "-iter")
+      *iterations = atoi(argv[i+1]);
+    if (input == "-nn")
+      *nneighbours = atoi(argv[i+1]);
+    if (input == "-m")
+      *minimages = atoi(argv[i+1]);
+    if (input == "-maxb")
+      *maxbucket = atoi(argv[i+1]);
+    if (input == "-mem")
+      *budget = atof(argv[i+1]);
+    if (input == "-block")
+      *blocksize = atoi(argv[i+1]);
+    if (input == "-top")
+      *top = atoi(argv[i+1]);
+    if (input == "-t")
+      *nthreads = atoi(argv[i+1]);
+  }
+}
+
+/* ===============================================================================================
+   64 bit mixing function (splitmix64 finalizer), used to hash the pair tokens
+   =============================================================================================== */
+uint64_t mix64 (uint64_t x)
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+}
+
+/* ===============================================================================================
+   Squared norm of each row of a CV_32F matrix
+   =============================================================================================== */
+void squared_norms (const Mat &rows, vector<float> &norms)
+{
+  norms.resize (rows.rows);
+  for (int i = 0; i < rows.rows; i++)
+  {
+    const float *x = rows.ptr<float>(i);
+    double norm = 0;
+    for (int j = 0; j < rows.cols; j++)
+      norm += x[j]*x[j];
+    norms[i] = (float) norm;
+  }
+}
+
+/* ===============================================================================================
+   Nearest word of each descriptor: |x - c|^2 = |x|^2 + |c|^2 - 2 x.c, the products by one
+   matrix product per image. With "inertia", adds the squared distances to the nearest words
+   =============================================================================================== */
+void assign_words (const Mat &descriptors, const Mat &centres, const vector<float> &norms, vector<int> &words, double *inertia)
+{
+  words.assign (descriptors.rows, 0);
+  if (descriptors.rows == 0)
+    return;
+
+  Mat products;
+  gemm (descriptors, centres, 1, Mat(), 0, products, GEMM_2_T);
+
+  for (int i = 0; i < descriptors.rows; i++)
+  {
+    const float *product = products.ptr<float>(i);
+    float best = norms[0] - 2*product[0];
+    for (int w = 1; w < centres.rows; w++)
+    {
+      float d = norms[w] - 2*product[w];
+      if (d < best)
+      {
+        best = d;
+        words[i] = w;
+      }
+    }
+    if (inertia != NULL)
+    {
+      const float *x = descriptors.ptr<float>(i);
+      double norm = 0;
+      for (int j = 0; j < descriptors.cols; j++)
+        norm += x[j]*x[j];
+      *inertia += max (0.0, norm + best);
+    }
+  }
+}
+
+/* ===============================================================================================
+   Pair tokens of an image: each keypoint with its "nneighbours" nearest keypoints. Distance
+   ratios are quantized by half octaves (from 1/4 to 16 sizes), angles by 45 degrees; keypoints
+   without orientation (upright SURF) count as oriented at 0
+   =============================================================================================== */
+void pair_tokens (const Features &features, const vector<int> &words, int nneighbours, vector<PairToken> &tokens)
+{
+  tokens.clear();
+  int n = features.size();
+  if (n < 2 || words.size() != n)
+    return;
+
+  vector<Point2f> pt (n);
+  vector<float> size (n), angle (n);
+  for (int i = 0; i < n; i++)
+  {
+    pt[i] = features.point (i);
+    Point2f shape = features.keypoints.size() > 0 ? Point2f (features.keypoints[i].size, features.keypoints[i].angle)
+                                                   : (features.shape.rows == n ? features.shape.at<Point2f>(i) : Point2f (1, 0));
+    size[i] = max (shape.x, 1.0f);
+    angle[i] = shape.y < 0 ? 0 : shape.y;
+  }
+
+  int k = min (nneighbours, n - 1);
+  PointGrid grid;
+  grid.build (pt, max (k, 2));
+  vector< pair<float,int> > neighbours;
+  for (int p = 0; p < n; p++)
+  {
+    grid.nearest (p, k, neighbours);
+
+    for (int m = 0; m < neighbours.size(); m++)
+    {
+      int q = neighbours[m].second;
+      float ratio = sqrt (neighbours[m].first)/size[p];
+      int dbin = (int) floor (2*log (max (ratio, 0.25f))/log (2.0f));
+      dbin = min (dbin, 8) + 4;
+
+      Point2f d = pt[q] - pt[p];
+      float direction = (float) (atan2 (d.y, d.x)*180/CV_PI) - angle[p];
+      float orientation = angle[q] - angle[p];
+      direction -= 360*floor (direction/360);
+      orientation -= 360*floor (orientation/360);
+      int abin = min ((int) (direction/45), 7);
+      int obin = min ((int) (orientation/45), 7);
+
+      PairToken token;
+      token.key = mix64 (mix64 (mix64 (words[p]) ^ words[q]) ^ ((dbin << 16) | (abin << 8) | obin));
+      token.p = p;
+      token.q = q;
+      token.wp = words[p];
+      token.wq = words[q];
+      tokens.push_back (token);
+    }
+  }
+}
+
+/* ===============================================================================================
+   Grid of the keypoints: cells of equal size over their bounding box, the points sorted by cell
+   =============================================================================================== */
+void PointGrid::build (const vector<Point2f> &points, int percell)
+{
+  pt = &points;
+  int n = points.size();
+  float x1 = points[0].x, y1 = points[0].y;
+  x0 = x1;
+  y0 = y1;
+  for (int i = 1; i < n; i++)
+  {
+    x0 = min (x0, points[i].x);
+    y0 = min (y0, points[i].y);
+    x1 = max (x1, points[i].x);
+    y1 = max (y1, points[i].y);
+  }
+  double area = max (x1 - x0, 1.0f)*(double) max (y1 - y0, 1.0f);
+  cell = (float) max (1.0, sqrt (area*percell/n));
+  cols = (int) ((x1 - x0)/cell) + 1;
+  rows = (int) ((y1 - y0)/cell) + 1;
+
+  starts.assign (cols*rows + 1, 0);
+  for (int i = 0; i < n; i++)
+    starts[row (points[i].y)*cols + column (points[i].x) + 1]++;
+  for (int c = 0; c < cols*rows; c++)
+    starts[c+1] += starts[c];
+  order.resize (n);
+  vector<int> next (starts.begin(), starts.end() - 1);
+  for (int i = 0; i < n; i++)
+    order[next[row (points[i].y)*cols + column (points[i].x)]++] = i;
+}
+
+/* ===============================================================================================
+   The k nearest points of point p (squared distance, index), closest first. A point outside
+   the rings 0..r around the cell of p is at least r cells away from it
+   =============================================================================================== */
+void PointGrid::nearest (int p, int k, vector< pair<float,int> > &neighbours) const
+{
+  const vector<Point2f> &points = *pt;
+  neighbours.clear();
+  int cx = column (points[p].x), cy = row (points[p].y);
+  for (int r = 0; ; r++)
+  {
+    for (int dy = -r; dy <= r; dy++)
+    {
+      int y = cy + dy;
+      if (y < 0 || y >= rows)
+        continue;
+      // whole rows of cells at the top and bottom of the ring, two cells on the other rows
+      int step = (dy == -r || dy == r) ? 1 : max (2*r, 1);
+      for (int dx = -r; dx <= r; dx += step)
+      {
+        int x = cx + dx;
+        if (x < 0 || x >= cols)
+          continue;
+        int c = y*cols + x;
+        for (int m = starts[c]; m < starts[c+1]; m++)
+        {
+          int q = order[m];
+          if (q == p)
+            continue;
+          Point2f d = points[q] - points[p];
+          pair<float,int> candidate (d.x*d.x + d.y*d.y, q);
+          if (neighbours.size() == k && !(candidate < neighbours.back()))
+            continue;
+          neighbours.insert (upper_bound (neighbours.begin(), neighbours.end(), candidate), candidate);
+          if (neighbours.size() > k)
+            neighbours.pop_back();
+        }
+      }
+    }
+    float reach = r*cell;
+    if (neighbours.size() == k && neighbours.back().first < reach*reach)
+      return;
+    if (cx - r <= 0 && cy - r <= 0 && cx + r >= cols - 1 && cy + r >= rows - 1)
+      return;
+  }
+}
+
+/* ===============================================================================================
+   Union-find: root of the component of token i, with path halving
+   =============================================================================================== */
+int find_root (vector<int> &parent, int i)
+{
+  while (parent[i] != i)
+  {
+    parent[i] = parent[parent[i]];
+    i = parent[i];
+  }
+  return i;
+}
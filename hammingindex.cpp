@@ -0,0 +1,168 @@
+/* ============================================================================================
+  hammingindex.cpp                 Version 1           Last Update: 10/19/2026
+
+  Binary descriptors (ORB, BRISK): Hamming distance with hardware popcount, and a multi-index
+  hash of the descriptors of a whole corpus, which finds the images sharing near-identical
+  descriptors with a seed without matching it against every image.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include "hammingindex.hpp"
+
+#include <algorithm>
+
+using namespace cv;
+using namespace std;
+
+namespace archv
+{
+
+static const int BUCKETS = 65536;
+
+HammingIndex::HammingIndex ()
+  : nbytes (0), ntables (0), nimages (0)
+{
+}
+
+/* ===============================================================================================
+   Add the descriptors of an image (8-bit binary descriptors, all of the same length); returns
+   -1 if they are not binary or do not have the length of the previous ones
+   =============================================================================================== */
+int HammingIndex::add (int image, const Mat &descriptors)
+{
+  if (descriptors.empty())
+    return 0;
+  if (descriptors.type() != CV_8U || descriptors.cols < 2 || (nbytes != 0 && descriptors.cols != nbytes))
+    return -1;
+
+  nbytes = descriptors.cols;
+  ntables = nbytes/2;
+  nimages = max (nimages, image + 1);
+
+  for (int r = 0; r < descriptors.rows; r++)
+  {
+    const uchar *row = descriptors.ptr<uchar>(r);
+    codes.insert (codes.end(), row, row + nbytes);
+    images.push_back (image);
+  }
+  return 0;
+}
+
+/* ===============================================================================================
+   Sort the descriptors into the tables (counting sort on every 16-bit substring)
+   =============================================================================================== */
+static inline unsigned substring (const uchar *code, int t)
+{
+  return code[2*t] | (code[2*t+1] << 8);
+}
+
+void HammingIndex::build ()
+{
+  int n = images.size();
+  offsets.assign (ntables, vector<unsigned> ());
+  ids.assign (ntables, vector<unsigned> ());
+
+  for (int t = 0; t < ntables; t++)
+  {
+    vector<unsigned> &start = offsets[t];
+    start.assign (BUCKETS + 1, 0);
+    for (int i = 0; i < n; i++)
+      start[substring (&codes[(size_t) i*nbytes], t) + 1]++;
+    for (int b = 0; b < BUCKETS; b++)
+      start[b+1] += start[b];
+
+    vector<unsigned> next (start.begin(), start.end() - 1);
+    ids[t].resize (n);
+    for (int i = 0; i < n; i++)
+      ids[t][next[substring (&codes[(size_t) i*nbytes], t)]++] = i;
+  }
+}
+
+/* ===============================================================================================
+   Votes of the seed descriptors: votes[image] is the number of seed descriptors that have at
+   least one descriptor of that image within "radius" bits. Returns the number of distances
+   computed (the candidates found in the tables, each counted once per seed descriptor).
+   =============================================================================================== */
+int HammingIndex::query (const Mat &descriptors, int radius, vector<int> &votes) const
+{
+  votes.assign (nimages, 0);
+  if (descriptors.empty() || images.size() == 0 || descriptors.type() != CV_8U || descriptors.cols != nbytes)
+    return 0;
+
+  int ndistances = 0;
+  vector<unsigned> candidates;
+  vector<int> hits;
+  for (int r = 0; r < descriptors.rows; r++)
+  {
+    const uchar *q = descriptors.ptr<uchar>(r);
+
+    candidates.clear();
+    for (int t = 0; t < ntables; t++)
+    {
+      unsigned key = substring (q, t);
+      candidates.insert (candidates.end(), ids[t].begin() + offsets[t][key], ids[t].begin() + offsets[t][key+1]);
+    }
+    sort (candidates.begin(), candidates.end());
+    candidates.erase (unique (candidates.begin(), candidates.end()), candidates.end());
+
+    hits.clear();
+    for (int c = 0; c < candidates.size(); c++)
+      if (hamming_distance (q, &codes[(size_t) candidates[c]*nbytes], nbytes) <= radius)
+        hits.push_back (images[candidates[c]]);
+    ndistances += candidates.size();
+
+    sort (hits.begin(), hits.end());
+    hits.erase (unique (hits.begin(), hits.end()), hits.end());
+    for (int h = 0; h < hits.size(); h++)
+      votes[hits[h]]++;
+  }
+  return ndistances;
+}
+
+/* ===============================================================================================
+   Memory used by the index, in bytes
+   =============================================================================================== */
+long HammingIndex::memory () const
+{
+  long bytes = codes.size() + images.size()*sizeof(int);
+  for (int t = 0; t < ntables; t++)
+    bytes += (offsets[t].size() + ids[t].size())*sizeof(unsigned);
+  return bytes;
+}
+
+}
@@ -0,0 +1,112 @@
+/* ============================================================================================
+  hammingindex.hpp                 Version 1           Last Update: 10/19/2026
+
+  Binary descriptors (ORB, BRISK): Hamming distance with hardware popcount, and a multi-index
+  hash of the descriptors of a whole corpus, which finds the images sharing near-identical
+  descriptors with a seed without matching it against every image.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#ifndef ARCHV_HAMMINGINDEX_HPP
+#define ARCHV_HAMMINGINDEX_HPP
+
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+
+#include "opencv2/core/core.hpp"
+
+namespace archv
+{
+
+/* ===============================================================================================
+   Number of differing bits between two binary descriptors of "nbytes" bytes, 64 bits at a
+   time (a single POPCNT instruction each when built with -mpopcnt, see the Makefile)
+   =============================================================================================== */
+inline int hamming_distance (const uchar *a, const uchar *b, int nbytes)
+{
+  int d = 0;
+  int k = 0;
+  for (; k + 8 <= nbytes; k += 8)
+  {
+    uint64_t x, y;
+    memcpy (&x, a + k, 8);
+    memcpy (&y, b + k, 8);
+    d += __builtin_popcountll (x ^ y);
+  }
+  for (; k < nbytes; k++)
+    d += __builtin_popcount (a[k] ^ b[k]);
+  return d;
+}
+
+/* ===============================================================================================
+   Multi-index hashing of the binary descriptors of a corpus. Every descriptor is cut into
+   16-bit substrings, and table t lists the descriptors by the value of their substring t.
+   Two descriptors less than "ntables" bits apart agree exactly on at least one substring, so
+   looking up the substrings of a seed descriptor finds all its neighbours up to that radius
+   (16 bits for ORB, 32 for BRISK) and, beyond it, most of them, as locality sensitive hashing
+   would. query() counts, for every image, the seed descriptors with a neighbour within
+   "radius" bits in that image: the images with the most votes are the candidates worth the
+   full matching chain.
+   =============================================================================================== */
+class HammingIndex
+{
+public:
+  HammingIndex ();
+
+  int add (int image, const cv::Mat &descriptors);
+  void build ();
+  int query (const cv::Mat &descriptors, int radius, std::vector<int> &votes) const;
+
+  int size () const { return images.size(); }
+  int tables () const { return ntables; }
+  long memory () const;
+
+private:
+  int nbytes;                                      // bytes per descriptor
+  int ntables;                                     // one table per 16 bits
+  int nimages;                                     // largest image number + 1
+  std::vector<uchar> codes;                        // all descriptors, nbytes each
+  std::vector<int> images;                         // image of every descriptor
+  std::vector< std::vector<unsigned> > offsets;    // per table: start of every bucket (65537)
+  std::vector< std::vector<unsigned> > ids;        // per table: descriptors sorted by bucket
+};
+
+}
+
+#endif
@@ -0,0 +1,145 @@
+/* ============================================================================================
+  mergeResults.cpp                 Version 1           Last Update: 10/19/2026
+
+  This program combines the partial results written by scanDatabase runs on the shards of a
+  database (scanDatabase -shard i/N) into the ranked JSON file that a single scanDatabase run
+  over the whole database produces.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "archv.hpp"
+
+using namespace std;
+using namespace archv;
+
+int  usage();
+void read_flags(int argc, char** argv, string *output, vector<string> *inputs);
+
+int main(int argc, char** argv)
+{
+/* ===============================================================================================
+   Show usage if needed
+   =============================================================================================== */
+  if (argc < 2)
+    return usage();
+
+  string input = argv[1];
+  if( input == "-h" || input == "-help" )
+    return usage();
+
+  string output;
+  vector<string> inputs;
+
+  read_flags (argc, argv, &output, &inputs);
+  if (output == "" || inputs.size() == 0)
+    return usage();
+
+/* ===============================================================================================
+   Read all partial result files
+   =============================================================================================== */
+  vector<ResultSet> parts (inputs.size());
+  for (int i = 0; i < inputs.size(); i++)
+  {
+    if (read_results (inputs[i], parts[i]) != 0)
+    {
+      cout << "Could not read partial results from " << inputs[i] << endl;
+      return -1;
+    }
+  }
+
+/* ===============================================================================================
+   Merge them (all shards must be present, exactly once) and write the ranked result file
+   =============================================================================================== */
+  vector<QueryResult> results;
+  if (merge_results (parts, results) != 0)
+  {
+    cout << "Partial results do not cover shards 0 to " << parts[0].nshards - 1 << " of the same database exactly once" << endl;
+    return -1;
+  }
+
+  write_results (output, parts[0].path, results);
+  cout << "Merged " << parts.size() << " shards (" << results.size() << " images) into " << output << endl;
+
+  return 0;
+}
+
+/* ===============================================================================================
+   Usage
+   =============================================================================================== */
+int usage()
+{
+    cout << "\n\n" <<endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=                                      MergeResults                                            ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     This program merges the partial results of scanDatabase runs on each shard of a          ="  << endl;
+    cout << "     " << "=     database (-shard i/N) into a single ranked result file.                                  ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     Usage is:                                                                                ="  << endl;
+    cout << "     " << "=                 mergeResults.exe                                                             ="  << endl;
+    cout << "     " << "=                                 -o        <path to output file>                              ="  << endl;
+    cout << "     " << "=                                 <partial result file> ...                                    ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "\n\n" <<endl;
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Procedure to read in flag values: every argument that is not a flag is a partial result file
+   =============================================================================================== */
+void read_flags(int argc, char** argv, string *output, vector<string> *inputs)
+{
+  string input;
+  for(int i = 1; i < argc; i++)
+  {
+    input = argv[i];
+    if (input == "-o" && i + 1 < argc)
+      *output = argv[++i];
+    else
+      inputs->push_back (input);
+  }
+}
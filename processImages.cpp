@@ -3,6 +3,7 @@
 
   This program reads in an input directory contianing a set of images, processes them, 
   computes features and descriptors and outputs them to YAML format files in output directory
+  With -watch, it keeps running and processes the images as they are added to the directory
   
   	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
 
@@ -47,20 +48,110 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <algorithm>
+#include <deque>
+#include <map>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#include <cstdio>
+#include <climits>
+#include <csignal>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include <sys/inotify.h>
 
 #include "opencv2/highgui/highgui.hpp"
 #include "opencv2/calib3d/calib3d.hpp"
 #include "opencv2/features2d/features2d.hpp"
 #include "opencv2/nonfree/nonfree.hpp"
 
+#include "archv.hpp"
+#include "featurestore.hpp"
+
 using namespace std;
 using namespace cv;
+using namespace archv;
 
 int usage ();
-void read_flags(int argc, char** argv, string *path2dir, string *path2outdir, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin);
-void read_surfparams (string param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin);
-int get_filelist (string path, vector <string> &allfiles);
-void filter_keypoints (vector <KeyPoint> &keypoints, int sizemin, double responsemin);
+void read_flags(int argc, char** argv, string *path2dir, string *path2outdir, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin, int *interval, string *reportfile, string *codec, int *level, string *thumbdir, bool *watch, double *settle, int *nthreads);
+
+/* ===============================================================================================
+   Book-keeping for the run report: per-stage timings, keypoint counts, bytes written and the
+   slowest images seen so far
+   =============================================================================================== */
+struct ImageTiming
+{
+  string name;
+  int width, height;
+  double seconds;
+};
+
+struct RunStats
+{
+  int nimages;
+  double t_decode, t_thumbs, t_detect, t_describe, t_write;
+  double t_extract;             // fused extraction, when detection and description are one pass
+  long kp_detected, kp_kept;
+  long bytes_written;
+  StoreStats store;             // raw / stored sizes of the blocks of binary feature files
+  int64 start;
+  int64 last_tick;
+  int last_nimages;
+  vector <ImageTiming> slowest;
+};
+
+void init_runstats (RunStats &stats);
+void add_timing (RunStats &stats, const ImageTiming &timing, int nslow);
+void report_progress (RunStats &stats, int ntotal);
+void report_run (const RunStats &stats, string reportfile);
+long peak_rss_kb ();
+long file_size (string filename);
+string output_name (string imagefile, string path2outdir, string extension);
+
+/* ===============================================================================================
+   Watch mode: settings shared by the workers, the queue of images ready to be processed (fully
+   written), and the counts of the images processed so far
+   =============================================================================================== */
+struct WatchSettings
+{
+  string path2dir, path2outdir, extension, thumbdir;
+  const FeatureExtractor *extractor;
+  StoreOptions storeoptions;
+  bool binary;
+};
+
+class WatchQueue
+{
+public:
+  WatchQueue () : closed (false) {}
+  void push (const string &file);
+  bool pop (string &file);
+  void close ();
+
+private:
+  mutex lock;
+  condition_variable changed;
+  deque<string> files;
+  bool closed;
+};
+
+struct WatchStats
+{
+  mutex lock;
+  int nimages, failed;
+  long keypoints;
+  double seconds;
+};
+
+int  watch_directory (const WatchSettings &settings, double settle, int nthreads);
+void watch_worker (const WatchSettings &settings, WatchQueue *queue, WatchStats *stats);
+bool up_to_date (string imagefile, string featurefile);
 
 int main(int argc, char **argv)
 {
@@ -83,81 +174,155 @@ int main(int argc, char **argv)
   double responsemin = 100;
   string name, nameful;
   string extension = ".yml";
-
-  read_flags (argc, argv, &path2dir, &path2outdir, &param, &minh, &octaves, &layers, &sizemin, &responsemin);
+  int interval = 100;           // number of images between two progress reports
+  int nslow = 10;               // number of slowest images listed in the run report
+  string reportfile = "";
+  string codec = "";            // binary feature files (.akf) compressed with this codec
+  int level = 3;                // compression level (zstd)
+  string thumbdir = "";         // thumbnails of the images for the tools drawing results
+  bool watch = false;           // keep running, processing the images added to the directory
+  double settle = 2;            // seconds without change before a new file is considered written
+  int nthreads = 0;             // watch mode: worker threads, 0 for one per core
+
+  read_flags (argc, argv, &path2dir, &path2outdir, &param, &minh, &octaves, &layers, &sizemin, &responsemin, &interval, &reportfile, &codec, &level, &thumbdir, &watch, &settle, &nthreads);
+  if (interval < 1)
+    interval = 100;
+
+  StoreOptions storeoptions;
+  if (codec != "")
+  {
+    storeoptions.codec = parse_codec (codec);
+    storeoptions.level = level;
+    if (storeoptions.codec < 0 || !codec_available (storeoptions.codec))
+    {
+      cout << "codec " << codec << " is not available" << endl;
+      return -1;
+    }
+    extension = ".akf";
+  }
 
   if (param != "")
     read_surfparams (param, &minh, &octaves, &layers, &sizemin, &responsemin);
 
 /* ===============================================================================================
-   Create all structures needed for SURF key point detection and feature extraction
+   Create the feature extractor used for key point detection and feature extraction (SURF, or
+   the binary descriptor selected in the parameter file)
    =============================================================================================== */
-  SurfFeatureDetector detector (minh, octaves, layers);
-  Ptr<DescriptorExtractor> extractor = new SurfDescriptorExtractor();
-  vector <KeyPoint> keypoints;
-  Mat descriptors;
+  SurfParams params (minh, octaves, layers, sizemin, responsemin);
+  if (param != "")
+    read_descriptorparams (param, params);
+  FeatureExtractor extractor (params);
+  Features features;
 
+/* ===============================================================================================
+   With -watch, the images already processed are skipped and the program runs until it is
+   interrupted, processing new images with one extractor shared by a pool of workers
+   =============================================================================================== */
+  if (watch)
+  {
+    WatchSettings settings;
+    settings.path2dir = path2dir;
+    settings.path2outdir = path2outdir;
+    settings.extension = extension;
+    settings.thumbdir = thumbdir;
+    settings.extractor = &extractor;
+    settings.storeoptions = storeoptions;
+    settings.binary = codec != "";
+    return watch_directory (settings, settle, nthreads);
+  }
 
 /* ===============================================================================================
-   Got to input directory, (1) get the file list (2) keep only image files (.jpg extension)
+   Got to input directory and get the list of image files (.jpg extension)
    =============================================================================================== */
-  vector <string> allfiles;
-  vector <string> files; //remaining images
+  vector <string> files;
 
-  int error =  get_filelist (path2dir, allfiles);
+  int error =  get_imagelist (path2dir, files);
   if ( error != 0)
   {
     cout << "no files in directory" << endl;
     return -1;
   }
 
-  //filter for image files
-  for (int i = 0; i < allfiles.size(); i++)
-  {
-    string filename = allfiles[i];
-    if (filename.substr (filename.find_last_of(".") + 1) == "jpg")
-      files.push_back (filename);
-  }
-
 
 /* ===============================================================================================
    For each image file: 
       (1) generate output file name
-      (2) detect keypoints
-      (3) filter them
-      (4) compute descriptors
-      (5) write in YAML format the keypoints and descriptors to output file
+      (2) detect keypoints, (3) filter them, (4) compute descriptors: one call to the
+          extractor, which shares the grey level image and buffers between the steps, and
+          times detection and description apart unless it runs them as one (fused) pass
+      (5) write the keypoints and descriptors to output file, in YAML format or, with -c,
+          in binary format with the blocks compressed
+      (6) with -th, write the thumbnails of the image
+   Every stage is timed; a progress line with the ingestion rate is printed every "interval"
+   images and a full run report at the end
    =============================================================================================== */
+  RunStats stats;
+  init_runstats (stats);
+  double freq = getTickFrequency();
+  int64 t0, t1;
+
   for (int i = 0; i < files.size(); i++)
   {
-    if (i % 100 == 0  || i == files.size())
-      cout << "Processing image # " << setw(4) << i << " out of " << files.size() << " files" << endl;
+    if (i % interval == 0)
+      report_progress (stats, files.size());
 
     //read in image file and generate output file name
     name = path2dir + files[i];
-    nameful = files[i];
-    nameful.erase(nameful.find_last_of("."), string::npos);
-    nameful = path2outdir + nameful + extension;
+    nameful = output_name (files[i], path2outdir, extension);
+
+    ImageTiming timing;
+    timing.name = files[i];
+    int64 tstart = getTickCount();
+
+    t0 = getTickCount();
     Mat image = imread (name);
+    t1 = getTickCount();
+    stats.t_decode += (t1 - t0)/freq;
+    timing.width = image.cols;
+    timing.height = image.rows;
 
-    //SURF detection and then filter
-    detector.detect (image, keypoints);
-    //cout << "keypoints: " << keypoints.size();
-    filter_keypoints (keypoints, sizemin, responsemin);
-    //cout << "  after filter: " << keypoints.size() << endl;
+    //thumbnails, reduced from the image already decoded
+    if (thumbdir != "")
+    {
+      t0 = getTickCount();
+      write_thumbnails (image, thumbdir, files[i]);
+      t1 = getTickCount();
+      stats.t_thumbs += (t1 - t0)/freq;
+    }
 
-    //write into output file
-    FileStorage fs (nameful, FileStorage::WRITE);
-    fs << "keypoints" << keypoints;
-    if (keypoints.size() > 0)
+    //detection, filter and descriptors
+    t0 = getTickCount();
+    stats.kp_detected += extractor.extract (image, features, Mat(), &stats.t_detect, &stats.t_describe);
+    stats.kp_kept += features.keypoints.size();
+    t1 = getTickCount();
+    if (extractor.fused())
+      stats.t_extract += (t1 - t0)/freq;
+
+    //write into output file, under a temporary name renamed once complete: a keypoint file
+    //that exists is never partial, even if the run is interrupted (watch mode relies on it)
+    t0 = getTickCount();
+    string temp = output_name (files[i], path2outdir, ".tmp" + extension);
+    int ierr;
+    if (codec != "")
+      ierr = write_binary_features (temp, features, storeoptions, &stats.store);
+    else
+      ierr = write_features (temp, features);
+    if (ierr != 0 || rename (temp.c_str(), nameful.c_str()) != 0)
     {
-      extractor->compute (image, keypoints, descriptors);
-      fs << "descriptors" << descriptors;
+      cout << "could not write " << nameful << endl;
+      remove (temp.c_str());
     }
-    fs.release();
+    t1 = getTickCount();
+    stats.t_write += (t1 - t0)/freq;
+    stats.bytes_written += file_size (nameful);
+
+    timing.seconds = (t1 - tstart)/freq;
+    add_timing (stats, timing, nslow);
+    stats.nimages++;
   }
 
-  cout << "Processed all " << files.size() << " images, and placed the .yml files in " << path2outdir << endl;
+  cout << "Processed all " << files.size() << " images, and placed the " << extension << " files in " << path2outdir << endl;
+  report_run (stats, reportfile);
   return 0;
 }  
 
@@ -183,6 +348,14 @@ int usage()
     cout << "     " << "=                                 -i  <path to directory with images>                          ="  <<  endl;
     cout << "     " << "=                                 -o  <path to output directory for keypoints>                 ="  <<  endl;
     cout << "     " << "=                                 -p  <path to param file for SURF>                            ="  <<  endl;
+    cout << "     " << "=                                 -ri <number of images between progress reports> (100)        ="  <<  endl;
+    cout << "     " << "=                                 -rep <path to JSON file for the run report> (optional)       ="  <<  endl;
+    cout << "     " << "=                                 -c  <none|lz4|zstd: write compressed binary .akf files>      ="  <<  endl;
+    cout << "     " << "=                                 -cl <compression level for zstd> (3)                         ="  <<  endl;
+    cout << "     " << "=                                 -th <path to output directory for thumbnails> (optional)     ="  <<  endl;
+    cout << "     " << "=                                 -watch  keep running, process the images as they arrive      ="  <<  endl;
+    cout << "     " << "=                                 -settle <seconds without change of a new file> (2)           ="  <<  endl;
+    cout << "     " << "=                                 -t  <number of threads in watch mode> (one per core)         ="  <<  endl;
     cout << "     " << "=                                                                                              ="  <<  endl;
     cout << "     " << "================================================================================================"  <<  endl;
     cout << "     " << "================================================================================================"  <<  endl;
@@ -197,7 +370,7 @@ int usage()
 /* ===============================================================================================
    Procedure to parse the command line options for the program
    =============================================================================================== */
-void read_flags(int argc, char** argv, string *path2dir, string *path2outdir, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin)
+void read_flags(int argc, char** argv, string *path2dir, string *path2outdir, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin, int *interval, string *reportfile, string *codec, int *level, string *thumbdir, bool *watch, double *settle, int *nthreads)
 {
   string input;
   for(int i = 1; i < argc; i++)
@@ -209,6 +382,22 @@ void read_flags(int argc, char** argv, string *path2dir, string *path2outdir, st
       *path2outdir = argv[i + 1];
     if (input == "-p")
       *param = argv[i + 1];
+    if (input == "-ri")
+      *interval = atoi(argv[i + 1]);
+    if (input == "-rep")
+      *reportfile = argv[i + 1];
+    if (input == "-c")
+      *codec = argv[i + 1];
+    if (input == "-cl")
+      *level = atoi(argv[i + 1]);
+    if (input == "-th")
+      *thumbdir = argv[i + 1];
+    if (input == "-watch")
+      *watch = true;
+    if (input == "-settle")
+      *settle = atof(argv[i + 1]);
+    if (input == "-t")
+      *nthreads = atoi(argv[i + 1]);
 
     if (input == "-h")
       *minh = atoi(argv[i+1]);
@@ -226,97 +415,416 @@ void read_flags(int argc, char** argv, string *path2dir, string *path2outdir, st
 
 
 /* ===============================================================================================
-   Procedure to read parameters for SURF from the parameter file
+   Procedure to reset the run statistics
    =============================================================================================== */
-void read_surfparams(string param, int *minHessian, int *octaves, int *octaveLayers, int *SizeMin, double *RespMin)
+void init_runstats (RunStats &stats)
 {
-  ifstream inFile;
-  inFile.open(param.c_str());
-	string record;
-	stringstream ss;
-
-	while ( !inFile.eof () ) {    
-		getline(inFile,record);
-		if (record.find("minHessian") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *minHessian;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("octaves") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *octaves;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("octaveLayers") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *octaveLayers;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("min Size") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *SizeMin;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("min Resp") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *RespMin;
-			ss.str("");
-			ss.clear();
-		}
-	}
+  stats.nimages = 0;
+  stats.t_decode = stats.t_thumbs = stats.t_detect = stats.t_describe = stats.t_extract = stats.t_write = 0;
+  stats.kp_detected = stats.kp_kept = 0;
+  stats.bytes_written = 0;
+  stats.store = StoreStats();
+  stats.start = getTickCount();
+  stats.last_tick = stats.start;
+  stats.last_nimages = 0;
+  stats.slowest.clear();
 }
 
 
+
 /* ===============================================================================================
-   Procedure to extract list of files from a directory
+   Procedure to record the timing of one image; only the "nslow" slowest images are kept,
+   sorted from slowest to fastest
    =============================================================================================== */
-int get_filelist (string path, vector <string> &allfiles)
+void add_timing (RunStats &stats, const ImageTiming &timing, int nslow)
 {
- //uses dirent.h to get the name of all the files within a directory
-  DIR *dp; //directory stream
-  struct dirent *entry; //directoryentry
+  vector <ImageTiming> &slowest = stats.slowest;
 
-  if ((dp = opendir (path.c_str())) == NULL)
-    return -1;
+  if (slowest.size() == nslow && timing.seconds <= slowest.back().seconds)
+    return;
 
-  while ((entry = readdir(dp)) != NULL)
-    allfiles.push_back (string (entry->d_name));
+  int pos = slowest.size();
+  while (pos > 0 && slowest[pos-1].seconds < timing.seconds)
+    pos--;
+  slowest.insert (slowest.begin() + pos, timing);
 
-  closedir (dp);
-  return 0;
+  if (slowest.size() > nslow)
+    slowest.pop_back();
 }
 
 
 
 /* ===============================================================================================
-   Procedure to filter the keypoints from the keypoint vector by minimum size and response
+   Procedure to print a progress line: overall ingestion rate, rate since the last report and
+   current peak memory
    =============================================================================================== */
-void filter_keypoints (vector <KeyPoint> &keypoints, int sizemin, double responsemin)
+void report_progress (RunStats &stats, int ntotal)
 {
-  vector <KeyPoint> temp;
-  int npoints = keypoints.size();
-  int size;
-  double response;
+  int64 now = getTickCount();
+  double freq = getTickFrequency();
+  double elapsed = (now - stats.start)/freq;
+  double window = (now - stats.last_tick)/freq;
 
-  //filter based on size and response size
-  for (int i = 0; i < npoints; i++)
+  cout << "Processing image # " << setw(4) << stats.nimages << " out of " << ntotal << " files";
+  if (stats.nimages > 0)
   {
-    size = keypoints[i].size;
-    response = keypoints[i].response;
-    if (size > sizemin && response > responsemin)
-      temp.push_back(keypoints[i]);
+    cout << fixed << setprecision(2);
+    cout << "  |  " << stats.nimages/elapsed << " img/s overall";
+    if (window > 0)
+      cout << ", " << (stats.nimages - stats.last_nimages)/window << " img/s last " << stats.nimages - stats.last_nimages;
+    cout << ", " << stats.kp_kept/stats.nimages << " kpts/img";
+    cout << ", peak RSS " << peak_rss_kb()/1024 << " MB";
+    cout.unsetf (ios::floatfield);
   }
+  cout << endl;
 
-  keypoints.clear();
-  keypoints = temp;
+  stats.last_tick = now;
+  stats.last_nimages = stats.nimages;
+}
 
-  return;
+
+
+/* ===============================================================================================
+   Procedure to print the final run report, and optionally write it in JSON format to a file
+   =============================================================================================== */
+void report_run (const RunStats &stats, string reportfile)
+{
+  double elapsed = (getTickCount() - stats.start)/getTickFrequency();
+  double rate = elapsed > 0 ? stats.nimages/elapsed : 0;
+  double total = stats.t_decode + stats.t_thumbs + stats.t_detect + stats.t_describe + stats.t_extract + stats.t_write;
+  if (total <= 0)
+    total = 1;
+  long rss = peak_rss_kb();
+
+  cout << endl;
+  cout << "Run report" << endl;
+  cout << fixed << setprecision(3);
+  cout << "  images processed     : " << stats.nimages << " in " << elapsed << " s (" << rate << " img/s)" << endl;
+  cout << "  decode time          : " << stats.t_decode << " s (" << 100*stats.t_decode/total << " %)" << endl;
+  if (stats.t_thumbs > 0)
+    cout << "  thumbnail time       : " << stats.t_thumbs << " s (" << 100*stats.t_thumbs/total << " %)" << endl;
+  if (stats.t_extract > 0)
+    cout << "  fused extraction time: " << stats.t_extract << " s (" << 100*stats.t_extract/total << " %)" << endl;
+  else
+  {
+    cout << "  detect + filter time : " << stats.t_detect << " s (" << 100*stats.t_detect/total << " %)" << endl;
+    cout << "  describe time        : " << stats.t_describe << " s (" << 100*stats.t_describe/total << " %)" << endl;
+  }
+  cout << "  write time           : " << stats.t_write << " s (" << 100*stats.t_write/total << " %)" << endl;
+  cout << "  keypoints detected   : " << stats.kp_detected << endl;
+  cout << "  keypoints kept       : " << stats.kp_kept << endl;
+  cout << "  bytes written        : " << stats.bytes_written << endl;
+  if (stats.store.storedBytes > 0)
+    cout << "  compression ratio    : " << stats.store.ratio() << " (" << stats.store.rawBytes << " raw bytes, encoded in " << stats.store.seconds << " s)" << endl;
+  cout << "  peak RSS             : " << rss << " kB" << endl;
+  cout << "  slowest images       :" << endl;
+  for (int i = 0; i < stats.slowest.size(); i++)
+    cout << "      " << stats.slowest[i].seconds << " s  " << stats.slowest[i].width << "x" << stats.slowest[i].height << "  " << stats.slowest[i].name << endl;
+  cout.unsetf (ios::floatfield);
+
+  if (reportfile == "")
+    return;
+
+  ofstream json (reportfile.c_str());
+  json << "{\"images\":" << stats.nimages;
+  json << ", \"elapsed\":" << elapsed;
+  json << ", \"images_per_sec\":" << rate;
+  json << ", \"time\":{\"decode\":" << stats.t_decode << ", \"thumbnails\":" << stats.t_thumbs << ", \"detect\":" << stats.t_detect;
+  json << ", \"describe\":" << stats.t_describe;
+  if (stats.t_extract > 0)
+    json << ", \"extract\":" << stats.t_extract;
+  json << ", \"write\":" << stats.t_write << "}";
+  json << ", \"keypoints_detected\":" << stats.kp_detected;
+  json << ", \"keypoints_kept\":" << stats.kp_kept;
+  json << ", \"bytes_written\":" << stats.bytes_written;
+  json << ", \"raw_bytes\":" << stats.store.rawBytes;
+  json << ", \"compression_ratio\":" << stats.store.ratio();
+  json << ", \"peak_rss_kb\":" << rss;
+  json << ", \"slowest\":[";
+  for (int i = 0; i < stats.slowest.size(); i++)
+  {
+    if (i != 0)
+      json << ",";
+    json << "{\"name\":\"" << stats.slowest[i].name << "\", \"seconds\":" << stats.slowest[i].seconds;
+    json << ", \"width\":" << stats.slowest[i].width << ", \"height\":" << stats.slowest[i].height << "}";
+  }
+  json << "]}" << endl;
+  json.close();
 }
 
 
 
-  
+/* ===============================================================================================
+   Procedure returning the peak resident set size of the process, in kB
+   =============================================================================================== */
+long peak_rss_kb ()
+{
+  struct rusage usage;
+  if (getrusage (RUSAGE_SELF, &usage) != 0)
+    return 0;
+  return usage.ru_maxrss;
+}
+
+
+
+/* ===============================================================================================
+   Procedure returning the size of a file in bytes (0 if it does not exist)
+   =============================================================================================== */
+long file_size (string filename)
+{
+  struct stat sb;
+  if (stat (filename.c_str(), &sb) != 0)
+    return 0;
+  return sb.st_size;
+}
+
+/* ===============================================================================================
+   Procedure returning the name of the keypoint file of an image
+   =============================================================================================== */
+string output_name (string imagefile, string path2outdir, string extension)
+{
+  return path2outdir + imagefile.substr (0, imagefile.find_last_of (".")) + extension;
+}
+
+/* ===============================================================================================
+   Procedure telling whether the keypoint file of an image exists and is not older than it.
+   Keypoint files are written under a temporary name and renamed, so one that exists is complete
+   =============================================================================================== */
+bool up_to_date (string imagefile, string featurefile)
+{
+  struct stat image, features;
+  if (stat (imagefile.c_str(), &image) != 0 || stat (featurefile.c_str(), &features) != 0)
+    return false;
+  return features.st_mtime >= image.st_mtime;
+}
+
+/* ===============================================================================================
+   Queue of the images ready to be processed: pop() waits for one, and returns false once the
+   queue is closed and empty
+   =============================================================================================== */
+void WatchQueue::push (const string &file)
+{
+  {
+    lock_guard<mutex> guard (lock);
+    files.push_back (file);
+  }
+  changed.notify_one();
+}
+
+bool WatchQueue::pop (string &file)
+{
+  unique_lock<mutex> guard (lock);
+  while (!closed && files.empty())
+    changed.wait (guard);
+  if (files.empty())
+    return false;
+  file = files.front();
+  files.pop_front();
+  return true;
+}
+
+void WatchQueue::close ()
+{
+  {
+    lock_guard<mutex> guard (lock);
+    closed = true;
+  }
+  changed.notify_all();
+}
+
+/* ===============================================================================================
+   Worker of the watch mode: processes the images of the queue with the shared extractor, and
+   writes each keypoint file under a temporary name (same extension, from which FileStorage
+   picks the format) renamed once complete, so that readers never see a partial file
+   =============================================================================================== */
+void watch_worker (const WatchSettings &settings, WatchQueue *queue, WatchStats *stats)
+{
+  Features features;
+  string file;
+  double freq = getTickFrequency();
+  while (queue->pop (file))
+  {
+    int64 t0 = getTickCount();
+    string nameful = output_name (file, settings.path2outdir, settings.extension);
+    string temp = output_name (file, settings.path2outdir, ".tmp" + settings.extension);
+
+    Mat image = imread (settings.path2dir + file);
+    int ierr = -1;
+    if (!image.empty())
+    {
+      if (settings.thumbdir != "")
+        write_thumbnails (image, settings.thumbdir, file);
+      settings.extractor->extract (image, features);
+      if (settings.binary)
+        ierr = write_binary_features (temp, features, settings.storeoptions);
+      else
+        ierr = write_features (temp, features);
+      if (ierr == 0)
+        ierr = rename (temp.c_str(), nameful.c_str());
+      if (ierr != 0)
+        remove (temp.c_str());
+    }
+    double seconds = (getTickCount() - t0)/freq;
+
+    lock_guard<mutex> guard (stats->lock);
+    if (ierr != 0)
+    {
+      cout << "could not process " << file << endl;
+      stats->failed++;
+      continue;
+    }
+    cout << "Processed " << file << ": " << features.keypoints.size() << " keypoints in " << seconds << " s" << endl;
+    stats->nimages++;
+    stats->keypoints += features.keypoints.size();
+    stats->seconds += seconds;
+  }
+}
+
+/* ===============================================================================================
+   Watch mode. The directory is watched with inotify; every event on a .jpg file (created,
+   written, closed or moved in) marks it as pending. A pending file is queued once it has seen
+   no event for "settle" seconds and its size is unchanged since the previous check, so files
+   still being copied are not read. At start, the images without an up-to-date keypoint file
+   are pending too, and the others are skipped: a restart does not process anything twice.
+   Runs until SIGINT or SIGTERM; the images already queued are finished before returning
+   =============================================================================================== */
+static volatile sig_atomic_t interrupted = 0;
+
+static void stop_watching (int)
+{
+  interrupted = 1;
+}
+
+struct PendingFile
+{
+  int64 tick;
+  long size;
+};
+
+static void mark_pending (map<string,PendingFile> &pending, const string &file)
+{
+  PendingFile &entry = pending[file];
+  entry.tick = getTickCount();
+  entry.size = -1;
+}
+
+static void scan_pending (const WatchSettings &settings, map<string,PendingFile> &pending, int *skipped)
+{
+  vector<string> files;
+  get_imagelist (settings.path2dir, files);
+  sort (files.begin(), files.end());
+  for (int i = 0; i < files.size(); i++)
+  {
+    if (up_to_date (settings.path2dir + files[i], output_name (files[i], settings.path2outdir, settings.extension)))
+      (*skipped)++;
+    else if (pending.count (files[i]) == 0)
+      mark_pending (pending, files[i]);
+  }
+}
+
+int watch_directory (const WatchSettings &settings, double settle, int nthreads)
+{
+  // thumbnails written into the watched directory would be taken for new images
+  char watched[PATH_MAX], thumbs[PATH_MAX];
+  if (settings.thumbdir != "" && realpath (settings.path2dir.c_str(), watched) != NULL && realpath (settings.thumbdir.c_str(), thumbs) != NULL
+      && string (watched) == string (thumbs))
+  {
+    cout << "the thumbnails (-th) cannot be written to the watched directory " << settings.path2dir << endl;
+    return -1;
+  }
+
+  int fd = inotify_init ();
+  if (fd < 0 || inotify_add_watch (fd, settings.path2dir.c_str(), IN_CREATE | IN_MODIFY | IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+  {
+    cout << "cannot watch " << settings.path2dir << endl;
+    if (fd >= 0)
+      close (fd);
+    return -1;
+  }
+  signal (SIGINT, stop_watching);
+  signal (SIGTERM, stop_watching);
+
+  map<string,PendingFile> pending;
+  int skipped = 0;
+  scan_pending (settings, pending, &skipped);
+
+  if (nthreads <= 0)
+    nthreads = default_threads();
+  WatchQueue queue;
+  WatchStats stats;
+  stats.nimages = stats.failed = 0;
+  stats.keypoints = 0;
+  stats.seconds = 0;
+  vector<thread> workers;
+  for (int t = 0; t < nthreads; t++)
+    workers.push_back (thread (watch_worker, cref (settings), &queue, &stats));
+
+  cout << "Watching " << settings.path2dir << " with " << nthreads << " workers: " << skipped << " images already processed, ";
+  cout << pending.size() << " to process (interrupt to stop)" << endl;
+
+  double freq = getTickFrequency();
+  char buffer[64*1024] __attribute__ ((aligned (__alignof__ (struct inotify_event))));
+  while (!interrupted)
+  {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    pfd.revents = 0;
+    if (poll (&pfd, 1, 250) > 0 && (pfd.revents & POLLIN))
+    {
+      ssize_t length = read (fd, buffer, sizeof (buffer));
+      for (char *p = buffer; length > 0 && p < buffer + length; )
+      {
+        const struct inotify_event *event = (const struct inotify_event *) p;
+        p += sizeof (struct inotify_event) + event->len;
+
+        // events were lost: look at the whole directory again
+        if (event->mask & IN_Q_OVERFLOW)
+          scan_pending (settings, pending, &skipped);
+        if (event->len == 0)
+          continue;
+        string file = event->name;
+        if (file.substr (file.find_last_of (".") + 1) == "jpg")
+          mark_pending (pending, file);
+      }
+    }
+
+    // queue the pending files that have settled; those that disappeared are forgotten
+    int64 now = getTickCount();
+    for (map<string,PendingFile>::iterator it = pending.begin(); it != pending.end(); )
+    {
+      if ((now - it->second.tick)/freq < settle)
+      {
+        ++it;
+        continue;
+      }
+      struct stat sb;
+      if (stat ((settings.path2dir + it->first).c_str(), &sb) != 0)
+      {
+        pending.erase (it++);
+        continue;
+      }
+      if (sb.st_size > 0 && sb.st_size == it->second.size)
+      {
+        queue.push (it->first);
+        pending.erase (it++);
+        continue;
+      }
+      it->second.size = sb.st_size;
+      it->second.tick = now;
+      ++it;
+    }
+  }
+
+  cout << "Stopping: finishing the images already queued" << endl;
+  queue.close();
+  for (int t = 0; t < workers.size(); t++)
+    workers[t].join();
+  close (fd);
+
+  cout << "Processed " << stats.nimages << " images (" << stats.failed << " failed)";
+  if (stats.nimages > 0)
+    cout << ", " << stats.keypoints/stats.nimages << " keypoints and " << stats.seconds/stats.nimages << " s per image";
+  cout << "; " << pending.size() << " files were still being written" << endl;
+  return stats.failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,403 @@
+/* ============================================================================================
+  reduceDescriptors.cpp            Version 1           Last Update: 10/19/2026
+
+  This program reduces the SURF descriptors of a collection to their first principal
+  components. It trains the projection (PCA, optionally whitened) on the descriptors of a
+  sample of the keypoint files, or reads one, and reports on the sample what the reduction
+  saves and costs: descriptor bytes per image, time per query, and the share of the top hits
+  of full-size queries still found with reduced descriptors. It can then write reduced
+  keypoint files for the whole collection, which scanDatabase queries with -pca.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+
+#include <sys/types.h>
+#include <sys/stat.h>
+
+#include "archv.hpp"
+#include "featurestore.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace archv;
+
+int  usage();
+void read_flags(int argc, char** argv, string *imgdir, string *infodir, int *dims, bool *whiten, int *nsample, int *ntrain, string *writefile, string *readfile, int *nseeds, int *top, string *outdir, int *nthreads);
+long file_size (string filename);
+
+/* ===============================================================================================
+   Ranking of the sample by a seed of the sample: number of matches of every image, and the
+   images of the top "top" with more than one match, best first (ties by sample order)
+   =============================================================================================== */
+static vector<int> top_images (const vector<Features> &sample, int seed, int top, double *seconds)
+{
+  vector<DMatch> matches;
+  vector< pair<int,int> > counts;
+  int64 t0 = getTickCount();
+  for (int i = 0; i < sample.size(); i++)
+    counts.push_back (make_pair (-match_features (sample[seed], sample[i], matches), i));
+  *seconds += (getTickCount() - t0)/getTickFrequency();
+
+  sort (counts.begin(), counts.end());
+  vector<int> images;
+  for (int r = 0; r < counts.size() && images.size() < top && -counts[r].first > 1; r++)
+    images.push_back (counts[r].second);
+  return images;
+}
+
+/* ===============================================================================================
+   Reduction of the keypoint files of the collection: each file is read, its descriptors
+   projected, and the result written in the same format under a temporary name, then renamed
+   =============================================================================================== */
+class ReduceBody : public ParallelLoopBody
+{
+public:
+  ReduceBody (const Corpus &c, const Projection &p, string o, vector<long> &i, vector<long> &w)
+    : corpus (c), projection (p), outdir (o), bytesIn (i), bytesOut (w) {}
+
+  void operator() (const Range &range) const
+  {
+    Features features;
+    Mat reduced;
+    for (int i = range.start; i < range.end; i++)
+    {
+      bytesIn[i] = bytesOut[i] = 0;
+      string input = corpus.featurefile (i);
+      if (read_features (input, features) != 0)
+        continue;
+
+      // only float descriptors of the width of the projection (reported as not reduced otherwise)
+      const Mat &descriptors = features.descriptors;
+      if (!descriptors.empty() && (descriptors.type() != CV_32F || descriptors.cols != projection.basis.cols))
+        continue;
+
+      project_descriptors (projection, features.descriptors, reduced);
+      features.descriptors = reduced.clone();
+
+      string output = outdir + input.substr (input.find_last_of ("/") + 1);
+      // the temporary name keeps the extension, from which FileStorage picks the format
+      string temp = output.substr (0, output.find_last_of (".")) + ".tmp" + output.substr (output.find_last_of ("."));
+      int ierr = is_binary_featurefile (input) ? write_binary_features (temp, features) : write_features (temp, features);
+      if (ierr != 0 || rename (temp.c_str(), output.c_str()) != 0)
+      {
+        remove (temp.c_str());
+        continue;
+      }
+      bytesIn[i] = file_size (input);
+      bytesOut[i] = file_size (output);
+    }
+  }
+
+private:
+  const Corpus &corpus;
+  const Projection &projection;
+  string outdir;
+  vector<long> &bytesIn;
+  vector<long> &bytesOut;
+};
+
+int main(int argc, char** argv)
+{
+/* ===============================================================================================
+   Show usage if needed
+   =============================================================================================== */
+  if (argc < 2)
+    return usage();
+
+  string input = argv[1];
+  if( input == "-h" || input == "-help" )
+    return usage();
+
+  string imgdir, infodir;
+  int dims = 32;                // components kept
+  bool whiten = false;
+  int nsample = 200;            // sample images, for training and evaluation
+  int ntrain = 100000;          // most descriptors used for training
+  string writefile = "";        // projection file written
+  string readfile = "";         // projection file used instead of training
+  int nseeds = 20;              // sample images queried against the sample
+  int top = 10;
+  string outdir = "";           // directory of the reduced keypoint files
+  int nthreads = 0;
+
+  read_flags (argc, argv, &imgdir, &infodir, &dims, &whiten, &nsample, &ntrain, &writefile, &readfile, &nseeds, &top, &outdir, &nthreads);
+  if (dims < 1 || nsample < 1 || ntrain < 1 || nseeds < 1 || top < 1)
+  {
+    cout << "-dim, -n, -s, -seeds and -top must be at least 1" << endl;
+    return -1;
+  }
+
+  Corpus corpus;
+  if (imgdir == "" || corpus.open (imgdir, infodir) != 0 || corpus.size() == 0)
+  {
+    cout << "no images in " << imgdir << endl;
+    return usage();
+  }
+
+/* ===============================================================================================
+   The sample: keypoint files spread over the collection, read into memory
+   =============================================================================================== */
+  vector<Features> sample;
+  int step = corpus.size() > nsample ? corpus.size()/nsample : 1;
+  long nrows = 0;
+  for (int i = 0; i < corpus.size() && sample.size() < nsample; i += step)
+  {
+    Features features;
+    if (read_features (corpus.featurefile (i), features) != 0 || features.descriptors.empty())
+      continue;
+    if (features.descriptors.type() != CV_32F)
+    {
+      cout << corpus.featurefile (i) << ": the descriptors are not float (SURF); binary descriptors are not reduced" << endl;
+      return -1;
+    }
+    nrows += features.descriptors.rows;
+    sample.push_back (features);
+  }
+  if (sample.size() == 0)
+  {
+    cout << "no descriptors in " << infodir << endl;
+    return -1;
+  }
+  int width = sample[0].descriptors.cols;
+
+/* ===============================================================================================
+   The projection: read, or trained on every k-th descriptor of the sample
+   =============================================================================================== */
+  Projection projection;
+  if (readfile != "")
+  {
+    if (read_projection (readfile, projection) != 0 || projection.mean.cols != width)
+    {
+      cout << "could not read a projection of " << width << "-dimensional descriptors from " << readfile << endl;
+      return -1;
+    }
+    cout << "Projection read from " << readfile << ": " << projection.dims() << " components" << endl;
+  }
+  else
+  {
+    int every = nrows > ntrain ? (nrows + ntrain - 1)/ntrain : 1;
+    Mat training;
+    long row = 0;
+    for (int s = 0; s < sample.size(); s++)
+      for (int r = 0; r < sample[s].descriptors.rows; r++, row++)
+        if (row % every == 0)
+          training.push_back (sample[s].descriptors.row (r));
+
+    int64 t0 = getTickCount();
+    double explained = train_projection (training, dims, whiten, projection);
+    cout << "Trained on " << training.rows << " descriptors of " << sample.size() << " images in " << (getTickCount() - t0)/getTickFrequency() << " s: ";
+    cout << projection.dims() << " of " << width << " components" << (whiten ? " (whitened)" : "") << " keep " << 100*explained << " % of the variance" << endl;
+
+    if (writefile != "")
+    {
+      if (write_projection (writefile, projection) != 0)
+      {
+        cout << "could not write " << writefile << endl;
+        return -1;
+      }
+      cout << "Projection written to " << writefile << endl;
+    }
+  }
+
+/* ===============================================================================================
+   Evaluation on the sample: every seed is matched with the whole sample, with full and with
+   reduced descriptors; the top hits of the full query are looked for in the reduced one
+   =============================================================================================== */
+  vector<Features> reduced (sample.size());
+  long bytesFull = 0, bytesReduced = 0;
+  for (int s = 0; s < sample.size(); s++)
+  {
+    reduced[s].keypoints = sample[s].keypoints;
+    project_descriptors (projection, sample[s].descriptors, reduced[s].descriptors);
+    bytesFull += sample[s].descriptors.total()*sample[s].descriptors.elemSize();
+    bytesReduced += reduced[s].descriptors.total()*reduced[s].descriptors.elemSize();
+  }
+
+  double secondsFull = 0, secondsReduced = 0, recall = 0;
+  int identical = 0;
+  int seedstep = sample.size() > nseeds ? sample.size()/nseeds : 1;
+  int n = 0;
+  for (int s = 0; s < sample.size() && n < nseeds; s += seedstep, n++)
+  {
+    vector<int> full = top_images (sample, s, top, &secondsFull);
+    vector<int> small = top_images (reduced, s, top, &secondsReduced);
+    if (full == small)
+      identical++;
+    set<int> found (small.begin(), small.end());
+    int nfound = 0;
+    for (int r = 0; r < full.size(); r++)
+      nfound += found.count (full[r]);
+    recall += full.size() > 0 ? (double) nfound/full.size() : 1;
+  }
+
+  int nimages = sample.size();
+  cout << endl;
+  cout << "descriptors   dims   bytes/image   ms/query   top " << top << " recall   identical top " << top << endl;
+  cout << fixed << setprecision(1);
+  cout << "full      " << setw(9) << width << setw(14) << (double) bytesFull/nimages << setw(11) << 1000*secondsFull/n;
+  cout << setprecision(3) << setw(15) << 1.0 << setw(13) << n << " / " << n << endl;
+  cout << setprecision(1);
+  cout << "reduced   " << setw(9) << projection.dims() << setw(14) << (double) bytesReduced/nimages << setw(11) << 1000*secondsReduced/n;
+  cout << setprecision(3) << setw(15) << recall/n << setw(13) << identical << " / " << n << endl;
+  cout.unsetf (ios::floatfield);
+  cout << "(" << n << " seeds queried against the " << nimages << " sample images)" << endl;
+
+/* ===============================================================================================
+   Reduced keypoint files for the whole collection
+   =============================================================================================== */
+  if (outdir == "")
+    return 0;
+  if (*outdir.rbegin() != '/')
+    outdir.append ("/");
+
+  vector<long> bytesIn (corpus.size()), bytesOut (corpus.size());
+  int64 t0 = getTickCount();
+  run_parallel (Range (0, corpus.size()), ReduceBody (corpus, projection, outdir, bytesIn, bytesOut), nthreads);
+
+  long totalIn = 0, totalOut = 0;
+  int failed = 0;
+  for (int i = 0; i < corpus.size(); i++)
+  {
+    if (bytesOut[i] == 0)
+    {
+      cout << "could not reduce " << corpus.featurefile (i) << endl;
+      failed++;
+    }
+    totalIn += bytesIn[i];
+    totalOut += bytesOut[i];
+  }
+  cout << endl << "Wrote " << corpus.size() - failed << " reduced keypoint files to " << outdir << " in " << (getTickCount() - t0)/getTickFrequency() << " s: ";
+  cout << totalOut << " bytes instead of " << totalIn;
+  if (totalOut > 0)
+    cout << " (" << (double) totalIn/totalOut << "x smaller)";
+  cout << endl;
+
+  return failed == 0 ? 0 : -1;
+}
+
+/* ===============================================================================================
+   Usage
+   =============================================================================================== */
+int usage()
+{
+    cout << "\n\n" <<endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=                                     ReduceDescriptors                                        ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     This program trains a PCA projection of the SURF descriptors of a collection, reports    ="  << endl;
+    cout << "     " << "=     the storage, speed and recall of reduced descriptors on a sample, and writes reduced     ="  << endl;
+    cout << "     " << "=     keypoint files (to query with scanDatabase -pca).                                        ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     Usage is:                                                                                ="  << endl;
+    cout << "     " << "=                 reduceDescriptors.exe                                                        ="  << endl;
+    cout << "     " << "=                                 -d        <path to directory with images>                    ="  << endl;
+    cout << "     " << "=                                 -k        <path to directory with keypoints of images>       ="  << endl;
+    cout << "     " << "=                                 -dim      <number of components kept> (32)                   ="  << endl;
+    cout << "     " << "=                                 -white    <whiten the components> (off)                      ="  << endl;
+    cout << "     " << "=                                 -n        <number of sample images> (200)                    ="  << endl;
+    cout << "     " << "=                                 -s        <most descriptors used for training> (100000)      ="  << endl;
+    cout << "     " << "=                                 -w        <path for the projection file> (optional)          ="  << endl;
+    cout << "     " << "=                                 -r        <projection file to use instead of training>       ="  << endl;
+    cout << "     " << "=                                 -seeds    <number of sample images queried> (20)             ="  << endl;
+    cout << "     " << "=                                 -top      <number of top hits compared> (10)                 ="  << endl;
+    cout << "     " << "=                                 -o        <directory for the reduced keypoint files>         ="  << endl;
+    cout << "     " << "=                                 -t        <number of threads> (one per core)                 ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "\n\n" <<endl;
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Procedure to read in flag values
+   =============================================================================================== */
+void read_flags(int argc, char** argv, string *imgdir, string *infodir, int *dims, bool *whiten, int *nsample, int *ntrain, string *writefile, string *readfile, int *nseeds, int *top, string *outdir, int *nthreads)
+{
+  string input;
+  for(int i = 1; i < argc; i++)
+  {
+    input = argv[i];
+    if (input == "-d")
+      *imgdir = argv[i + 1];
+    if (input == "-k")
+      *infodir = argv[i + 1];
+    if (input == "-dim")
+      *dims = atoi(argv[i + 1]);
+    if (input == "-white")
+      *whiten = true;
+    if (input == "-n")
+      *nsample = atoi(argv[i + 1]);
+    if (input == "-s")
+      *ntrain = atoi(argv[i + 1]);
+    if (input == "-w")
+      *writefile = argv[i + 1];
+    if (input == "-r")
+      *readfile = argv[i + 1];
+    if (input == "-seeds")
+      *nseeds = atoi(argv[i + 1]);
+    if (input == "-top")
+      *top = atoi(argv[i + 1]);
+    if (input == "-o")
+      *outdir = argv[i + 1];
+    if (input == "-t")
+      *nthreads = atoi(argv[i + 1]);
+  }
+}
+
+/* ===============================================================================================
+   Size of a file in bytes (0 if it does not exist)
+   =============================================================================================== */
+long file_size (string filename)
+{
+  struct stat sb;
+  if (stat (filename.c_str(), &sb) != 0)
+    return 0;
+  return sb.st_size;
+}
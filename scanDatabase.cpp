@@ -54,31 +54,28 @@
 
 #include <fstream>
 #include <iostream>
+#include <algorithm>
 
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <dirent.h>
 #include <errno.h>
 
-#include <algorithm>  // for sort algorithm
+#include "archv.hpp"
+#include "featurestore.hpp"
+#include "hammingindex.hpp"
+
 using namespace cv;
 using namespace std;
+using namespace archv;
 
 
 int  usage();
-void read_flags(int argc, char** argv, string *imgfile, string *imgdir, string *infodir, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin);
-void read_surfparams(string param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin);
-int GetFileList(string directory, vector<string> &files);
+void read_flags(int argc, char** argv, string *imgfile, string *imgdir, string *infodir, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin, string *shardspec, int *prefetch, int *prefetchThreads, string *seedlist, double *budget, string *roi, string *polygonfile, int *savematches, int *lshcandidates, int *lshradius, int *coarseKeypoints, int *coarseMatches, int *rerank, int *batch, string *pcafile);
+int  build_index (const Corpus &corpus, int shard, int nshards, HammingIndex &index);
 
-void filter_keypoints (vector<KeyPoint>& keypoints, int sizemin, double responsemin);
 void showkeypts(vector<KeyPoint>& keypoints, Mat& drawImg);
 
-int ratioTest(vector<vector<cv::DMatch> > &matches, double ratio);
-void symmetryTest(const vector<vector<DMatch> >& matches1,const vector<vector<DMatch> >& matches2,vector<DMatch>& symMatches);
-Mat ransacTest(const vector<cv::DMatch>& matches,const vector<cv::KeyPoint>& keypoints1, const vector<cv::KeyPoint>& keypoints2, vector<cv::DMatch>& outMatches);
-
-Mat CombineImages(int nimage, Mat images[], string titles[]);
-vector<int> ordered(vector<double> const & values, int nval);
 
 
 int main(int argc, char** argv)
@@ -107,51 +104,55 @@ int main(int argc, char** argv)
   double responsemin = 100;
   double scale = 1;
   double ratio = 0.8;
-
-  read_flags (argc, argv, &imgfile, &imgdir, &infodir, &output, &param, &minh, &octaves, &layers, &sizemin, &responsemin);
+  string shardspec = "";
+  int shard = 0, nshards = 1;
+  int prefetch = 8;             // number of keypoint files read ahead of the matcher
+  int prefetchThreads = 2;      // number of threads reading them
+  string seedlist = "";         // file listing seed images, one query each (batch mode)
+  double budget = 0;            // memory budget of the feature cache, in MB (0: no cache)
+  string roi = "";              // region of the seed image to search for: x,y,w,h
+  string polygonfile = "";      // or a polygon, one vertex per line
+  int savematches = 0;          // number of top hits whose matches are saved for drawMatches
+  int lshcandidates = 0;        // binary descriptors: only match the N images with most votes in the index
+  int lshradius = 0;            // Hamming radius of a vote (0: a sixth of the descriptor bits)
+  int coarseKeypoints = 0;      // progressive matching: strongest seed keypoints matched first (0: off)
+  int coarseMatches = 2;        // coarse matches an image needs to be matched with the whole seed
+  int rerank = 0;               // two-stage ranking: images verified by RANSAC (0: all)
+  int batch = 0;                // batched matching: database descriptors per block (0: one image at a time)
+  string pcafile = "";          // projection of reduceDescriptors, when the keypoint files are reduced
+
+  read_flags (argc, argv, &imgfile, &imgdir, &infodir, &output, &param, &minh, &octaves, &layers, &sizemin, &responsemin, &shardspec, &prefetch, &prefetchThreads, &seedlist, &budget, &roi, &polygonfile, &savematches, &lshcandidates, &lshradius, &coarseKeypoints, &coarseMatches, &rerank, &batch, &pcafile);
 
   if (param != "")
     read_surfparams (param, &minh, &octaves, &layers, &sizemin, &responsemin);
 
-/* ===============================================================================================
-   Create all structures that are needed to process the images:
-        - use SURF for key points detection and feature extraction
-        - use BFMatcher (Brute force matcher) for assigning a point to its two nearest
-          neighbours in another image
-   =============================================================================================== */
-  SurfFeatureDetector detector( minh, octaves, layers );  // Define SURF detector
-
-  Ptr<DescriptorExtractor> extractor = new SurfDescriptorExtractor(); // Feature extractor from keypoints
-
-
-  vector<KeyPoint> keypoints1;                                         // Vector of keypoints
-  vector<KeyPoint> keypoints2;                                         // Vector of keypoints
-
-  Mat descriptors1, descriptors2;
-
-  BFMatcher matcher;
-
-  vector < vector<DMatch> > matches1;
-  vector < vector<DMatch> > matches2;
-  vector <DMatch> sym_matches;
-  vector <DMatch> matches;
+  if (shardspec != "" && parse_shard (shardspec, &shard, &nshards) != 0)
+  {
+    cout << "Shard should be given as i/N, with 0 <= i < N" << endl;
+    return -1;
+  }
 
 /* ===============================================================================================
-   Process image:
-	- detect keypoints
-	- filter keypoints
+   List the seed images: the one given with -i, or all those of the batch file given with -b
+   (one path per line), in which case -o is the directory receiving one result file per seed
    =============================================================================================== */
-  Mat img1;
-
-  img1 = imread(imgfile);
-
-  detector.detect( img1, keypoints1);
-  filter_keypoints (keypoints1, sizemin, responsemin);
-  extractor->compute(img1, keypoints1, descriptors1);
+  vector<string> seeds;
+  if (seedlist != "")
+  {
+    ifstream list (seedlist.c_str());
+    string line;
+    while (getline (list, line))
+      if (line != "")
+        seeds.push_back (line);
+    if (output != "" && *output.rbegin() != '/')
+      output.append ("/");
+  }
+  else
+    seeds.push_back (imgfile);
 
 /* ===============================================================================================
-   Go to directory containing images, check it exists, get file list, select those files
-   that contain an image (.jpg extension).
+   Go to directory containing images, check it exists, and open it as a corpus: the list of
+   image files (.jpg extension) and their keypoint files
    =============================================================================================== */
   struct stat sb;
 
@@ -163,138 +164,205 @@ int main(int argc, char** argv)
     return -1;
    }
 
-  vector<string> allfiles = vector<string>();                 // vector containing names of all files
+  Corpus corpus;
 
-  int ierr = GetFileList(imgdir, allfiles);
+  int ierr = corpus.open (imgdir, infodir);
   if (ierr != 0) 
   {
 	  cout << " Problem while trying to read in list of histograms; check the directory!" <<endl;
     return -1;
   }
 
-  vector<string> files;
-  string filename;
-  int counter = 0;
+  // matching only needs the keypoint coordinates and the descriptors; with binary keypoint
+  // files the descriptors are read first, and the coordinates only for promising images
+  if (corpus.binary())
+    corpus.select (FIELD_DESCRIPTORS);
+  else
+    corpus.select (FIELDS_MATCH);
 
-  for(int i = 0; i < allfiles.size(); i++)
-  {
-	  filename = allfiles[i];
-	  if(filename.substr(filename.find_last_of(".") + 1) == "jpg")
-	  {
-		  files.push_back(filename);
-		  counter++;
-	  }
-  }
+  // with a memory budget, feature files stay in an LRU cache shared by all the queries
+  if (budget > 0)
+    corpus.cache ((long) (budget*1024*1024));
 
 /* ===============================================================================================
-   Now loop over all image files:
+   Create the feature extractor (SURF detection, filter, SURF description), then for each seed
+   image compare it with all images of the corpus (ratio, symmetry and ransac tests) and rank
+   them by number of remaining matches
    =============================================================================================== */
-  vector<double> distval(files.size());
-  vector<int>    indices(files.size());
-
-  string infofile;
-  int pos;
-
-  counter = 0;
-  int ndist = 0;
+  SurfParams params (minh, octaves, layers, sizemin, responsemin);
+  if (param != "")
+    read_descriptorparams (param, params);
+  FeatureExtractor extractor (params);
+  Features seed;
+
+  QueryOptions options;
+  options.ratio = ratio;
+  options.progress = 100;
+  options.shard = shard;
+  options.nshards = nshards;
+  options.prefetch = prefetch;
+  options.prefetchThreads = prefetchThreads;
+  options.keepMatches = savematches > 0;
+  options.coarseKeypoints = coarseKeypoints;
+  options.coarseMatches = coarseMatches;
+  options.rerank = rerank;
+  options.batch = batch;
 
-  for(int i = 0; i < files.size(); i++)
+/* ===============================================================================================
+   With -lsh, the binary descriptors of the corpus (or of the shard) are indexed once; each
+   seed is then matched only with the images that share the most near-identical descriptors
+   =============================================================================================== */
+  HammingIndex index;
+  vector<int> candidates;
+  if (lshcandidates > 0)
   {
-/*      =========================================================================================
-        Generate filenames
-        ========================================================================================== */
-	  if((counter+1) % 100 ==0 || counter == files.size()-1) cout << "Processing image # " << counter+1 << " out of " << files.size() << " images in the database"<<endl;
-
-	  infofile = files[i];
-    pos = 0;
-    pos = infofile.find("jpg",pos);
-    infofile.replace(pos,3,"yml");
-    filename = infodir;
-    if(*filename.rbegin() != '/') filename.append("/");
-    filename.append(infofile);
-
-/*      =========================================================================================
-        Read keypoints from file
-        ========================================================================================== */
-  	keypoints2.clear();
-
-	  FileStorage fs(filename, FileStorage::READ);
-	  FileNode kptFileNode = fs["keypoints"];
-	  read( kptFileNode, keypoints2 );
-
-/*      =========================================================================================
-        Process image2
-        ========================================================================================== */
-    if(keypoints1.size()>0 && keypoints2.size() > 0 ) 
+    int64 t0 = getTickCount();
+    if (build_index (corpus, shard, nshards, index) != 0)
     {
+      cout << "-lsh needs binary descriptors (descriptor: orb or brisk in the parameter file)" << endl;
+      return -1;
+    }
+    if (lshradius <= 0)
+      lshradius = 8*2*index.tables()/6;
+    cout << "Indexed " << index.size() << " descriptors in " << index.tables() << " tables (" << index.memory()/(1024*1024) << " MB) in ";
+    cout << (getTickCount() - t0)/getTickFrequency() << " s" << endl;
+    options.candidates = &candidates;
+  }
 
-   	  fs["descriptors"] >> descriptors2;
-
-/*  	=========================================================================================
-    	Find matches based on descriptors: 
-	- first from img1 to img2 (with 2 NN), then from img2 to img1
-	- filter based on ratio test
-	- filter for symmetry
-	- filter by RANSAC
-    	======================================================================================== */
+/* ===============================================================================================
+   With -pca, the keypoint files were reduced by reduceDescriptors: the descriptors of each seed
+   are projected the same way before matching
+   =============================================================================================== */
+  Projection projection;
+  if (pcafile != "" && read_projection (pcafile, projection) != 0)
+  {
+    cout << "could not read the projection " << pcafile << endl;
+    return -1;
+  }
 
-		  matches1.clear();
-		  matches2.clear();
- 		  matcher.knnMatch(descriptors1,descriptors2,matches1,2);
- 		  matcher.knnMatch(descriptors2,descriptors1,matches2,2);
+  // image paths of the saved matches: the same for every seed of a batch
+  string imagepath = imgdir;
+  if (imagepath != "" && *imagepath.rbegin() != '/')
+    imagepath.append ("/");
 
- 		  int removed= ratioTest(matches1,ratio);
- 		  removed= ratioTest(matches2,ratio);
+  for (int s = 0; s < seeds.size(); s++)
+  {
+    Mat img1;
 
-		  sym_matches.clear();
-		  matches.clear();
+    img1 = imread(seeds[s]);
 
- 		  symmetryTest(matches1,matches2,sym_matches);
+    // only the keypoints of the region of interest, if one is given, are detected
+    Mat mask;
+    if (seed_mask (img1.size(), roi, polygonfile, mask) != 0)
+    {
+      cout << "Region should be given as x,y,w,h, polygons as one x y vertex per line (at least 3)" << endl;
+      return -1;
+    }
 
- 		  Mat fundamental= ransacTest(sym_matches,keypoints1,keypoints2, matches);
-		  distval[counter] = matches.size();
-	 }
+    extractor.extract (img1, seed, mask);
+    if (!projection.empty())
+    {
+      if (!seed.descriptors.empty() && (seed.descriptors.type() != CV_32F || seed.descriptors.cols != projection.basis.cols))
+      {
+        cout << "-pca needs float (SURF) descriptors of " << projection.basis.cols << " values, as projected by " << pcafile << endl;
+        return -1;
+      }
+      Mat reduced;
+      project_descriptors (projection, seed.descriptors, reduced);
+      seed.descriptors = reduced;
+    }
+    cout << "Seed " << seeds[s] << ": " << seed.size() << " keypoints" << endl;
 
-	  else
-		  distval[counter] = 0;
+    if (lshcandidates > 0)
+    {
+      int64 t0 = getTickCount();
+      vector<int> votes;
+      int ndistances = index.query (seed.descriptors, lshradius, votes);
+
+      vector< pair<int,int> > ranked;
+      for (int i = 0; i < votes.size(); i++)
+        if (votes[i] > 0)
+          ranked.push_back (make_pair (-votes[i], i));
+      sort (ranked.begin(), ranked.end());
+      candidates.clear();
+      for (int c = 0; c < ranked.size() && c < lshcandidates; c++)
+        candidates.push_back (ranked[c].second);
+
+      cout << "Index lookup: " << ndistances << " distances, " << ranked.size() << " images with votes, " << candidates.size();
+      cout << " matched, in " << (getTickCount() - t0)/getTickFrequency() << " s" << endl;
+    }
 
-	  fs.release();
-	  counter++;
-  }
-    ndist = counter;
+    vector<QueryResult> results;
+    QueryStats stats;
+    query (corpus, seed, results, options, &stats);
 
 /* ===============================================================================================
-   Sort array of distances: get indices of sorted values
+   Report how much of the reading of the keypoint files was hidden behind the matching
    =============================================================================================== */
-    indices = ordered(distval,ndist);
+    cout << "Scanned " << results.size() << " images in " << stats.seconds << " s" << endl;
+    if (stats.prefetch.nimages > 0)
+    {
+      cout << "Prefetch (depth " << prefetch << ", " << prefetchThreads << " threads): read " << stats.prefetch.readSeconds << " s, ";
+      cout << "waited " << stats.prefetch.waitSeconds << " s, overlap " << 100*stats.prefetch.overlap() << " %" << endl;
+    }
+    if (coarseKeypoints > 0)
+      cout << "Progressive matching: " << stats.escalated << " of " << results.size() << " images matched with the whole seed" << endl;
+    if (rerank > 0)
+      cout << "Two-stage ranking: " << stats.verified << " images verified, the top " << stats.certain << " hits rank as in a full scan" << endl;
+    if (corpus.binary())
+      cout << "Keypoint coordinates read for " << stats.geometryLoads << " of " << results.size() << " images" << endl;
 
 /* ===============================================================================================
-   Write out ordered list of images, with number of matches
+   Write out ordered list of images, with number of matches; a shard writes the raw distances
+   of all its images, to be combined by mergeResults. In batch mode, the result file of a seed
+   is named after it.
    =============================================================================================== */
-  string jsonfile = output;
+    string outfile = output;
+    if (seedlist != "")
+    {
+      string seedname = seeds[s].substr (seeds[s].find_last_of ("/") + 1);
+      outfile = output + seedname.substr (0, seedname.find_last_of (".")) + ".json";
+    }
 
-  ofstream json(jsonfile.c_str());
-  json << "{\"path\":\"" << imgdir << "\"";
-  json << ", \"files\":[";
-  int count = 0;
-  int idx;
-  double dist;
+    if (shardspec != "")
+      write_partial_results (outfile, imgdir, shard, nshards, results);
+    else
+      write_results (outfile, imgdir, results);
 
-  for(int i=0; i < ndist; i++)
-  {
-	  idx = indices[i];
-	  dist = distval[idx];
-    if (dist > 1)
+/* ===============================================================================================
+   Save the matches of the top hits next to the result file (<output>.akm), so that drawMatches
+   can render them from the keypoint files instead of matching the pairs again
+   =============================================================================================== */
+    if (savematches > 0)
     {
-      if (count != 0)
-        json << ",";
-      json << "{\"name\":\"" <<files[idx].substr(0,files[idx].find_last_of(".")) << "\",";
-      json <<"\"distance\":" << dist << "}";
-      count++;
+      MatchFile matchfile;
+      matchfile.seed = seeds[s];
+      matchfile.seedKeypoints = seed.keypoints;
+      for (int r = 0; r < results.size() && matchfile.hits.size() < savematches; r++)
+      {
+        if (results[r].distance <= 1)
+          break;
+        MatchRecord hit;
+        hit.image = imagepath + corpus.filename (results[r].index);
+        hit.featurefile = corpus.featurefile (results[r].index);
+        hit.distance = results[r].distance;
+        hit.matches = results[r].matches;
+        matchfile.hits.push_back (hit);
+      }
+      write_matchfile (outfile + ".akm", matchfile);
     }
   }
-  json << "]}" << endl;
-  json.close();
+
+/* ===============================================================================================
+   Report how well the feature cache served the queries
+   =============================================================================================== */
+  if (corpus.cached())
+  {
+    CacheStats cache = corpus.cacheStats();
+    cout << "Feature cache (" << budget << " MB): " << cache.hits << " hits, " << cache.misses << " misses, hit rate ";
+    cout << 100*cache.hitRate() << " %, " << cache.evictions << " evictions, " << cache.bytesRead << " bytes read, ";
+    cout << cache.entries << " images (" << cache.bytesCached << " bytes) in memory" << endl;
+  }
 
   return 0;
 }
@@ -324,6 +392,21 @@ int usage()
     cout << "     " << "=                                 -k        <path to directory with keypoints of images>       ="  << endl;
     cout << "     " << "=                                 -o        <path to output file>                              ="  << endl;
     cout << "     " << "=                                 -p        <path to param file for SURF>                      ="  << endl;
+    cout << "     " << "=                                 -shard    <i/N: only scan shard i of N, partial output>      ="  << endl;
+    cout << "     " << "=                                 -q        <number of keypoint files read ahead> (8, 0: off)  ="  << endl;
+    cout << "     " << "=                                 -qt       <number of threads reading ahead> (2)              ="  << endl;
+    cout << "     " << "=                                 -b        <file listing seed images: -o is then a directory> ="  << endl;
+    cout << "     " << "=                                 --mem-budget <MB: keep keypoint files in an LRU cache>       ="  << endl;
+    cout << "     " << "=                                 -roi      <x,y,w,h: only search for this seed region>        ="  << endl;
+    cout << "     " << "=                                 -mask     <polygon file: one x y vertex per line>            ="  << endl;
+    cout << "     " << "=                                 -sm       <N: save the matches of the top N hits (.akm)>     ="  << endl;
+    cout << "     " << "=                                 -lsh      <N: binary descriptors, only match N images>       ="  << endl;
+    cout << "     " << "=                                 -lr       <Hamming radius of the index lookup> (bits/6)      ="  << endl;
+    cout << "     " << "=                                 -cm       <N: first match the N strongest seed keypoints>    ="  << endl;
+    cout << "     " << "=                                 -ct       <coarse matches to match the whole seed> (2)       ="  << endl;
+    cout << "     " << "=                                 -rr       <N: only verify the N best by symmetric matches>   ="  << endl;
+    cout << "     " << "=                                 -batch    <N: match by blocks of N descriptors (SURF)>       ="  << endl;
+    cout << "     " << "=                                 -pca      <projection file of reduced keypoint files>        ="  << endl;
     cout << "     " << "=                                                                                              ="  << endl;
     cout << "     " << "================================================================================================"  << endl;
     cout << "     " << "================================================================================================"  << endl;
@@ -338,7 +421,7 @@ int usage()
 /* ===============================================================================================
    Procedure to read in flag values
    =============================================================================================== */
-void read_flags(int argc, char** argv, string *imgfile, string *imgdir, string *infodir, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin)
+void read_flags(int argc, char** argv, string *imgfile, string *imgdir, string *infodir, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin, string *shardspec, int *prefetch, int *prefetchThreads, string *seedlist, double *budget, string *roi, string *polygonfile, int *savematches, int *lshcandidates, int *lshradius, int *coarseKeypoints, int *coarseMatches, int *rerank, int *batch, string *pcafile)
 {
   string input;
   for(int i = 1; i < argc; i++)
@@ -354,6 +437,36 @@ void read_flags(int argc, char** argv, string *imgfile, string *imgdir, string *
       *output = argv[i + 1];
     if (input == "-p") 
       *param = argv[i + 1];
+    if (input == "-shard" || input == "--shard")
+      *shardspec = argv[i + 1];
+    if (input == "-q")
+      *prefetch = atoi(argv[i + 1]);
+    if (input == "-qt")
+      *prefetchThreads = atoi(argv[i + 1]);
+    if (input == "-b")
+      *seedlist = argv[i + 1];
+    if (input == "-mem-budget" || input == "--mem-budget")
+      *budget = atof(argv[i + 1]);
+    if (input == "-roi")
+      *roi = argv[i + 1];
+    if (input == "-mask")
+      *polygonfile = argv[i + 1];
+    if (input == "-sm")
+      *savematches = atoi(argv[i + 1]);
+    if (input == "-lsh")
+      *lshcandidates = atoi(argv[i + 1]);
+    if (input == "-lr")
+      *lshradius = atoi(argv[i + 1]);
+    if (input == "-cm")
+      *coarseKeypoints = atoi(argv[i + 1]);
+    if (input == "-ct")
+      *coarseMatches = atoi(argv[i + 1]);
+    if (input == "-rr")
+      *rerank = atoi(argv[i + 1]);
+    if (input == "-batch")
+      *batch = atoi(argv[i + 1]);
+    if (input == "-pca")
+      *pcafile = argv[i + 1];
 
     if (input == "-h")
       *minh = atoi(argv[i+1]);
@@ -369,91 +482,44 @@ void read_flags(int argc, char** argv, string *imgfile, string *imgdir, string *
 }
 
 /* ===============================================================================================
-   Procedure to read parameters for SURF
+   Index of the binary descriptors of the images of a shard, read on all cores; returns -1 if
+   the feature files do not hold binary descriptors
    =============================================================================================== */
-void read_surfparams(string param, int *minHessian, int *octaves, int *octaveLayers, int *SizeMin, double *RespMin)
+class ReadDescriptorsBody : public ParallelLoopBody
 {
-  ifstream inFile;
-  inFile.open(param.c_str());
-	string record;
-	stringstream ss;
-
-	while ( !inFile.eof () ) {    
-		getline(inFile,record);
-		if (record.find("minHessian") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *minHessian;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("octaves") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *octaves;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("octaveLayers") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *octaveLayers;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("min Size") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *SizeMin;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("min Resp") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *RespMin;
-			ss.str("");
-			ss.clear();
-		}
-	}
-}
+public:
+  ReadDescriptorsBody (const Corpus &c, const vector<int> &i, vector<Mat> &d)
+    : corpus (c), indices (i), descriptors (d) {}
 
-/* ===============================================================================================
-   Procedure to extract list of files from a directory
-   =============================================================================================== */
-int GetFileList(string directory, vector<string> &files) 
-{
-  DIR *dp;
-  struct dirent *dirp;
-  if((dp  = opendir(directory.c_str())) == NULL) {
-    return errno;
+  void operator() (const Range &range) const
+  {
+    Features buffer;
+    for (int k = range.start; k < range.end; k++)
+      descriptors[k] = corpus.features (indices[k], buffer).descriptors.clone();
   }
 
-  while ((dirp = readdir(dp)) != NULL) {
-    files.push_back(string(dirp->d_name));
-  }
-  closedir(dp);
-  return 0;
-}
+private:
+  const Corpus &corpus;
+  const vector<int> &indices;
+  vector<Mat> &descriptors;
+};
 
-/* ===============================================================================================
-   Procedure to filter keypoints based on size and response
-   =============================================================================================== */
-void filter_keypoints (vector<KeyPoint>& keypoints, int sizemin, double responsemin)
+int build_index (const Corpus &corpus, int shard, int nshards, HammingIndex &index)
 {
-	vector<KeyPoint> temp;
-	int npoints=keypoints.size();
-	int size;
-	double response;
-
-  //filter based on size and reponse size
- 	for(int i = 0; i < npoints; i++)
-	{
-		size = keypoints[i].size;
-    response = keypoints[i].response;
-		if(size > sizemin && response > responsemin)
-			temp.push_back(keypoints[i]);
-	}
+  vector<int> indices;
+  if (shard_corpus (corpus, shard, nshards, indices) != 0)
+    return -1;
 
-	keypoints.clear();
-	keypoints = temp;
+  vector<Mat> descriptors (indices.size());
+  run_parallel (Range (0, indices.size()), ReadDescriptorsBody (corpus, indices, descriptors), 0, 16);
 
-  return;
+  for (int k = 0; k < indices.size(); k++)
+    if (index.add (indices[k], descriptors[k]) != 0)
+      return -1;
+  if (index.size() == 0)
+    return -1;
+  index.build();
+  return 0;
 }
 
 /* ===============================================================================================
@@ -476,402 +542,4 @@ void showkeypts(vector<KeyPoint>& keypoints, Mat& drawImg)
 	}
 }
 
-/* ===============================================================================================
-   This function combines multiple images into a single image
-   =============================================================================================== */
-
-Mat CombineImages(int nimage, Mat images[], string titles[])
-{
-	Mat NewImage;
-	Mat myimg;
-	Mat img;
-	string title;
-
-	int i;
-	int offset_x, offset_y;
-	int width,height;
-	int width_max, height_max;
-	int spacer_x,spacer_y;
-	int pos_x,pos_y;
-
-/* ===============================================================================================
-	img_row : (maximum) number of images per row
-	col_max : (maximum) number of images per column
-   =============================================================================================== */
-
-	int img_row, img_col;
-
-/* ===============================================================================================
-	Define the geometry of the new image: number of rows and columns,
-	as well as size of each individual image
-   =============================================================================================== */
-
-	if (nimage == 2) {
-		img_row = 1;
-		img_col = 1;
-	}
-	else if (nimage == 4) {
-		img_row = 2;
-		img_col = 2;
-	}
-	else if (nimage == 6)  {
-		img_row = 3;
-		img_col = 2;
-	}
-	else {
-		img_row = 4;
-		img_col = 2;
-	}
 
-/* ===============================================================================================
-	spacer_x and spacer_y are the spaces (# of pixels) left empty between images on row 1
-	pos_x and pos_y is the position of the text for the first title
-   =============================================================================================== */
-
-	spacer_x = 20;
-	spacer_y = 20;
-
-	pos_x   = 2*spacer_x;
-	pos_y   = spacer_y/2;
-
-/* ===============================================================================================
-	Get information from images: size (width and height)
-   =============================================================================================== */
-
-	width_max = 0;
-	height_max = 0;
-	for(i = 0; i < nimage; i++) {
-		if(images[i].cols > width_max) width_max = images[i].cols;
-	}
-	double scale;
-	i = 0;
-	int h;
-	while (i < nimage)
-	{
-		scale = ((float) width_max)/images[i].cols;
-		height = images[i].rows*scale;
-		h = height;
-		i++;
-		scale = ((float) width_max)/images[i].cols;
-		height = images[i].rows*scale;
-		if(height>h) h = height;
-		i++;
-		height_max=height_max + h;
-	}
-		
-/* ===============================================================================================
-	Create new image and size it so that it can contain all the images
-	Generate image with white background
-   =============================================================================================== */
-
-	int size_x = spacer_x*(img_row+1) + width_max*img_row;
-	int size_y = spacer_y*(img_col+1) + height_max;
-
-	NewImage = Mat( cvSize(size_x,size_y), CV_8UC3, Scalar(255,255,255));
-
-/* ===============================================================================================
-	Now place all images into the New Image
-   =============================================================================================== */
-
-	Mat TargetROI;
-
-
-	offset_x = spacer_x;
-	offset_y = spacer_y;
-
-   	int interpolation=INTER_LINEAR;
-	i = 0;
-
-	while (i < nimage)
-	{
-/* 		==================================================================================
-		First put image on the left
-   		================================================================================== */
-
-		img = images[i];
-		title = titles[i];
-
-		scale = ((float) width_max)/img.cols;
-		resize(img,myimg, Size(),scale,scale,interpolation);
-		width = myimg.cols;
-		height = myimg.rows;
-		h = height;
-
-/* 		==================================================================================
-		- Set a rectangle where we want to put the image;
-		- Define a "Region Of Interest" corresponding to this rectangle
-		- Copy the image in that rectangle
-   		================================================================================== */
- 
-		Rect ROI(offset_x, offset_y, width, height);
-		TargetROI = NewImage(ROI);
-		myimg.copyTo(TargetROI);
-
-/* 		==================================================================================
-		Write a title above the image: indicate the minHessian, octaves, and octaveLayers
-		that were used for that image
-		Title is written in black
-   		================================================================================== */
-
-		putText(NewImage, title, Point(pos_x,pos_y), CV_FONT_HERSHEY_PLAIN, 0.7, Scalar(0,0,0));
-
-		i++;
-
-/* 		==================================================================================
-		Repeat for image representing the histogram, on the right
-   		================================================================================== */
-/* 		==================================================================================
-		Reset the offsets in X and Y: move along rows.
-   		================================================================================== */
-
-		offset_x += width_max + spacer_x;
-		pos_x    += width_max + spacer_x;
-
-		img = images[i];
-		title = titles[i];
-
-		scale = ((float) width_max)/img.cols;
-		resize(img,myimg, Size(),scale,scale,interpolation);
-		width = myimg.cols;
-		height = myimg.rows;
-		if(height>h) h = height;
-
-		Rect ROI2(offset_x, offset_y, width, height);
-		TargetROI = NewImage(ROI2);
-		myimg.copyTo(TargetROI);
-
-		putText(NewImage, title, Point(pos_x,pos_y), CV_FONT_HERSHEY_PLAIN, 0.7, Scalar(0,0,0));
-
-		i++;
-
-/* 		==================================================================================
-		Switch to new row
-   		================================================================================== */
-
-		offset_x = spacer_x;
-		offset_y += spacer_y + h;
-		pos_x = 2*spacer_x;
-		pos_y += h +spacer_y;
-	}
-
-/* ===============================================================================================
-	Now return New Image to main program
-   =============================================================================================== */
-
-	return NewImage;
-
-}
-
-/* ===============================================================================================
-   Procedure to sort an array (in descending order) by providing the indices of the sorted positions
-   (does not change the array)
-   Use simple bubble sort! Could be easily improved....
-   =============================================================================================== */
-
-vector<int> ordered(vector<double> const & values, int nval)
-{
-	vector<int> indices(values.size());
-	for(int i =0; i < nval ; i++)
-	{
-		indices[i] = i;
-	}
-	int idx;
-	for(int i = 0; i < nval-1; i++)
-	{
-		for(int j = i+1; j< nval; j++)
-		{
-			if(values[indices[i]] < values[indices[j]])
-			{
-				idx = indices[i];
-				indices[i]=indices[j];
-				indices[j]=idx;
-			}
-		}
-	}
-
-    	return indices;
-}
-
-/* ===============================================================================================
-   This function perform a ratio test: 
-   - Clear matches for which NN ratio is > than threshold
-   - return the number of removed points
-   =============================================================================================== */
-
-int ratioTest(vector<vector<cv::DMatch> > &matches, double ratio) 
-{
-  int removed=0;
-
-	for (vector<vector<cv::DMatch> >::iterator
-		matchIterator= matches.begin();
-		matchIterator!= matches.end(); ++matchIterator) 
-	{
-/*      	==================================================================================
-                if 2 NN have been identified
-        	================================================================================== */
-
-		if (matchIterator->size() > 1)
-    {
-/*      	==================================================================================
-                check distance ratio
-        	================================================================================== */
-
-			if ((*matchIterator)[0].distance/ (*matchIterator)[1].distance > ratio)
-      {
-				matchIterator->clear(); // remove match
-				removed++;
-     	}
-
-		} 
-
-/*      	==================================================================================
-                does not have 2 neighbours, then remove match
-        	================================================================================== */
-		else 
-    {
-			matchIterator->clear(); // remove match
-			removed++;
-		}
-	}
-
-	return removed;
-}
-
-/* ===============================================================================================
-   This function perform a symmetry test:
-   matches from 1 to 2 should match with matches from 2 to 1
-   =============================================================================================== */
-
-void symmetryTest(const vector<vector<DMatch> >& matches1,const vector<vector<DMatch> >& matches2, vector<DMatch>& symMatches) 
-{
-
-/*     	=========================================================================================
-        for all matches image 1 -> image 2
-       	========================================================================================= */
-
-	for (vector<vector<cv::DMatch> >:: const_iterator matchIterator1= matches1.begin();
-           matchIterator1!= matches1.end(); ++matchIterator1) 
-	{
-         	// ignore deleted matches
-         	if (matchIterator1->size() < 2) continue;
-
-/*     		=================================================================================
-        	for all matches image 2 -> image 1
-       		================================================================================= */
-
-		for (vector<vector<cv::DMatch> >:: const_iterator matchIterator2= matches2.begin();
-		matchIterator2!= matches2.end(); ++matchIterator2) 
-		{
-
-			// ignore deleted matches
-			if (matchIterator2->size() < 2) continue;
-
-/*     			=========================================================================
-        		Symmetry test
-       			========================================================================= */
-
-			if ((*matchIterator1)[0].queryIdx == (*matchIterator2)[0].trainIdx &&
-			(*matchIterator2)[0].queryIdx == (*matchIterator1)[0].trainIdx) 
-			{
-
-				symMatches.push_back(cv::DMatch((*matchIterator1)[0].queryIdx,
-				(*matchIterator1)[0].trainIdx,(*matchIterator1)[0].distance));
-
-				break; // next match in image 1 -> image 2
-
-			}
-		}
-	}
-}
-
-/* ===============================================================================================
-   Identify good matches using RANSAC; return fundamental matrix
-   =============================================================================================== */
-
-Mat ransacTest(const vector<cv::DMatch>& matches,const vector<cv::KeyPoint>& keypoints1, const vector<cv::KeyPoint>& keypoints2, vector<cv::DMatch>& outMatches) 
-{
-
-/*     	=========================================================================================
-        Convert keypoints1 and keypoints2 into Point2f
-       	========================================================================================= */
-
-	vector<cv::Point2f> points1, points2;
-
-	Mat fundemental;
-
-	for (vector<cv::DMatch>::const_iterator it= matches.begin();it!= matches.end(); ++it) 
-	{
-
-		double x= keypoints1[it->queryIdx].pt.x;
-		double y= keypoints1[it->queryIdx].pt.y;
-		points1.push_back(Point2f(x,y));
-
-		x= keypoints2[it->trainIdx].pt.x;
-		y= keypoints2[it->trainIdx].pt.y;
-		points2.push_back(cv::Point2f(x,y));
-	}
-
-/*     	=========================================================================================
-        Compute fundamental matrix using RANSAC
-       	========================================================================================= */
-
-	vector<uchar> inliers(points1.size(),0);
-
-	double confidence = 0.99;
-	double distance = 3.0;
-	int refineF = 1;
-
-	if (points1.size()>0&&points2.size()>0)
-	{
-
-		Mat fundemental= cv::findFundamentalMat(
-                        cv::Mat(points1),cv::Mat(points2), // matching points
-                        inliers,       // match status (inlier or outlier)
-                        CV_FM_RANSAC, // RANSAC method
-                        distance,      // distance to epipolar line
-                        confidence); // confidence probability
-
-		// extract the surviving (inliers) matches
-
-		vector<uchar>::const_iterator itIn= inliers.begin();
-		vector<cv::DMatch>::const_iterator itM= matches.begin();
-
-		for ( ;itIn!= inliers.end(); ++itIn, ++itM) 
-		{
-			if (*itIn) { // it is a valid match
-				outMatches.push_back(*itM);
-			}
-		}
-
-		if (refineF) {
-
-			// The F matrix will be recomputed with all accepted matches
-			// Convert keypoints into Point2f for final F computation
-
-			points1.clear();
-			points2.clear();
-
-			for (std::vector<cv::DMatch>::const_iterator it= outMatches.begin();it!= outMatches.end(); ++it) 
-			{
-				double x= keypoints1[it->queryIdx].pt.x;
-				double y= keypoints1[it->queryIdx].pt.y;
-				points1.push_back(cv::Point2f(x,y));
-
-				x= keypoints2[it->trainIdx].pt.x;
-				y= keypoints2[it->trainIdx].pt.y;
-				points2.push_back(cv::Point2f(x,y));
-			}
-
-			// Compute 8-point F from all accepted matches
-
-			if (points1.size()>0&&points2.size()>0){
-
-				fundemental= cv::findFundamentalMat(cv::Mat(points1),cv::Mat(points2), // matches
-						CV_FM_8POINT); // 8-point method
-
-			}
-		}
-	}
-
- return fundemental;
-}
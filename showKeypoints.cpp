@@ -8,6 +8,8 @@
 		[3] filters the keypoints based on a sizemin and responsemin specified 
 		[4] uses opencv's Circle function to draw all the keypoints over the image
 		[5] saves the image with drawn keypoints into file specified in step 1
+		with a directory as input, does the same for every image of the directory on all
+		cores, and writes a summary of the keypoint counts in CSV format
 
 	mainly use this program to test parameters and to see the location and intensity of keypoints
 	
@@ -50,19 +52,24 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <cstdlib>
+#include <sys/stat.h>
 #include "opencv2/highgui/highgui.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
 #include "opencv2/calib3d/calib3d.hpp"
 #include "opencv2/features2d/features2d.hpp"
 #include "opencv2/nonfree/nonfree.hpp"
 
+#include "archv.hpp"
+
 using namespace std;
 using namespace cv;
+using namespace archv;
 
 int usage ();
-void read_flags (int argc, char **argv, string *input, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin);
-void read_surfparams (string param, int *min, int *octaves, int *layers, int *sizemin, double *responsemin);
-void filter_keypoints (vector <KeyPoint> &keypoints, int sizemin, double responsemin);
+void read_flags (int argc, char **argv, string *input, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin, string *featurefile, string *thumbdir, int *minwidth, int *nthreads, int *maxwidth, string *csvfile);
+int show_directory (string inputdir, string outputdir, string csvfile, const FeatureExtractor &extractor, int nthreads, int maxwidth);
 
 int main(int argc, char **argv)
 {
@@ -85,6 +92,12 @@ int main(int argc, char **argv)
   double responsemin = 100;
   string input, output;
   string param = "";
+  string featurefile = "";      // stored keypoints to draw instead of detecting them
+  string thumbdir = "";         // thumbnails written by processImages -th
+  int minwidth = 800;           // smallest width of a thumbnail to use
+  int nthreads = 0;             // batch mode: worker threads, 0 for one per core
+  int maxwidth = 0;             // batch mode: largest width of the output images, 0 to keep the size
+  string csvfile = "";          // batch mode: summary file, <output>/keypoints.csv by default
   vector <KeyPoint> keypoints;
   Mat image;
   Mat outimage; 
@@ -92,18 +105,49 @@ int main(int argc, char **argv)
 /* =====================================================================================
 	parse command line into variables above and read in the image into Mat image
    ===================================================================================== */
-  read_flags(argc, argv, &input, &output, &param, &minh, &octaves, &layers, &sizemin, &responsemin);
+  read_flags(argc, argv, &input, &output, &param, &minh, &octaves, &layers, &sizemin, &responsemin, &featurefile, &thumbdir, &minwidth, &nthreads, &maxwidth, &csvfile);
+  SurfParams params (minh, octaves, layers, sizemin, responsemin);
   if (param != "")
-    read_surfparams (param, &minh, &octaves, &layers, &sizemin, &responsemin);
-  image = imread (input);
+    read_surfparams (param, params);
+
+/* =====================================================================================
+	batch mode: the input is a directory of images, the output a directory
+   ===================================================================================== */
+  struct stat sb;
+  if (stat (input.c_str(), &sb) == 0 && S_ISDIR (sb.st_mode))
+  {
+    FeatureExtractor extractor (params);
+    return show_directory (input, output, csvfile, extractor, nthreads, maxwidth);
+  }
 
 /* =====================================================================================
-	create openCV's SurfFreatureDetector and then run detect() function
+	with -f, draw the keypoints stored by processImages: the image can then be read
+	from its thumbnail, and the keypoints are scaled to it
    ===================================================================================== */
-  SurfFeatureDetector detector (minh, octaves, layers);
-  detector.detect (image, keypoints);
-  int original = keypoints.size();
-  filter_keypoints (keypoints, sizemin, responsemin);
+  if (featurefile != "")
+  {
+    Features features;
+    if (read_features (featurefile, features, FIELDS_KEYPOINTS) != 0)
+    {
+      cout << "could not read keypoints: " << featurefile << endl;
+      return -1;
+    }
+    keypoints = features.keypoints;
+    int factor = load_image (input, thumbdir, minwidth, image);
+    scale_keypoints (keypoints, 1.0/factor);
+  }
+  else
+  {
+    image = imread (input);
+
+/* =====================================================================================
+	create the feature extractor and run its detect() function (detection with SURF or
+	the descriptor of the parameter file, and filter on size and response)
+   ===================================================================================== */
+    FeatureExtractor extractor (params);
+    int detected = extractor.detect (image, keypoints);
+    cout << "Keypoints: " << detected << " detected, " << keypoints.size() << " kept after filter" << endl;
+  }
 
 /* =====================================================================================
 	call drawkeypoints from opencv and write to the output image
@@ -120,10 +164,14 @@ int usage ()
   cout << "./a.out -i input -o output -p paramfilepath " << endl;
   cout << "otherwise, without param file:" << endl;
   cout << "./a.out -i input -o output -h # -oct # -l # -s # -r #" << endl;
+  cout << "or, to draw the keypoints stored by processImages (from a thumbnail if there is one):" << endl;
+  cout << "./a.out -i input -o output -f keypointfile [-th thumbnaildir -w minwidth]" << endl;
+  cout << "or, for every image of a directory (summary in outputdir/keypoints.csv by default):" << endl;
+  cout << "./a.out -i inputdir -o outputdir -p paramfilepath [-t threads -ow maxwidth -csv summaryfile]" << endl;
   return -1;
 }
 
-void read_flags (int argc, char **argv, string *input, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin)
+void read_flags (int argc, char **argv, string *input, string *output, string *param, int *minh, int *octaves, int *layers, int *sizemin, double *responsemin, string *featurefile, string *thumbdir, int *minwidth, int *nthreads, int *maxwidth, string *csvfile)
 {
   string parser;
   for (int i = 0; i < argc; i++)
@@ -146,82 +194,140 @@ void read_flags (int argc, char **argv, string *input, string *output, string *p
       *sizemin = atoi(argv[i+1]);
     if (parser == "-r")
       *responsemin = atoi(argv[i+1]);
+
+    if (parser == "-f")
+      *featurefile = argv[i+1];
+    if (parser == "-th")
+      *thumbdir = argv[i+1];
+    if (parser == "-w")
+      *minwidth = atoi(argv[i+1]);
+
+    if (parser == "-t")
+      *nthreads = atoi(argv[i+1]);
+    if (parser == "-ow")
+      *maxwidth = atoi(argv[i+1]);
+    if (parser == "-csv")
+      *csvfile = argv[i+1];
   }
 }
- 
 
-/* ===============================================================================================
-   Procedure to read parameters for SURF from the parameter file
-   =============================================================================================== */
-void read_surfparams(string param, int *minHessian, int *octaves, int *octaveLayers, int *SizeMin, double *RespMin)
-{
-  ifstream inFile;
-  inFile.open(param.c_str());
-	string record;
-	stringstream ss;
-
-	while ( !inFile.eof () ) {    
-		getline(inFile,record);
-		if (record.find("minHessian") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *minHessian;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("octaves") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *octaves;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("octaveLayers") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *octaveLayers;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("min Size") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *SizeMin;
-			ss.str("");
-			ss.clear();
-		}
-		if (record.find("min Resp") != std::string::npos) {
-			ss<<record.substr(record.find_last_of(":") + 1);
-			ss>> *RespMin;
-			ss.str("");
-			ss.clear();
-		}
-	}
-}
 
 
-/* ===============================================================================================
-   Procedure to filter the keypoints from the keypoint vector by minimum size and response
-   =============================================================================================== */
-void filter_keypoints (vector <KeyPoint> &keypoints, int sizemin, double responsemin)
+/* =====================================================================================
+	batch mode: each worker reads, detects, filters and draws whole images; the
+	keypoints are drawn on the reduced image (scaled accordingly) rather than
+	drawn at full size and then reduced
+   ===================================================================================== */
+struct ImageSummary
+{
+  int width, height;
+  int detected, kept;
+  double seconds;
+  bool written;
+};
+
+class ShowBody : public ParallelLoopBody
 {
-  vector <KeyPoint> temp;
-  int npoints = keypoints.size();
-  int size;
-  double response;
+public:
+  ShowBody (const vector<string> &f, string i, string o, const FeatureExtractor &e, int w, vector<ImageSummary> &s)
+    : files (f), inputdir (i), outputdir (o), extractor (e), maxwidth (w), summaries (s) {}
 
-  //filter based on size and response size
-  for (int i = 0; i < npoints; i++)
+  void operator() (const Range &range) const
   {
-    size = keypoints[i].size;
-    response = keypoints[i].response;
-    if (size > sizemin && response > responsemin)
-      temp.push_back(keypoints[i]);
+    vector <KeyPoint> keypoints;
+    Mat small, outimage;
+    for (int i = range.start; i < range.end; i++)
+    {
+      ImageSummary &summary = summaries[i];
+      int64 t0 = getTickCount();
+
+      Mat image = imread (inputdir + files[i]);
+      summary.width = image.cols;
+      summary.height = image.rows;
+      summary.detected = summary.kept = 0;
+      summary.seconds = 0;
+      summary.written = false;
+      if (image.empty())
+        continue;
+
+      summary.detected = extractor.detect (image, keypoints);
+      summary.kept = keypoints.size();
+
+      if (maxwidth > 0 && image.cols > maxwidth)
+      {
+        double scale = (double) maxwidth/image.cols;
+        resize (image, small, Size(), scale, scale, INTER_AREA);
+        scale_keypoints (keypoints, scale);
+        drawKeypoints (small, keypoints, outimage, Scalar (155,0,0), 4);
+      }
+      else
+        drawKeypoints (image, keypoints, outimage, Scalar (155,0,0), 4);
+
+      summary.written = imwrite (outputdir + files[i], outimage);
+      summary.seconds = (getTickCount() - t0)/getTickFrequency();
+    }
   }
 
-  keypoints.clear();
-  keypoints = temp;
+private:
+  const vector<string> &files;
+  string inputdir, outputdir;
+  const FeatureExtractor &extractor;
+  int maxwidth;
+  vector<ImageSummary> &summaries;
+};
 
-  return;
-}
+int show_directory (string inputdir, string outputdir, string csvfile, const FeatureExtractor &extractor, int nthreads, int maxwidth)
+{
+  if (*inputdir.rbegin() != '/')
+    inputdir.append ("/");
+  if (outputdir != "" && *outputdir.rbegin() != '/')
+    outputdir.append ("/");
+  if (csvfile == "")
+    csvfile = outputdir + "keypoints.csv";
 
+  vector <string> files;
+  if (get_imagelist (inputdir, files) != 0 || files.size() == 0)
+  {
+    cout << "no images in " << inputdir << endl;
+    return -1;
+  }
+  sort (files.begin(), files.end());
 
+  vector<ImageSummary> summaries (files.size());
+  int64 t0 = getTickCount();
+  run_parallel (Range (0, files.size()), ShowBody (files, inputdir, outputdir, extractor, maxwidth, summaries), nthreads);
+  double seconds = (getTickCount() - t0)/getTickFrequency();
 
-  
-  
+/* =====================================================================================
+	summary: one line per image, in the order of the file names
+   ===================================================================================== */
+  ofstream csv (csvfile.c_str());
+  csv << "image,width,height,detected,kept,seconds" << endl;
+  int failed = 0;
+  long detected = 0, kept = 0;
+  for (int i = 0; i < files.size(); i++)
+  {
+    const ImageSummary &summary = summaries[i];
+    if (!summary.written)
+    {
+      cout << "could not process " << files[i] << endl;
+      failed++;
+      continue;
+    }
+    csv << files[i] << "," << summary.width << "," << summary.height << "," << summary.detected << "," << summary.kept << "," << summary.seconds << endl;
+    detected += summary.detected;
+    kept += summary.kept;
+  }
+  csv.close();
+
+  int done = files.size() - failed;
+  cout << "Processed " << done << " of " << files.size() << " images in " << seconds << " s";
+  if (seconds > 0)
+    cout << " (" << done/seconds << " img/s)";
+  cout << endl;
+  if (done > 0)
+    cout << "Keypoints per image: " << detected/done << " detected, " << kept/done << " kept after filter" << endl;
+  cout << "Summary written to " << csvfile << endl;
+
+  return failed == 0 ? 0 : -1;
+}
@@ -0,0 +1,615 @@
+/* ============================================================================================
+  tuneParams.cpp                   Version 1           Last Update: 10/19/2026
+
+  This program helps choosing the feature parameters of a collection (SURF, or a binary
+  descriptor: ORB or BRISK, which the grid can compare with SURF). It extracts the features
+  of a small set of images with every setting of a grid of parameter values, and for each
+  setting reports the extraction time, the number of keypoints and of descriptor bytes per
+  image, the query time, and the recall on labelled pairs of matching images. It then
+  recommends the fastest setting that reaches a target recall.
+  
+  	This file is part of the Arch-V Platform -- https://github.com/cstahmer/archv
+
+	Copyright 2012 by Carl G. Stahmer -- http://www.carlstahmer.com
+	
+	Arch-V was originally created by Carl G. Stahmer through the generous support of 
+	the National Endowment for the Humanities.  Subsequent development was performed 
+	by Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl (avkoehl@ucdavis.edu) 
+	at the Digital Scholars Lab at the the University of California Davis, Univeristy 
+	Library (http://ds.lib.ucdavis.edu/). Documentation authored by Henry Le 
+	(hutle@ucdavis.edu).
+
+	Arch-V is licensed under a Creative Commons Attribution 4.0 International
+	License (https://creativecommons.org/licenses/by/4.0/legalcode).
+
+	You are FREE to SHARE (copy and redistribute the material in any medium or format) 
+	and ADAPT (remix, transform, and build upon the material for any purpose, even 
+	commercially) WITH THE FOLLOWING RESTRICTIONS:
+
+	1. 	You must credit Carl G. Stahmer (http://www.carlstahmer.com) and Arthur Koehl 
+		(avkoehl@ucdavis.edu) as the original developers of this software.
+		
+	2. 	You must credit the National Endowment for the Humanities and Univeristy of 
+		California, Davis Univeristy Library as having supported the original development 
+		of the software.
+		
+	3. 	You must provide a copyright notice.
+	
+	4. 	You must provide a link to the license 
+		(https://creativecommons.org/licenses/by/4.0/legalcode).
+		
+	5. 	You must indicate if and what changes you made to the software.
+	
+	6. 	You must provide a link to the original software at
+		https://github.com/cstahmer/archv](https://github.com/cstahmer/archv
+
+ ============================================================================================ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <map>
+#include <algorithm>
+#include <cstdlib>
+
+#include "opencv2/highgui/highgui.hpp"
+#include "opencv2/imgproc/imgproc.hpp"
+
+#include "archv.hpp"
+
+using namespace cv;
+using namespace std;
+using namespace archv;
+
+int  usage();
+void read_flags(int argc, char** argv, string *pairfile, string *gridfile, string *param, string *imgdir, int *nother, int *top, double *target, string *criterion, int *nthreads, string *reportfile, string *outparam);
+int  read_grid (string gridfile, const SurfParams &base, vector<SurfParams> &settings);
+int  read_pairs (string pairfile, vector<string> &images, vector< pair<int,int> > &pairs);
+
+/* ===============================================================================================
+   Results of one setting of the grid; times are per image (extraction) and per query
+   =============================================================================================== */
+struct Setting
+{
+  SurfParams params;
+  double extractSeconds;
+  double keypoints;
+  double descriptorBytes;
+  double querySeconds;
+  double recall;
+};
+
+/* ===============================================================================================
+   Parallel bodies: decode (once for all settings), detect (once per minHessian, octaves and
+   octaveLayers), filter and describe (once per setting), and query every labelled pair
+   =============================================================================================== */
+class DecodeBody : public ParallelLoopBody
+{
+public:
+  DecodeBody (const vector<string> &i, vector<Mat> &g) : images (i), gray (g) {}
+
+  void operator() (const Range &range) const
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      // SURF works on the grey levels: converting once spares the conversion to every setting
+      Mat image = imread (images[i]);
+      if (!image.empty())
+        cvtColor (image, gray[i], CV_BGR2GRAY);
+    }
+  }
+
+private:
+  const vector<string> &images;
+  vector<Mat> &gray;
+};
+
+class DetectBody : public ParallelLoopBody
+{
+public:
+  DetectBody (const vector<Mat> &g, const Feature2D &d, vector< vector<KeyPoint> > &k, vector<double> &s)
+    : gray (g), detector (d), detected (k), seconds (s) {}
+
+  void operator() (const Range &range) const
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      int64 t0 = getTickCount();
+      detected[i].clear();
+      detector.detect (gray[i], detected[i]);
+      seconds[i] = (getTickCount() - t0)/getTickFrequency();
+    }
+  }
+
+private:
+  const vector<Mat> &gray;
+  const Feature2D &detector;
+  vector< vector<KeyPoint> > &detected;
+  vector<double> &seconds;
+};
+
+class DescribeBody : public ParallelLoopBody
+{
+public:
+  DescribeBody (const vector<Mat> &g, const vector< vector<KeyPoint> > &k, const FeatureExtractor &e, vector<Features> &f, vector<double> &s)
+    : gray (g), detected (k), extractor (e), features (f), seconds (s) {}
+
+  void operator() (const Range &range) const
+  {
+    const SurfParams &params = extractor.params();
+    for (int i = range.start; i < range.end; i++)
+    {
+      int64 t0 = getTickCount();
+      features[i].keypoints = detected[i];
+      filter_keypoints (features[i].keypoints, params.sizeMin, params.responseMin);
+      extractor.describe (gray[i], features[i].keypoints, features[i].descriptors);
+      seconds[i] = (getTickCount() - t0)/getTickFrequency();
+    }
+  }
+
+private:
+  const vector<Mat> &gray;
+  const vector< vector<KeyPoint> > &detected;
+  const FeatureExtractor &extractor;
+  vector<Features> &features;
+  vector<double> &seconds;
+};
+
+class QueryBody : public ParallelLoopBody
+{
+public:
+  QueryBody (const vector<Features> &f, const vector< pair<int,int> > &p, int t, vector<int> &fd, vector<double> &s)
+    : features (f), pairs (p), top (t), found (fd), seconds (s) {}
+
+  void operator() (const Range &range) const
+  {
+    vector<DMatch> matches;
+    vector<int> counts (features.size());
+    for (int p = range.start; p < range.end; p++)
+    {
+      int query = pairs[p].first;
+      int target = pairs[p].second;
+
+      // the first image of the pair is matched against all the others, as scanDatabase would
+      int64 t0 = getTickCount();
+      for (int i = 0; i < features.size(); i++)
+        counts[i] = i == query ? -1 : match_features (features[query], features[i], matches);
+      seconds[p] = (getTickCount() - t0)/getTickFrequency();
+
+      // found if it has matches (scanDatabase reports distances > 1) and ranks within "top"
+      int rank = 0;
+      for (int i = 0; i < features.size(); i++)
+        if (counts[i] > counts[target])
+          rank++;
+      found[p] = counts[target] > 1 && rank < top;
+    }
+  }
+
+private:
+  const vector<Features> &features;
+  const vector< pair<int,int> > &pairs;
+  int top;
+  vector<int> &found;
+  vector<double> &seconds;
+};
+
+static double mean (const vector<double> &values)
+{
+  double sum = 0;
+  for (int i = 0; i < values.size(); i++)
+    sum += values[i];
+  return values.size() > 0 ? sum/values.size() : 0;
+}
+
+static double cost (const Setting &setting, string criterion)
+{
+  if (criterion == "extract")
+    return setting.extractSeconds;
+  if (criterion == "total")
+    return setting.extractSeconds + setting.querySeconds;
+  return setting.querySeconds;
+}
+
+int main(int argc, char** argv)
+{
+/* ===============================================================================================
+   Show usage if needed
+   =============================================================================================== */
+  if (argc < 2)
+    return usage();
+
+  string input = argv[1];
+  if( input == "-h" || input == "-help" )
+    return usage();
+
+  string pairfile, gridfile, imgdir;
+  string param = "";
+  int nother = 100;             // images of -d added to the sample
+  int top = 5;                  // a pair is found if its second image ranks within "top"
+  double target = 0.9;          // recall the recommended setting must reach
+  string criterion = "query";   // time minimised by the recommendation
+  int nthreads = 0;
+  string reportfile = "";
+  string outparam = "";
+
+  read_flags (argc, argv, &pairfile, &gridfile, &param, &imgdir, &nother, &top, &target, &criterion, &nthreads, &reportfile, &outparam);
+  if (pairfile == "" || gridfile == "")
+    return usage();
+  if (imgdir != "" && nother < 1)
+  {
+    cout << "at least one image of " << imgdir << " must be added to the sample (-n)" << endl;
+    return -1;
+  }
+
+  SurfParams base;
+  if (param != "")
+    read_surfparams (param, base);
+
+  vector<SurfParams> settings;
+  if (read_grid (gridfile, base, settings) != 0)
+  {
+    cout << "could not read grid file " << gridfile << endl;
+    return -1;
+  }
+
+/* ===============================================================================================
+   The sample: the images of the labelled pairs, plus images of -d spread over the directory
+   =============================================================================================== */
+  vector<string> images;
+  vector< pair<int,int> > pairs;
+  if (read_pairs (pairfile, images, pairs) != 0 || pairs.size() == 0)
+  {
+    cout << "no pairs in " << pairfile << endl;
+    return -1;
+  }
+  int npaired = images.size();
+
+  if (imgdir != "")
+  {
+    if (*imgdir.rbegin() != '/')
+      imgdir.append ("/");
+    vector<string> files;
+    get_imagelist (imgdir, files);
+    sort (files.begin(), files.end());
+    int step = files.size() > nother ? files.size()/nother : 1;
+    for (int i = 0; i < files.size() && images.size() - npaired < nother; i += step)
+      if (find (images.begin(), images.end(), imgdir + files[i]) == images.end())
+        images.push_back (imgdir + files[i]);
+  }
+
+  double freq = getTickFrequency();
+  int nimages = images.size();
+  vector<Mat> gray (nimages);
+  int64 t0 = getTickCount();
+  run_parallel (Range (0, nimages), DecodeBody (images, gray), nthreads);
+  double tdecode = (getTickCount() - t0)/freq;
+
+  for (int i = 0; i < nimages; i++)
+    if (gray[i].empty())
+    {
+      cout << "could not read " << images[i] << endl;
+      return -1;
+    }
+
+  cout << "Sample: " << nimages << " images (" << npaired << " in " << pairs.size() << " pairs), decoded once in " << tdecode << " s" << endl;
+  cout << "Grid: " << settings.size() << " settings" << endl << endl;
+
+/* ===============================================================================================
+   Every setting: detection is shared by the settings that differ only by the size and
+   response filters (read_grid orders the settings so that they are consecutive), then
+   filter, describe and query
+   =============================================================================================== */
+  vector<Setting> results;
+  vector< vector<KeyPoint> > detected (nimages);
+  vector<double> tdetect (nimages), tdescribe (nimages), tquery (pairs.size());
+  vector<Features> features (nimages);
+  vector<int> found (pairs.size());
+
+  cout << "desc   minHessian  octaves  layers  maxFeat  thresh  minSize  minResp   extract ms   kpts/img   desc KB/img   query ms   recall" << endl;
+  cout << fixed;
+
+  for (int s = 0; s < settings.size(); s++)
+  {
+    const SurfParams &params = settings[s];
+    bool newdetection = s == 0 || params.descriptor != settings[s-1].descriptor || params.minHessian != settings[s-1].minHessian || params.octaves != settings[s-1].octaves
+      || params.octaveLayers != settings[s-1].octaveLayers || params.maxFeatures != settings[s-1].maxFeatures || params.threshold != settings[s-1].threshold;
+    if (newdetection)
+    {
+      Ptr<Feature2D> detector = create_feature2d (params);
+      run_parallel (Range (0, nimages), DetectBody (gray, *detector, detected, tdetect), nthreads);
+    }
+
+    FeatureExtractor extractor (params);
+    run_parallel (Range (0, nimages), DescribeBody (gray, detected, extractor, features, tdescribe), nthreads);
+    run_parallel (Range (0, pairs.size()), QueryBody (features, pairs, top, found, tquery), nthreads);
+
+    Setting result;
+    result.params = params;
+    result.extractSeconds = mean (tdetect) + mean (tdescribe);
+    result.querySeconds = mean (tquery);
+    long keypoints = 0, bytes = 0;
+    int nfound = 0;
+    for (int i = 0; i < nimages; i++)
+    {
+      keypoints += features[i].keypoints.size();
+      bytes += features[i].descriptors.total()*features[i].descriptors.elemSize();
+    }
+    for (int p = 0; p < pairs.size(); p++)
+      nfound += found[p];
+    result.keypoints = (double) keypoints/nimages;
+    result.descriptorBytes = (double) bytes/nimages;
+    result.recall = (double) nfound/pairs.size();
+    results.push_back (result);
+
+    cout << left << setw(6) << descriptor_name (params.descriptor) << right;
+    cout << setw(11) << params.minHessian << setw(9) << params.octaves << setw(8) << params.octaveLayers << setw(9) << params.maxFeatures << setw(8) << params.threshold;
+    cout << setw(9) << params.sizeMin << setprecision(1) << setw(9) << params.responseMin;
+    cout << setprecision(2) << setw(13) << 1000*result.extractSeconds << setw(11) << setprecision(1) << result.keypoints;
+    cout << setw(14) << result.descriptorBytes/1024 << setprecision(2) << setw(11) << 1000*result.querySeconds;
+    cout << setprecision(3) << setw(9) << result.recall << endl;
+  }
+  cout.unsetf (ios::floatfield);
+
+/* ===============================================================================================
+   Recommendation: the fastest setting (by query, extraction or total time) reaching the target
+   recall; if none does, the setting with the best recall
+   =============================================================================================== */
+  int best = -1;
+  for (int s = 0; s < results.size(); s++)
+    if (results[s].recall >= target && (best < 0 || cost (results[s], criterion) < cost (results[best], criterion)))
+      best = s;
+
+  cout << endl;
+  if (best >= 0)
+    cout << "Fastest setting (" << criterion << " time) with a recall of at least " << target << ":" << endl;
+  else
+  {
+    for (int s = 0; s < results.size(); s++)
+      if (best < 0 || results[s].recall > results[best].recall)
+        best = s;
+    cout << "No setting reaches a recall of " << target << "; best recall (" << results[best].recall << "):" << endl;
+  }
+
+  const SurfParams &chosen = results[best].params;
+  ostringstream recommended;
+  recommended << "descriptor: " << descriptor_name (chosen.descriptor) << endl;
+  recommended << "minHessian: " << chosen.minHessian << endl;
+  recommended << "octaves: " << chosen.octaves << endl;
+  recommended << "octaveLayers: " << chosen.octaveLayers << endl;
+  recommended << "min Size: " << chosen.sizeMin << endl;
+  recommended << "min Response: " << chosen.responseMin << endl;
+  recommended << "max Features: " << chosen.maxFeatures << endl;
+  recommended << "threshold: " << chosen.threshold << endl;
+  cout << recommended.str();
+
+  if (outparam != "")
+  {
+    ofstream out (outparam.c_str());
+    out << recommended.str();
+  }
+
+  if (reportfile != "")
+  {
+    ofstream csv (reportfile.c_str());
+    csv << "descriptor,minHessian,octaves,octaveLayers,maxFeatures,threshold,minSize,minResponse,extract_ms,keypoints_per_image,descriptor_bytes_per_image,query_ms,recall" << endl;
+    for (int s = 0; s < results.size(); s++)
+    {
+      const Setting &r = results[s];
+      csv << descriptor_name (r.params.descriptor) << "," << r.params.minHessian << "," << r.params.octaves << "," << r.params.octaveLayers << ",";
+      csv << r.params.maxFeatures << "," << r.params.threshold << "," << r.params.sizeMin << "," << r.params.responseMin;
+      csv << "," << 1000*r.extractSeconds << "," << r.keypoints << "," << r.descriptorBytes << "," << 1000*r.querySeconds << "," << r.recall << endl;
+    }
+  }
+
+  return 0;
+}
+
+/* ===============================================================================================
+   Grid file: the keys of the param file, each followed by one or more values, e.g.
+      descriptor: surf orb
+      minHessian: 1000 2000 4000
+      octaves: 4 5
+   Keys that are not given keep the value of "base". The settings are all the combinations,
+   ordered by the keys of the detection (descriptor, minHessian, octaves, octaveLayers,
+   max Features, threshold) first.
+   =============================================================================================== */
+static bool same_setting (const SurfParams &a, const SurfParams &b)
+{
+  return a.descriptor == b.descriptor && a.minHessian == b.minHessian && a.octaves == b.octaves && a.octaveLayers == b.octaveLayers
+    && a.maxFeatures == b.maxFeatures && a.threshold == b.threshold && a.sizeMin == b.sizeMin && a.responseMin == b.responseMin;
+}
+
+int read_grid (string gridfile, const SurfParams &base, vector<SurfParams> &settings)
+{
+  ifstream in (gridfile.c_str());
+  if (!in.is_open())
+    return -1;
+
+  const int NKEYS = 8;
+  const char *keys[NKEYS] = { "descriptor", "minHessian", "octaves", "octaveLayers", "max Features", "threshold", "min Size", "min Response" };
+  vector<double> values[NKEYS];
+
+  string record;
+  while (getline (in, record))
+  {
+    int colon = record.find_last_of (":");
+    if (colon == string::npos)
+      continue;
+    for (int k = 0; k < NKEYS; k++)
+      if (record.substr (0, colon).find (keys[k]) != string::npos)
+      {
+        string list = record.substr (colon + 1);
+        replace (list.begin(), list.end(), ',', ' ');
+        stringstream ss (list);
+        string v;
+        while (ss >> v)
+        {
+          if (k > 0)
+            values[k].push_back (atof (v.c_str()));
+          else if (descriptor_type (v) >= 0)
+            values[k].push_back (descriptor_type (v));
+          else
+            return -1;
+        }
+      }
+  }
+
+  if (values[0].empty()) values[0].push_back (base.descriptor);
+  if (values[1].empty()) values[1].push_back (base.minHessian);
+  if (values[2].empty()) values[2].push_back (base.octaves);
+  if (values[3].empty()) values[3].push_back (base.octaveLayers);
+  if (values[4].empty()) values[4].push_back (base.maxFeatures);
+  if (values[5].empty()) values[5].push_back (base.threshold);
+  if (values[6].empty()) values[6].push_back (base.sizeMin);
+  if (values[7].empty()) values[7].push_back (base.responseMin);
+
+  // all the combinations, the last key varying fastest
+  settings.clear();
+  vector<int> at (NKEYS, 0);
+  while (true)
+  {
+    SurfParams params (values[1][at[1]], values[2][at[2]], values[3][at[3]], values[6][at[6]], values[7][at[7]]);
+    params.descriptor = values[0][at[0]];
+    params.maxFeatures = values[4][at[4]];
+    params.threshold = values[5][at[5]];
+
+    // keys that do not apply to the descriptor keep their first value, so that the
+    // combinations differing only by them are not run twice
+    if (params.descriptor == DESCRIPTOR_SURF)
+    {
+      params.maxFeatures = values[4][0];
+      params.threshold = values[5][0];
+    }
+    else
+    {
+      params.minHessian = values[1][0];
+      params.octaveLayers = values[3][0];
+      if (params.descriptor == DESCRIPTOR_ORB)
+        params.threshold = values[5][0];
+      else
+        params.maxFeatures = values[4][0];
+    }
+    bool seen = false;
+    for (int p = 0; p < settings.size() && !seen; p++)
+      seen = same_setting (settings[p], params);
+    if (!seen)
+      settings.push_back (params);
+
+    int k = NKEYS - 1;
+    while (k >= 0 && ++at[k] == values[k].size())
+      at[k--] = 0;
+    if (k < 0)
+      break;
+  }
+  return 0;
+}
+
+/* ===============================================================================================
+   Pair file: two image paths per line, the second one expected among the top hits of the
+   first; an image may appear in several pairs
+   =============================================================================================== */
+int read_pairs (string pairfile, vector<string> &images, vector< pair<int,int> > &pairs)
+{
+  ifstream in (pairfile.c_str());
+  if (!in.is_open())
+    return -1;
+
+  map<string,int> index;
+  string record;
+  while (getline (in, record))
+  {
+    stringstream ss (record);
+    string name[2];
+    if (!(ss >> name[0] >> name[1]))
+      continue;
+
+    int id[2];
+    for (int k = 0; k < 2; k++)
+    {
+      map<string,int>::const_iterator found = index.find (name[k]);
+      if (found == index.end())
+      {
+        id[k] = images.size();
+        index[name[k]] = id[k];
+        images.push_back (name[k]);
+      }
+      else
+        id[k] = found->second;
+    }
+    if (id[0] != id[1])
+      pairs.push_back (make_pair (id[0], id[1]));
+  }
+  return 0;
+}
+
+/* ===============================================================================================
+   Usage
+   =============================================================================================== */
+int usage()
+{
+    cout << "\n\n" <<endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=                                     TuneParams                                               ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     This program extracts the features of a sample of images with every setting of a grid    ="  << endl;
+    cout << "     " << "=     of feature parameters and reports speed, size and recall, then recommends a setting.     ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "=     Usage is:                                                                                ="  << endl;
+    cout << "     " << "=                 tuneParams.exe                                                               ="  << endl;
+    cout << "     " << "=                                 -pairs    <file of matching pairs: two image paths per line> ="  << endl;
+    cout << "     " << "=                                 -g        <grid file: param keys with several values>        ="  << endl;
+    cout << "     " << "=                                 -p        <param file for the keys missing from the grid>    ="  << endl;
+    cout << "     " << "=                                 -d        <directory of other images added to the sample>    ="  << endl;
+    cout << "     " << "=                                 -n        <number of images taken from -d> (100)             ="  << endl;
+    cout << "     " << "=                                 -top      <rank within which a pair is found> (5)            ="  << endl;
+    cout << "     " << "=                                 -recall   <target recall> (0.9)                              ="  << endl;
+    cout << "     " << "=                                 -by       <query|extract|total: time to minimise> (query)    ="  << endl;
+    cout << "     " << "=                                 -t        <number of threads> (one per core)                 ="  << endl;
+    cout << "     " << "=                                 -o        <path to CSV report> (optional)                    ="  << endl;
+    cout << "     " << "=                                 -w        <path for the recommended param file> (optional)   ="  << endl;
+    cout << "     " << "=                                                                                              ="  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "     " << "================================================================================================"  << endl;
+    cout << "\n\n" <<endl;
+
+  return -1;
+}
+
+/* ===============================================================================================
+   Procedure to read in flag values
+   =============================================================================================== */
+void read_flags(int argc, char** argv, string *pairfile, string *gridfile, string *param, string *imgdir, int *nother, int *top, double *target, string *criterion, int *nthreads, string *reportfile, string *outparam)
+{
+  string input;
+  for(int i = 1; i < argc; i++)
+  {
+    input = argv[i];
+    if (input == "-pairs")
+      *pairfile = argv[i + 1];
+    if (input == "-g")
+      *gridfile = argv[i + 1];
+    if (input == "-p")
+      *param = argv[i + 1];
+    if (input == "-d")
+      *imgdir = argv[i + 1];
+    if (input == "-n")
+      *nother = atoi(argv[i + 1]);
+    if (input == "-top")
+      *top = atoi(argv[i + 1]);
+    if (input == "-recall")
+      *target = atof(argv[i + 1]);
+    if (input == "-by")
+      *criterion = argv[i + 1];
+    if (input == "-t")
+      *nthreads = atoi(argv[i + 1]);
+    if (input == "-o")
+      *reportfile = argv[i + 1];
+    if (input == "-w")
+      *outparam = argv[i + 1];
+  }
+}